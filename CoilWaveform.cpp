@@ -0,0 +1,270 @@
+/*
+CoilWaveform.cpp - Hardware timed, buffered coil output
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "Vision.h"
+#include "Controller.h"
+#include "Input.h"
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+/**====================================================
+* Function to precompute the samples of an open loop actuation
+* Input: Schedule (mask, duty, PWM period, length), sample rate, pattern (output)
+* Output: NULL
+*======================================================*/
+void MakeCoilPattern(const CoilSchedule& schedule, double sampleRate, CoilPattern& pattern)
+{
+	size_t samples = (size_t)llround(schedule.ms * sampleRate / 1000.0);
+	long long period = llround(schedule.periodMs * sampleRate / 1000.0);
+	long long on = llround(schedule.duty * period);
+
+	pattern.resize(samples);
+	for (size_t i = 0; i < samples; i++)
+	{
+		bool active = schedule.duty >= 1.0 || period <= 0 || (long long)(i % period) < on;
+		pattern[i] = active ? schedule.mask : 0;
+	}
+}
+
+//Constructor
+CoilWaveform::CoilWaveform() : streaming(false), failed(false), frameMask(0), forcedOff(false), cancelBefore(0)
+{
+	taskHandle = 0;
+	rate = waveformRate;
+	bufferSamples = 0;
+	chunkSamples = 0;
+	running = 0;
+	nextSequence = 0;
+	current.pattern = NULL;
+	current.sequence = 0;
+	position = 0;
+	samplesWritten = 0;
+	patternsPlayed = 0;
+	patternsCancelled = 0;
+	errBuff[0] = '\0';
+}
+
+CoilWaveform::~CoilWaveform()
+{
+	stop();
+}
+
+bool CoilWaveform::check(int32 error)
+{
+	if (!DAQmxFailed(error))
+		return true;
+	DAQmxGetExtendedErrorInfo(errBuff, sizeof(errBuff));
+	printf("DAQmx Error: %s\n", errBuff);
+	return false;
+}
+
+/**====================================================
+* Function to configure the sample clocked task, fill the buffer with the
+* coils off and start the generation and the streaming thread
+* Input: DO channel, sample rate (samples/s)
+* Output: bool (1 if streaming)
+*======================================================*/
+bool CoilWaveform::start(const std::string& channel, double sampleRate)
+{
+	if (running)
+		return true;
+
+	rate = sampleRate;
+	bufferSamples = (uInt32)(rate * waveformBufferMs / 1000.0);
+	chunkSamples = (uInt32)(rate * waveformChunkMs / 1000.0);
+	if (chunkSamples == 0 || chunkSamples > bufferSamples)
+	{
+		cout << "Coil waveform: the buffer must hold at least one chunk" << endl;
+		return false;
+	}
+	chunk.assign(bufferSamples, 0);
+
+	int32 written = 0;
+	bool ok = check(DAQmxCreateTask("", &taskHandle))
+		&& check(DAQmxCreateDOChan(taskHandle, channel.c_str(), "", DAQmx_Val_ChanForAllLines))
+		&& check(DAQmxCfgSampClkTiming(taskHandle, "", rate, DAQmx_Val_Rising, DAQmx_Val_ContSamps, bufferSamples))
+		&& check(DAQmxSetWriteRegenMode(taskHandle, DAQmx_Val_DoNotAllowRegen))
+		&& check(DAQmxCfgOutputBuffer(taskHandle, bufferSamples))
+		&& check(DAQmxWriteDigitalU8(taskHandle, bufferSamples, 0, 1.0, DAQmx_Val_GroupByChannel, chunk.data(), &written, NULL))
+		&& check(DAQmxStartTask(taskHandle));
+	if (!ok)
+	{
+		if (taskHandle != 0)
+			DAQmxClearTask(taskHandle);
+		taskHandle = 0;
+		return false;
+	}
+
+	chunk.resize(chunkSamples);
+	samplesWritten = written;
+	patternsPlayed = 0;
+	patternsCancelled = 0;
+	failed = false;
+	streaming = true;
+	running = 1;
+	streamThread = std::thread(&CoilWaveform::stream, this);
+	return true;
+}
+
+/**====================================================
+* Function to stop streaming. The buffer is ended with a chunk of coils off and
+* the generation is stopped inside it, before the buffer runs out.
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void CoilWaveform::stop()
+{
+	if (!running)
+		return;
+	streaming = false;
+	if (streamThread.joinable())
+		streamThread.join();
+
+	if (!hasFailed())
+	{
+		int32 written = 0;
+		chunk.assign(chunkSamples, 0);
+		if (check(DAQmxWriteDigitalU8(taskHandle, chunkSamples, 0, 1.0, DAQmx_Val_GroupByChannel, chunk.data(), &written, NULL)))
+		{
+			samplesWritten += written;
+			uInt64 generated = 0;
+			for (int i = 0; i < 1000 && generated + chunkSamples / 2 < samplesWritten; i++)
+			{
+				if (!check(DAQmxGetWriteTotalSampPerChanGenerated(taskHandle, &generated)))
+					break;
+				SleepMs(1);
+			}
+		}
+	}
+	DAQmxStopTask(taskHandle);
+	DAQmxClearTask(taskHandle);
+	taskHandle = 0;
+
+	QueuedPattern item;
+	if (current.pattern)
+		drop(current);
+	while (patterns.pop(item))
+		drop(item);
+	running = 0;
+}
+
+/**====================================================
+* Function to queue a pattern after the ones already queued (takes ownership)
+* Input: Pattern
+* Output: bool (0 if the queue is full, the pattern is then deleted)
+*======================================================*/
+bool CoilWaveform::play(CoilPattern* pattern)
+{
+	QueuedPattern item = { pattern, nextSequence++ };
+	if (!running || !patterns.push(item))
+	{
+		delete pattern;
+		return false;
+	}
+	return true;
+}
+
+/**====================================================
+* Function to drop the playing pattern and the queued ones (not those
+* queued later)
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void CoilWaveform::cancel()
+{
+	cancelBefore.store(nextSequence, std::memory_order_release);
+}
+
+void CoilWaveform::drop(QueuedPattern& item)
+{
+	delete item.pattern;
+	item.pattern = NULL;
+	patternsCancelled++;
+}
+
+/**====================================================
+* Function to fill the next chunk: pattern samples, the frame mask otherwise,
+* zeros while forced off
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void CoilWaveform::fillChunk()
+{
+	if (forcedOff.load(std::memory_order_acquire))
+	{
+		QueuedPattern item;
+		if (current.pattern)
+			drop(current);
+		while (patterns.pop(item))
+			drop(item);
+		for (uInt32 i = 0; i < chunkSamples; i++)
+			chunk[i] = 0;
+		return;
+	}
+
+	unsigned cancelled = cancelBefore.load(std::memory_order_acquire);
+	if (current.pattern && current.sequence < cancelled)
+		drop(current);
+
+	for (uInt32 i = 0; i < chunkSamples; i++)
+	{
+		while (!current.pattern && patterns.pop(current))
+		{
+			position = 0;
+			if (current.sequence < cancelled || current.pattern->empty())
+				drop(current);
+		}
+		if (current.pattern)
+		{
+			chunk[i] = (*current.pattern)[position++];
+			if (position >= current.pattern->size())
+			{
+				delete current.pattern;
+				current.pattern = NULL;
+				patternsPlayed++;
+			}
+		}
+		else
+			chunk[i] = frameMask.load(std::memory_order_relaxed);
+	}
+}
+
+/**====================================================
+* Function run by the streaming thread: every write blocks until the device
+* has room for the chunk
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void CoilWaveform::stream()
+{
+	while (streaming)
+	{
+		fillChunk();
+		int32 written = 0;
+		if (!check(DAQmxWriteDigitalU8(taskHandle, chunkSamples, 0, 1.0, DAQmx_Val_GroupByChannel, chunk.data(), &written, NULL)))
+		{
+			failed.store(true, std::memory_order_release);
+			return;
+		}
+		samplesWritten += written;
+	}
+}
+
+/**====================================================
+* Function to print the samples and patterns streamed (after stop)
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void CoilWaveform::PrintReport()
+{
+	cout << "Coil waveform: " << samplesWritten << " samples at " << rate << " samples/s ("
+		<< samplesWritten / rate << " s), " << patternsPlayed << " patterns played, "
+		<< patternsCancelled << " cancelled" << (hasFailed() ? ", stopped on a DAQ error" : "") << endl;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#ifndef COILWAVEFORM_H
+#define COILWAVEFORM_H
+
+#include "SpscQueue.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*	Note: Hardware timed coil output
+*	With Controller::useWaveform the coil port is driven by a sample clocked,
+*	buffered DO task (continuous samples, regeneration disabled) instead of the
+*	on demand writes. A streaming thread keeps the device buffer filled, one chunk
+*	per write, and the writes block until the device has room, so the sample clock
+*	of the card paces the output and host jitter only changes how full the buffer
+*	is. Each sample is either the next sample of a queued pattern or, when no
+*	pattern is playing, the mask of the last frame.
+*	Patterns are precomputed sample arrays (MakeCoilPattern: a pulse or a PWM of
+*	one mask), so an open loop actuation switches the coils on the sample clock
+*	whatever the frame rate. The loop hands them over through a lock-free queue;
+*	cancel drops the pattern being played and those queued before it.
+*	Latency of a frame mask or a pattern: up to waveformBufferMs + waveformChunkMs.
+*	If the thread misses the buffer (underflow) the generation stops, the lines keep
+*	the last sample and Controller falls back to on demand writes on its next frame.
+*	The watchdog (Watchdog.h) can force the coils off from its own thread.
+*	Needs a port with hardware timed lines (port0 of X Series cards). TaskHandle
+*	comes from the DAQmx header included by Controller.h.
+*/
+
+#define waveformRate 100000.0	// samples/s (10 us resolution)
+#define waveformBufferMs 10.0	// device buffer
+#define waveformChunkMs 2.0		// samples per write
+#define maxQueuedPatterns 16
+
+typedef std::vector<unsigned char> CoilPattern;
+
+// Open loop actuation of one mask, duty 1 for a plain pulse
+struct CoilSchedule
+{
+	unsigned char mask;
+	double duty;		// 0 - 1
+	double periodMs;	// PWM period
+	double ms;			// length
+};
+
+void MakeCoilPattern(const CoilSchedule& schedule, double sampleRate, CoilPattern& pattern);
+
+class CoilWaveform
+{
+public:
+	//Constructor
+	CoilWaveform();
+	~CoilWaveform();
+
+	bool start(const std::string& channel, double sampleRate = waveformRate);
+	void stop();
+	bool isRunning() { return running; }
+	bool hasFailed() { return failed.load(std::memory_order_acquire); }
+	bool isStreaming() { return streaming.load(std::memory_order_acquire) && !hasFailed(); }
+	double getRate() { return rate; }
+
+	// Mask of the frame, output while no pattern is playing
+	void setFrameMask(unsigned char mask) { frameMask.store(mask, std::memory_order_relaxed); }
+
+	bool play(CoilPattern* pattern);
+	void cancel();
+
+	// Watchdog (any thread): coils off and the patterns dropped until released
+	void setForcedOff(bool off) { forcedOff.store(off, std::memory_order_release); }
+
+	void PrintReport();
+
+private:
+	struct QueuedPattern
+	{
+		CoilPattern* pattern;
+		unsigned sequence;
+	};
+
+	void stream();
+	bool check(int32 error);
+	void fillChunk();
+	void drop(QueuedPattern& item);
+
+	TaskHandle taskHandle;
+	double rate;
+	uInt32 bufferSamples;
+	uInt32 chunkSamples;
+	std::vector<uInt8> chunk;
+
+	std::thread streamThread;
+	bool running;
+	std::atomic<bool> streaming;
+	std::atomic<bool> failed;
+	std::atomic<unsigned char> frameMask;
+	std::atomic<bool> forcedOff;
+
+	SpscQueue<QueuedPattern, maxQueuedPatterns> patterns;
+	unsigned nextSequence;					// loop thread
+	std::atomic<unsigned> cancelBefore;		// patterns with a lower sequence are dropped
+	QueuedPattern current;					// streaming thread
+	size_t position;
+
+	// Report
+	uInt64 samplesWritten;
+	long patternsPlayed, patternsCancelled;
+	char errBuff[2048];
+};
+
+#endif //COILWAVEFORM_H
@@ -0,0 +1,240 @@
+/*
+CommandServer.cpp - Local socket command server for external planners
+Date: 2026-10-18
+Author: agent
+*/
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET socket_t;
+#define closeSocket closesocket
+#else
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closeSocket close
+#endif
+
+#include "CommandServer.h"
+#include "Profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+/**====================================================
+* Function to wait until a socket is readable
+* Input: socket, timeout (ms)
+* Output: bool (1 if readable)
+*======================================================*/
+static bool waitReadable(socket_t s, int timeout_ms)
+{
+	fd_set set;
+	FD_ZERO(&set);
+	FD_SET(s, &set);
+	timeval timeout;
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+	return select((int)s + 1, &set, NULL, NULL, &timeout) > 0;
+}
+
+/**====================================================
+* Function to read exactly n bytes (gives up when the server stops)
+* Input: socket, buffer, size, running flag
+* Output: bool (0 on disconnect or stop)
+*======================================================*/
+static bool readFully(socket_t s, unsigned char* buffer, size_t n, const std::atomic<bool>& running)
+{
+	size_t got = 0;
+	while (got < n)
+	{
+		if (!running)
+			return false;
+		if (!waitReadable(s, 100))
+			continue;
+		int r = (int)recv(s, (char*)buffer + got, (int)(n - got), 0);
+		if (r <= 0)
+			return false;
+		got += r;
+	}
+	return true;
+}
+
+//Constructor
+CommandServer::CommandServer()
+{
+	running = false;
+	listenSocket = (long long)INVALID_SOCKET;
+	received = 0;
+	rejected = 0;
+	dropped = 0;
+}
+
+CommandServer::~CommandServer()
+{
+	stop();
+}
+
+/**====================================================
+* Function to create the socket and start the server thread
+* Input: Socket path
+* Output: bool (1 if listening)
+*======================================================*/
+bool CommandServer::start(const std::string& path)
+{
+	if (running)
+		return true;
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		cout << "Command server: WSAStartup failed" << endl;
+		return false;
+	}
+#endif
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		cout << "Command server: socket path too long" << endl;
+		return false;
+	}
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+	socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == INVALID_SOCKET)
+	{
+		cout << "Command server: could not create socket" << endl;
+		return false;
+	}
+
+	remove(path.c_str()); // stale socket of a previous run
+	if (bind(s, (sockaddr*)&address, sizeof(address)) != 0 || listen(s, 1) != 0)
+	{
+		cout << "Command server: could not listen on " << path << endl;
+		closeSocket(s);
+		return false;
+	}
+
+	socketPath = path;
+	listenSocket = (long long)s;
+	running = true;
+	thread = std::thread(&CommandServer::serve, this);
+	cout << "Command server listening on " << path << endl;
+	return true;
+}
+
+void CommandServer::stop()
+{
+	if (!running)
+		return;
+	running = false;
+	thread.join();
+	closeSocket((socket_t)listenSocket);
+	listenSocket = (long long)INVALID_SOCKET;
+	remove(socketPath.c_str());
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	cout << "Command server: " << received << " commands, " << rejected << " rejected, " << dropped << " dropped" << endl;
+}
+
+/**====================================================
+* Server thread: accepts one client at a time and queues its commands
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void CommandServer::serve()
+{
+	unsigned char payload[65536];
+
+	while (running)
+	{
+		if (!waitReadable((socket_t)listenSocket, 100))
+			continue;
+		socket_t client = accept((socket_t)listenSocket, NULL, NULL);
+		if (client == INVALID_SOCKET)
+			continue;
+
+		CommandHeader header;
+		while (readFully(client, (unsigned char*)&header, sizeof(header), running)
+			&& readFully(client, payload, header.length, running))
+		{
+			if (!handle(header, payload))
+				rejected++;
+		}
+		closeSocket(client);
+	}
+}
+
+/**====================================================
+* Function to parse one message into a queued command
+* Input: Header, payload
+* Output: bool (0 if the message is malformed)
+*======================================================*/
+bool CommandServer::handle(const CommandHeader& header, const unsigned char* payload)
+{
+	RemoteCommand command;
+	command.type = header.type;
+	command.sequence = header.sequence;
+	command.ticks = StageProfiler::now();
+	command.id = 0;
+	command.argument = 0;
+	command.value = 0;
+	command.append = false;
+	command.count = 0;
+
+	switch (header.type)
+	{
+	case CMD_SET_TARGET:
+		if (header.length != 2 * sizeof(float))
+			return false;
+		memcpy(command.points, payload, 2 * sizeof(float));
+		command.count = 1;
+		break;
+
+	case CMD_WAYPOINTS:
+		if (header.length < 2)
+			return false;
+		command.append = payload[0] != 0;
+		command.count = payload[1];
+		if (command.count > maxWaypointsPerCommand || header.length != 2 + command.count * 2 * sizeof(float))
+			return false;
+		memcpy(command.points, payload + 2, command.count * 2 * sizeof(float));
+		break;
+
+	case CMD_SET_MODE:
+		if (header.length != 1 + sizeof(int32_t))
+			return false;
+		command.id = payload[0];
+		int32_t argument;
+		memcpy(&argument, payload + 1, sizeof(argument));
+		command.argument = argument;
+		break;
+
+	case CMD_SET_PARAM:
+		if (header.length != 1 + sizeof(double))
+			return false;
+		command.id = payload[0];
+		memcpy(&command.value, payload + 1, sizeof(double));
+		break;
+
+	default:
+		return false;
+	}
+
+	received++;
+	if (!queue.push(command))
+		dropped++;
+	return true;
+}
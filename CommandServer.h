@@ -0,0 +1,109 @@
+#pragma once
+#ifndef COMMANDSERVER_H
+#define COMMANDSERVER_H
+
+#include "SpscQueue.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+/*	Note: Command server
+*	A Unix-domain socket (AF_UNIX, also available on Windows 10) that lets an
+*	external planner drive the rig. One client at a time, no replies. Every message
+*	is an 8 byte header followed by the payload, little endian:
+*		uint16 type, uint16 payload length, uint32 sequence number
+*	Payloads:
+*		CMD_SET_TARGET	float u, float v							(pixels)
+*		CMD_WAYPOINTS	uint8 append, uint8 count, count x (float u, float v)
+*						in multi particle mode point k is the target of particle k
+*		CMD_SET_MODE	uint8 mode (RemoteMode), int32 argument
+*		CMD_SET_PARAM	uint8 parameter (RemoteParam), float64 value
+*	The server thread only parses and queues the commands. The loop applies them
+*	at the start of a frame, and the time from reception to the next DAQ write is
+*	recorded as the Command stage of the latency report.
+*	With several rigs (rigs.txt) every rig has its own server on <rig name>.sock.
+*/
+
+#define commandSocketPath "ferro_rig.sock"
+#define maxWaypointsPerCommand 64
+
+typedef enum {
+	CMD_SET_TARGET = 1,
+	CMD_WAYPOINTS = 2,
+	CMD_SET_MODE = 3,
+	CMD_SET_PARAM = 4
+} CommandType;
+
+typedef enum {
+	REMOTE_MANUAL,
+	REMOTE_AUTOMATIC,
+	REMOTE_TRAJECTORY,	// argument: trajectory id, -1 stops the trajectory
+	REMOTE_OPEN_LOOP,	// argument: experiment id + 1 starts the experiment (file, then scripts), 0 stops
+	REMOTE_RECORDING,	// argument: 1 start, 0 stop
+	REMOTE_STOP,		// stop all operations
+	REMOTE_QUIT
+} RemoteMode;
+
+typedef enum {
+	PARAM_ALPHA,
+	PARAM_BETA,
+	PARAM_GAMMA,
+	PARAM_DELTA,
+	PARAM_MM2PIX,
+	PARAM_SCALING_POWER,
+	PARAM_TRACKING_SPEED	// mm/s of timed tracking
+} RemoteParam;
+
+#pragma pack(push, 1)
+struct CommandHeader
+{
+	uint16_t type;
+	uint16_t length;
+	uint32_t sequence;
+};
+#pragma pack(pop)
+
+struct RemoteCommand
+{
+	uint16_t type;
+	uint32_t sequence;
+	long long ticks;	// StageProfiler::now() at reception
+	int id;				// mode or parameter
+	int argument;
+	double value;
+	bool append;
+	int count;
+	float points[2 * maxWaypointsPerCommand];
+};
+
+class CommandServer
+{
+public:
+	CommandServer();
+	~CommandServer();
+
+	bool start(const std::string& path = commandSocketPath);
+	void stop();
+	bool isRunning() { return running; }
+
+	// Consumer side, called by the loop
+	bool poll(RemoteCommand& command) { return queue.pop(command); }
+
+private:
+	void serve();
+	bool handle(const CommandHeader& header, const unsigned char* payload);
+
+	std::string socketPath;
+	std::atomic<bool> running;
+	std::thread thread;
+	long long listenSocket;
+	long received;
+	long rejected;
+	std::atomic<long> dropped;
+
+	SpscQueue<RemoteCommand, 1024> queue;
+};
+
+#endif //COMMANDSERVER_H
@@ -3,7 +3,17 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
+// Mock of the NI-DAQmx API (DAQmxMock.h), runs the DAQ code without the driver and the card
+#define mockDAQ
+#undef mockDAQ
+
+#ifdef mockDAQ
+#include "DAQmxMock.h"
+#else
 #include <NIDAQmx.h>
+#endif
+#include "ForceModel.h"
+#include "CoilWaveform.h"
 
 #include <ilcplex/ilocplex.h>
 
@@ -21,22 +31,42 @@ ILOSTLBEGIN
 #define coil7_key 6
 #define coil8_key 7
 
-extern bool keyboardInputEnabled;
 void lpkeyboardInput();
-extern bool PrintToConsole;
+extern thread_local bool PrintToConsole;
+extern thread_local double mm2pix;
+extern thread_local double coilGain[nModelCoils];
+extern thread_local double coilExponent[nModelCoils];
 
 uInt8 lpModel(vpImagePoint particlePos, vpImagePoint target, vpImagePoint coilTip[]);
+double coilVelocityModel(int coil, double distance_mm);
+bool loadForceModel(const std::string& fileName = forceModelFile);
+void getForceModel(ForceModel& model);
+void setModelParameter(int parameter, double value);
+
+class ParticleSimulator;
 
 class Controller
 {
 public:
 	//Constructor
-	Controller();
+	Controller(const std::string& channel = "Dev1/port0");
 
 	void initDAQ();
 	void writeToDAQ(uInt8 data);
 	void stopDAQ();
 	void DAQ_ErrorHandling();
+	void useSimulator(ParticleSimulator *particleSimulator);
+
+	// Sample clocked output (CoilWaveform.h), call before initDAQ
+	void useWaveform(double sampleRate = waveformRate);
+	bool isWaveform() { return waveformMode; }
+	bool playSchedule(const CoilSchedule& schedule);
+	void releaseSchedule(bool cancel);
+
+	// Watchdog thread (Watchdog.h): coils off through a path of its own
+	bool forceOff();
+	void releaseForceOff();
+	bool isSimulated() { return simulator != NULL; }
 
 	uInt8 selectCoilsLP(vpImagePoint particlePos, vpImagePoint target, vpImagePoint coilTip[]);
 
@@ -44,7 +74,13 @@ public:
 
 private:
 
-	TaskHandle  taskHandle;
+	std::atomic<TaskHandle> taskHandle{ NULL };	// on demand task, also written by the watchdog thread
+	std::string doChannel;	// digital output port of the coils
+	ParticleSimulator *simulator = NULL;
+	CoilWaveform waveform;
+	bool waveformMode = 0;
+	double waveformSampleRate = waveformRate;
+	bool scheduleOwned = 0;	// the frame masks wait until the pattern is released
 	int32       error = 0;
 	char        errBuff[2048] = { '\0' };
 	
@@ -0,0 +1,324 @@
+/*
+DAQmxMock.cpp - Mock of the NI-DAQmx digital output API
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "Vision.h"
+#include "Controller.h"
+
+#ifdef mockDAQ
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+struct MockTask
+{
+	std::mutex lock;
+	std::string channel;
+	std::chrono::steady_clock::time_point created;
+
+	// Sample clock
+	bool timed = false;
+	double rate = 0;
+	uInt64 bufferSize = 0;
+	bool regeneration = true;
+
+	bool started = false;
+	std::chrono::steady_clock::time_point startTime;
+	uInt64 written = 0;			// samples written since the task was created
+	uInt64 generated = 0;		// samples generated since StartTask
+	int32 error = 0;			// sticky error of the generation
+
+	uInt8 last = 0;				// last value written (the lines start low)
+	std::vector<std::pair<uInt64, uInt8> > changes;	// sample number or us, value
+};
+
+static thread_local std::string lastError;
+
+// Started tasks, which hold their lines
+static std::mutex reservationLock;
+static std::vector<MockTask*> reservations;
+
+static int32 fail(int32 error, const std::string& message)
+{
+	lastError = message;
+	return error;
+}
+
+static MockTask* task(TaskHandle taskHandle)
+{
+	return (MockTask*)taskHandle;
+}
+
+/**====================================================
+* Function to reserve the lines of a task when it starts
+* Input: Task (locked)
+* Output: bool (0 if another started task holds the lines)
+*======================================================*/
+static bool reserve(MockTask* t)
+{
+	std::lock_guard<std::mutex> guard(reservationLock);
+	for (size_t i = 0; i < reservations.size(); i++)
+		if (reservations[i] != t && reservations[i]->channel == t->channel)
+			return false;
+	if (std::find(reservations.begin(), reservations.end(), t) == reservations.end())
+		reservations.push_back(t);
+	return true;
+}
+
+static void unreserve(MockTask* t)
+{
+	std::lock_guard<std::mutex> guard(reservationLock);
+	reservations.erase(std::remove(reservations.begin(), reservations.end(), t), reservations.end());
+}
+
+static int32 reservedError(MockTask* t)
+{
+	return fail(DAQmxErrorResourceReserved, "The specified resource is reserved. The operation could not be completed as specified. Lines: " + t->channel);
+}
+
+/**====================================================
+* Function to advance the emulated sample clock to the host time. Running out
+* of samples is only an error while the generation goes on, not when stopping.
+* Input: Task (locked), stopping
+* Output: NULL
+*======================================================*/
+static void advance(MockTask* t, bool stopping = false)
+{
+	if (!t->timed || !t->started || t->error)
+		return;
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t->startTime).count();
+	uInt64 clock = (uInt64)(elapsed * t->rate);
+	if (clock <= t->written)
+	{
+		t->generated = clock;
+		return;
+	}
+	if (t->regeneration || stopping)
+	{
+		// the buffer is played again, the mock only keeps the count
+		t->generated = t->regeneration ? clock : t->written;
+		return;
+	}
+	t->generated = t->written;
+	t->error = DAQmxErrorGenStoppedToPreventRegenOfOldSamples;
+}
+
+int32 DAQmxCreateTask(const char taskName[], TaskHandle* taskHandle)
+{
+	MockTask* t = new MockTask();
+	t->created = std::chrono::steady_clock::now();
+	*taskHandle = (TaskHandle)t;
+	return 0;
+}
+
+int32 DAQmxCreateDOChan(TaskHandle taskHandle, const char lines[], const char nameToAssignToLines[], int32 lineGrouping)
+{
+	if (!taskHandle)
+		return fail(DAQmxErrorInvalidTask, "Invalid task");
+	task(taskHandle)->channel = lines;
+	return 0;
+}
+
+int32 DAQmxCfgSampClkTiming(TaskHandle taskHandle, const char source[], float64 rate, int32 activeEdge, int32 sampleMode, uInt64 sampsPerChan)
+{
+	if (!taskHandle)
+		return fail(DAQmxErrorInvalidTask, "Invalid task");
+	MockTask* t = task(taskHandle);
+	std::lock_guard<std::mutex> guard(t->lock);
+	t->timed = true;
+	t->rate = rate;
+	if (t->bufferSize == 0)
+		t->bufferSize = sampsPerChan;
+	return 0;
+}
+
+int32 DAQmxSetWriteRegenMode(TaskHandle taskHandle, int32 data)
+{
+	if (!taskHandle)
+		return fail(DAQmxErrorInvalidTask, "Invalid task");
+	MockTask* t = task(taskHandle);
+	std::lock_guard<std::mutex> guard(t->lock);
+	t->regeneration = (data != DAQmx_Val_DoNotAllowRegen);
+	return 0;
+}
+
+int32 DAQmxCfgOutputBuffer(TaskHandle taskHandle, uInt32 numSampsPerChan)
+{
+	if (!taskHandle)
+		return fail(DAQmxErrorInvalidTask, "Invalid task");
+	MockTask* t = task(taskHandle);
+	std::lock_guard<std::mutex> guard(t->lock);
+	t->bufferSize = numSampsPerChan;
+	return 0;
+}
+
+int32 DAQmxStartTask(TaskHandle taskHandle)
+{
+	if (!taskHandle)
+		return fail(DAQmxErrorInvalidTask, "Invalid task");
+	MockTask* t = task(taskHandle);
+	std::lock_guard<std::mutex> guard(t->lock);
+	if (t->timed && t->written == 0)
+		return fail(DAQmxErrorOutputBufferEmpty, "Generation cannot be started, because the output buffer is empty");
+	if (!reserve(t))
+		return reservedError(t);
+	t->started = true;
+	t->startTime = std::chrono::steady_clock::now();
+	return 0;
+}
+
+int32 DAQmxStopTask(TaskHandle taskHandle)
+{
+	if (!taskHandle)
+		return fail(DAQmxErrorInvalidTask, "Invalid task");
+	MockTask* t = task(taskHandle);
+	std::lock_guard<std::mutex> guard(t->lock);
+	advance(t, true);
+	t->started = false;
+	unreserve(t);
+	return 0;
+}
+
+/**====================================================
+* Function to clear the task and write its output log
+* Input: Task
+* Output: Error code
+*======================================================*/
+int32 DAQmxClearTask(TaskHandle taskHandle)
+{
+	if (!taskHandle)
+		return fail(DAQmxErrorInvalidTask, "Invalid task");
+	MockTask* t = task(taskHandle);
+	{
+		std::lock_guard<std::mutex> guard(t->lock);
+		advance(t, true);
+	}
+	unreserve(t);
+
+	if (t->written == 0)
+	{
+		delete t;	// a task that never wrote keeps the log of the others
+		return 0;
+	}
+	std::string fileName = t->channel;
+	std::replace(fileName.begin(), fileName.end(), '/', '_');
+	std::ofstream log(fileName + "_mock.csv");
+	log << (t->timed ? "sample" : "us") << ",value" << endl;
+	for (size_t i = 0; i < t->changes.size(); i++)
+		log << t->changes[i].first << "," << (int)t->changes[i].second << endl;
+	if (t->timed)
+		log << "# rate " << t->rate << " written " << t->written << " generated " << t->generated
+			<< (t->error ? " stopped on underflow" : "") << endl;
+
+	delete t;
+	return 0;
+}
+
+/**====================================================
+* Function to write digital samples. On demand tasks change the lines at once,
+* sample clocked tasks wait for room in the buffer until the timeout.
+* Input: Task, samples, auto start, timeout (s), layout, data, samples written, reserved
+* Output: Error code
+*======================================================*/
+int32 DAQmxWriteDigitalU8(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout, const uInt8 writeArray[], int32* sampsPerChanWritten, bool32* reserved)
+{
+	if (!taskHandle)
+		return fail(DAQmxErrorInvalidTask, "Invalid task");
+	MockTask* t = task(taskHandle);
+	if (sampsPerChanWritten)
+		*sampsPerChanWritten = 0;
+
+	std::unique_lock<std::mutex> guard(t->lock);
+	if (!t->timed)
+	{
+		//An on demand write of a task that is not started starts it for the write
+		if (!t->started && !reserve(t))
+			return reservedError(t);
+		if (!t->started)
+			unreserve(t);
+		uInt64 us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t->created).count();
+		for (int32 i = 0; i < numSampsPerChan; i++)
+		{
+			if (writeArray[i] != t->last || t->changes.empty())
+				t->changes.push_back(std::make_pair(us, writeArray[i]));
+			t->last = writeArray[i];
+		}
+		t->written += numSampsPerChan;
+		if (sampsPerChanWritten)
+			*sampsPerChanWritten = numSampsPerChan;
+		return 0;
+	}
+
+	if ((uInt64)numSampsPerChan > t->bufferSize)
+		return fail(DAQmxErrorSamplesCanNotYetBeWritten, "More samples than the output buffer holds");
+	if (autoStart && !t->started && !reserve(t))
+		return reservedError(t);
+
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+		+ std::chrono::microseconds((long long)(timeout * 1e6));
+	while (true)
+	{
+		advance(t);
+		if (t->error)
+			return fail(t->error, "The generation has stopped to prevent the regeneration of old samples");
+		if (t->written - t->generated + numSampsPerChan <= t->bufferSize)
+			break;
+		if (!t->started)
+			return fail(DAQmxErrorSamplesCanNotYetBeWritten, "The output buffer is full and the task is not started");
+		if (timeout >= 0 && std::chrono::steady_clock::now() >= deadline)
+			return fail(DAQmxErrorSamplesCanNotYetBeWritten, "Some or all of the samples to write could not be written to the buffer yet");
+		guard.unlock();
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+		guard.lock();
+	}
+
+	for (int32 i = 0; i < numSampsPerChan; i++)
+	{
+		if (writeArray[i] != t->last || t->changes.empty())
+			t->changes.push_back(std::make_pair(t->written + i, writeArray[i]));
+		t->last = writeArray[i];
+	}
+	t->written += numSampsPerChan;
+	if (sampsPerChanWritten)
+		*sampsPerChanWritten = numSampsPerChan;
+
+	if (autoStart && !t->started)
+	{
+		t->started = true;
+		t->startTime = std::chrono::steady_clock::now();
+	}
+	return 0;
+}
+
+int32 DAQmxGetWriteTotalSampPerChanGenerated(TaskHandle taskHandle, uInt64* data)
+{
+	if (!taskHandle)
+		return fail(DAQmxErrorInvalidTask, "Invalid task");
+	MockTask* t = task(taskHandle);
+	std::lock_guard<std::mutex> guard(t->lock);
+	advance(t);
+	*data = t->generated;
+	return 0;
+}
+
+int32 DAQmxGetExtendedErrorInfo(char errorString[], uInt32 bufferSize)
+{
+	if (bufferSize == 0)
+		return 0;
+	strncpy(errorString, lastError.c_str(), bufferSize - 1);
+	errorString[bufferSize - 1] = '\0';
+	return 0;
+}
+
+#endif //mockDAQ
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef DAQMXMOCK_H
+#define DAQMXMOCK_H
+
+#include <stdint.h>
+
+/*	Note: Mock of the NI-DAQmx API
+*	Stands in for NIDAQmx.h and the driver when mockDAQ is defined (Controller.h),
+*	so the DAQ code of Controller and CoilWaveform runs on a machine without the
+*	card. Only the calls used here are provided, with the same names, types and
+*	error codes as NI-DAQmx.
+*	On demand tasks take every write immediately. Sample clocked tasks emulate the
+*	device: the samples written go to a buffer of the configured size, which the
+*	sample clock empties at the configured rate from StartTask on (steady clock of
+*	the host). A write waits for room in the buffer until its timeout. With
+*	regeneration disabled an empty buffer stops the generation with
+*	DAQmxErrorGenStoppedToPreventRegenOfOldSamples and the lines keep the last sample.
+*	A started task reserves its lines like the device does: starting (or auto
+*	starting) another task on the same lines fails with
+*	DAQmxErrorResourceReserved until the first one is stopped or cleared. Calls
+*	on one task from several threads are serialized.
+*	Every change of the output is logged (sample number for sample clocked tasks,
+*	microseconds since the start for on demand tasks) and written to
+*	<channel>_mock.csv when the task is cleared, e.g. Dev1_port0_mock.csv.
+*/
+
+typedef int32_t		int32;
+typedef uint8_t		uInt8;
+typedef uint32_t	uInt32;
+typedef uint64_t	uInt64;
+typedef double		float64;
+typedef uint32_t	bool32;
+typedef void*		TaskHandle;
+
+#define DAQmxFailed(error) ((error) < 0)
+
+#define DAQmx_Val_ChanForAllLines 1
+#define DAQmx_Val_GroupByChannel 0
+#define DAQmx_Val_Rising 10280
+#define DAQmx_Val_FiniteSamps 10178
+#define DAQmx_Val_ContSamps 10123
+#define DAQmx_Val_AllowRegen 10097
+#define DAQmx_Val_DoNotAllowRegen 10158
+#define DAQmx_Val_WaitInfinitely -1.0
+
+#define DAQmxErrorResourceReserved -50103
+#define DAQmxErrorInvalidTask -200088
+#define DAQmxErrorGenStoppedToPreventRegenOfOldSamples -200290
+#define DAQmxErrorSamplesCanNotYetBeWritten -200292
+#define DAQmxErrorOutputBufferEmpty -200462
+
+int32 DAQmxCreateTask(const char taskName[], TaskHandle* taskHandle);
+int32 DAQmxCreateDOChan(TaskHandle taskHandle, const char lines[], const char nameToAssignToLines[], int32 lineGrouping);
+int32 DAQmxCfgSampClkTiming(TaskHandle taskHandle, const char source[], float64 rate, int32 activeEdge, int32 sampleMode, uInt64 sampsPerChan);
+int32 DAQmxSetWriteRegenMode(TaskHandle taskHandle, int32 data);
+int32 DAQmxCfgOutputBuffer(TaskHandle taskHandle, uInt32 numSampsPerChan);
+int32 DAQmxStartTask(TaskHandle taskHandle);
+int32 DAQmxStopTask(TaskHandle taskHandle);
+int32 DAQmxClearTask(TaskHandle taskHandle);
+int32 DAQmxWriteDigitalU8(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart, float64 timeout, bool32 dataLayout, const uInt8 writeArray[], int32* sampsPerChanWritten, bool32* reserved);
+int32 DAQmxGetWriteTotalSampPerChanGenerated(TaskHandle taskHandle, uInt64* data);
+int32 DAQmxGetExtendedErrorInfo(char errorString[], uInt32 bufferSize);
+
+#endif //DAQMXMOCK_H
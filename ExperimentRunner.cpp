@@ -0,0 +1,682 @@
+/*
+ExperimentRunner.cpp - Experiments loaded from file and run as phase sequences
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "ExperimentRunner.h"
+#include "VisualServo.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+thread_local ExperimentRunner MyExperiments;
+
+typedef enum {
+	PHASE_GOTO,
+	PHASE_HOLD,
+	PHASE_WAIT,
+	PHASE_ACTUATE,
+	PHASE_RECORD_ON,
+	PHASE_RECORD_OFF,
+	PHASE_PWM
+} PhaseType;
+
+static const char* phaseNames[] = { "goto", "hold", "wait", "actuate", "record on", "record off", "pwm" };
+
+static vector<string> split(const string& text, char separator)
+{
+	vector<string> parts;
+	stringstream ss(text);
+	string part;
+	while (getline(ss, part, separator))
+		parts.push_back(part);
+	return parts;
+}
+
+//Constructor
+ExperimentRunner::ExperimentRunner()
+{
+	originU = 0;
+	originV = 0;
+	running = 0;
+	current = -1;
+	combination = 0;
+	combinations = 0;
+	repetition = 0;
+	trial = 0;
+	phase = 0;
+	phaseEntered = 0;
+	phaseStart = 0;
+	phaseArgCount = 0;
+	actuations = 0;
+	recordingStarted = 0;
+}
+
+/**====================================================
+* Function to load the experiments from a file
+* Input: File name
+* Output: bool (1 if at least one experiment was loaded)
+*======================================================*/
+bool ExperimentRunner::Load(const std::string& fileName)
+{
+	ifstream file(fileName);
+	if (!file.is_open())
+	{
+		cout << "Could not open experiment file " << fileName << endl;
+		return false;
+	}
+
+	experiments.clear();
+
+	string line;
+	int lineNumber = 0;
+	Experiment* current = NULL;
+	while (getline(file, line))
+	{
+		lineNumber++;
+		stringstream ss(line);
+		string keyword;
+		if (!(ss >> keyword) || keyword[0] == '#')
+			continue;
+
+		if (keyword == "origin")
+		{
+			ss >> originU >> originV;
+			continue;
+		}
+		if (keyword == "experiment")
+		{
+			Experiment e;
+			ss >> e.name;
+			getline(ss >> ws, e.description);
+			if (e.description.empty())
+				e.description = e.name;
+			e.centerU = 0;
+			e.centerV = 0;
+			e.repeat = 1;
+			experiments.push_back(e);
+			current = &experiments.back();
+			continue;
+		}
+		if (!current)
+		{
+			cout << fileName << ":" << lineNumber << ": " << keyword << " outside of an experiment" << endl;
+			continue;
+		}
+		if (keyword == "end")
+		{
+			if (!validate(*current, fileName))
+				experiments.pop_back();
+			current = NULL;
+			continue;
+		}
+		if (keyword == "center")
+		{
+			ss >> current->centerU >> current->centerV;
+			continue;
+		}
+		if (keyword == "repeat")
+		{
+			ss >> current->repeat;
+			if (current->repeat < 1)
+				current->repeat = 1;
+			continue;
+		}
+		if (keyword == "vary")
+		{
+			Sweep sweep;
+			string names, values;
+			ss >> names;
+			sweep.names = split(names, ',');
+			while (ss >> values)
+				sweep.values.push_back(split(values, ','));
+			bool valid = !sweep.names.empty() && !sweep.values.empty();
+			for (size_t i = 0; i < sweep.values.size(); i++)
+				valid = valid && sweep.values[i].size() == sweep.names.size();
+			if (!valid)
+			{
+				cout << fileName << ":" << lineNumber << ": every value of vary needs " << sweep.names.size() << " fields" << endl;
+				continue;
+			}
+			current->sweeps.push_back(sweep);
+			continue;
+		}
+
+		Phase p;
+		size_t minArgs, maxArgs;
+		string token;
+		while (ss >> token)
+			p.args.push_back(token);
+		p.line = lineNumber;
+
+		if (keyword == "goto") { p.type = PHASE_GOTO; minArgs = 2; maxArgs = 4; }
+		else if (keyword == "hold") { p.type = PHASE_HOLD; minArgs = 3; maxArgs = 3; }
+		else if (keyword == "wait") { p.type = PHASE_WAIT; minArgs = 1; maxArgs = 1; }
+		else if (keyword == "actuate") { p.type = PHASE_ACTUATE; minArgs = 2; maxArgs = 3; }
+		else if (keyword == "pwm") { p.type = PHASE_PWM; minArgs = 4; maxArgs = 5; }
+		else if (keyword == "record" && p.args.size() == 1 && (p.args[0] == "on" || p.args[0] == "off"))
+		{
+			p.type = (p.args[0] == "on") ? PHASE_RECORD_ON : PHASE_RECORD_OFF;
+			p.args.clear();
+			minArgs = 0;
+			maxArgs = 0;
+		}
+		else
+		{
+			cout << fileName << ":" << lineNumber << ": unknown keyword " << keyword << endl;
+			continue;
+		}
+
+		if (p.args.size() < minArgs || p.args.size() > maxArgs)
+		{
+			cout << fileName << ":" << lineNumber << ": wrong number of values for " << keyword << endl;
+			continue;
+		}
+		current->phases.push_back(p);
+	}
+	if (current && !validate(*current, fileName))
+		experiments.pop_back();
+
+	cout << "Loaded " << experiments.size() << " experiments from " << fileName << endl;
+	return !experiments.empty();
+}
+
+/**====================================================
+* Function to check that every value of an experiment can be resolved
+* Input: Experiment, file name (for the messages)
+* Output: bool (1 if valid)
+*======================================================*/
+bool ExperimentRunner::validate(const Experiment& experiment, const std::string& fileName)
+{
+	bool valid = !experiment.phases.empty();
+	if (!valid)
+		cout << fileName << ": experiment " << experiment.name << " has no phases" << endl;
+
+	parameters.clear();
+	double result;
+	for (size_t i = 0; i < experiment.sweeps.size(); i++)
+	{
+		const Sweep& sweep = experiment.sweeps[i];
+		for (size_t j = 0; j < sweep.values.size(); j++)
+			for (size_t k = 0; k < sweep.names.size(); k++)
+			{
+				if (!value(sweep.values[j][k], result))
+				{
+					cout << fileName << ": experiment " << experiment.name << ": bad value " << sweep.values[j][k] << endl;
+					valid = false;
+				}
+				parameters[sweep.names[k]] = 0;
+			}
+	}
+	for (size_t i = 0; i < experiment.phases.size(); i++)
+	{
+		const Phase& p = experiment.phases[i];
+		for (size_t j = 0; j < p.args.size(); j++)
+			if (!value(p.args[j], result))
+			{
+				cout << fileName << ":" << p.line << ": bad value " << p.args[j] << endl;
+				valid = false;
+			}
+	}
+	parameters.clear();
+	return valid;
+}
+
+/**====================================================
+* Function to resolve a value: a number, a 0b mask, a $parameter or a coil
+* tip coordinate (tipu<n>, tipv<n>, optionally scaled: tipu4*0.5)
+* Input: Token, result
+* Output: bool (1 if resolved)
+*======================================================*/
+bool ExperimentRunner::value(const std::string& token, double& result)
+{
+	if (token.empty())
+		return false;
+	if (token[0] == '$')
+	{
+		map<string, double>::iterator it = parameters.find(token.substr(1));
+		if (it == parameters.end())
+			return false;
+		result = it->second;
+		return true;
+	}
+	if (token.compare(0, 4, "tipu") == 0 || token.compare(0, 4, "tipv") == 0)
+	{
+		// Tip of coil n (1 - nModelCoils) relative to the origin, from the rig geometry
+		const char* begin = token.c_str() + 4;
+		char* end;
+		long coil = strtol(begin, &end, 10);
+		if (end == begin || coil < 1 || coil > nModelCoils)
+			return false;
+		bool isU = (token[3] == 'u');
+		double factor = 1.0;
+		if (*end == '*')
+		{
+			begin = end + 1;
+			factor = strtod(begin, &end);
+			if (end == begin)
+				return false;
+		}
+		if (*end != '\0')
+			return false;
+		result = factor * (isU ? coilTipPixels[coil - 1][0] - originU : coilTipPixels[coil - 1][1] - originV);
+		return true;
+	}
+
+	const char* begin = token.c_str();
+	char* end;
+	if (token.size() > 2 && token[0] == '0' && (token[1] == 'b' || token[1] == 'B'))
+	{
+		begin += 2;
+		result = (double)strtoul(begin, &end, 2);
+	}
+	else
+	{
+		result = strtod(begin, &end);
+	}
+	return end != begin && *end == '\0';
+}
+
+double ExperimentRunner::arg(size_t i, double fallback)
+{
+	return (i < phaseArgCount) ? phaseArgs[i] : fallback;
+}
+
+/**====================================================
+* Function to find an experiment by name
+* Input: Name
+* Output: id, -1 if not found
+*======================================================*/
+int ExperimentRunner::find(const std::string& name)
+{
+	for (size_t i = 0; i < experiments.size(); i++)
+		if (experiments[i].name == name)
+			return (int)i;
+	return -1;
+}
+
+int ExperimentRunner::getTrials(int id)
+{
+	int n = experiments[id].repeat;
+	for (size_t i = 0; i < experiments[id].sweeps.size(); i++)
+		n *= (int)experiments[id].sweeps[i].values.size();
+	return n;
+}
+
+/**====================================================
+* Function to start all the trials of an experiment
+* Input: Experiment id
+* Output: bool (1 if started)
+*======================================================*/
+bool ExperimentRunner::start(int id)
+{
+	if (id < 0 || id >= size())
+	{
+		cout << "No experiment " << id << endl;
+		return false;
+	}
+	if (running)
+		stop();
+
+	current = id;
+	combinations = getTrials(id) / experiments[id].repeat;
+	combination = 0;
+	repetition = 0;
+	trial = 0;
+	running = 1;
+	openResults();
+	selectCombination();
+
+	cout << "Started experiment " << experiments[id].name << ": " << getTrials(id) << " trials" << endl;
+	return true;
+}
+
+/**====================================================
+* Function to stop the running experiment
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void ExperimentRunner::stop()
+{
+	if (!running)
+		return;
+	if (recordingStarted)
+		currentRig->stopRecording = 1;
+	recordingStarted = 0;
+	results.close();
+	running = 0;
+	cout << "Stopped experiment " << experiments[current].name << " after " << trial << " of " << getTrials(current) << " trials" << endl;
+}
+
+/**====================================================
+* Function to set the parameters of the current combination and reset the trial
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void ExperimentRunner::selectCombination()
+{
+	const Experiment& e = experiments[current];
+	parameters.clear();
+	int index = combination;
+	for (size_t i = e.sweeps.size(); i-- > 0;)
+	{
+		const Sweep& sweep = e.sweeps[i];
+		int k = index % (int)sweep.values.size();
+		index /= (int)sweep.values.size();
+		for (size_t j = 0; j < sweep.names.size(); j++)
+			value(sweep.values[k][j], parameters[sweep.names[j]]);
+	}
+
+	phase = 0;
+	phaseEntered = 0;
+	trialStart = loopClock->nowMs();
+	gotoTime = 0;
+	measuring = 0;
+	measured = 0;
+	measureStart = 0;
+	measureEnd = 0;
+	startU = startV = endU = endV = 0;
+	errorSquared = 0;
+	errorSamples = 0;
+	aborted = 0;
+	timedOut = 0;
+}
+
+/**====================================================
+* Function to run the experiment for one frame
+* Input: Particle position, target (in/out), coils
+* Output: bool (1 if the coils are to be selected by the solver)
+*======================================================*/
+bool ExperimentRunner::step(double u, double v, double& targetU, double& targetV, unsigned char& coils)
+{
+	bool closedLoop = 0;
+	coils = 0;
+
+	// Phases that end in this frame hand over to the next one in the same frame
+	while (running)
+	{
+		if (!phaseEntered)
+		{
+			enterPhase(u, v);
+			phaseEntered = 1;
+		}
+		if (!runPhase(u, v, targetU, targetV, coils, closedLoop))
+			break;
+
+		phase++;
+		phaseEntered = 0;
+		if (phase >= experiments[current].phases.size())
+			endTrial(u, v);
+	}
+	return closedLoop;
+}
+
+void ExperimentRunner::enterPhase(double u, double v)
+{
+	const Phase& p = experiments[current].phases[phase];
+	phaseArgCount = p.args.size();
+	for (size_t i = 0; i < phaseArgCount; i++)
+		value(p.args[i], phaseArgs[i]);
+	phaseStart = loopClock->nowMs();
+	if (p.type == PHASE_ACTUATE || p.type == PHASE_PWM)
+		actuations++;
+
+	if (p.type == PHASE_RECORD_ON && !measuring)
+	{
+		if (!currentRig->recording)
+		{
+			currentRig->startRecording = 1;
+			recordingStarted = 1;
+		}
+		measuring = 1;
+		measureStart = phaseStart;
+		startU = u;
+		startV = v;
+	}
+	else if (p.type == PHASE_RECORD_OFF && measuring)
+	{
+		if (recordingStarted)
+			currentRig->stopRecording = 1;
+		recordingStarted = 0;
+		measuring = 0;
+		measured = 1;
+		measureEnd = phaseStart;
+		endU = u;
+		endV = v;
+	}
+}
+
+/**====================================================
+* Function to run the current phase
+* Input: Particle position, target, coils, closed loop flag
+* Output: bool (1 if the phase is finished)
+*======================================================*/
+bool ExperimentRunner::runPhase(double u, double v, double& targetU, double& targetV, unsigned char& coils, bool& closedLoop)
+{
+	const Experiment& e = experiments[current];
+	long long elapsed = loopClock->nowMs() - phaseStart;
+
+	switch (experiments[current].phases[phase].type)
+	{
+	case PHASE_GOTO:
+	{
+		targetU = originU + arg(0, 0);
+		targetV = originV + arg(1, 0);
+		closedLoop = 1;
+		double tolerance = arg(2, currentRig->positionErrorTolerance);
+		double timeout = arg(3, 0);
+		if (abs(targetU - u) < tolerance && abs(targetV - v) < tolerance)
+		{
+			gotoTime += elapsed;
+			return true;
+		}
+		if (timeout > 0 && elapsed > timeout)
+		{
+			cout << "Experiment " << e.name << " trial " << trial + 1 << ": goto timed out" << endl;
+			gotoTime += elapsed;
+			timedOut = 1;
+			phase = e.phases.size() - 1; //skip the rest of the trial
+			return true;
+		}
+		return false;
+	}
+	case PHASE_HOLD:
+		targetU = originU + arg(0, 0);
+		targetV = originV + arg(1, 0);
+		closedLoop = 1;
+		if (measuring)
+		{
+			errorSquared += (targetU - u) * (targetU - u) + (targetV - v) * (targetV - v);
+			errorSamples++;
+		}
+		return elapsed >= arg(2, 0);
+
+	case PHASE_WAIT:
+		coils = 0;
+		closedLoop = 0;
+		return elapsed >= arg(0, 0);
+
+	case PHASE_ACTUATE:
+	{
+		coils = (unsigned char)arg(0, 0);
+		closedLoop = 0;
+		double abortHalfWidth = arg(2, 0);
+		if (abortHalfWidth > 0 && (abs(originU + e.centerU - u) > abortHalfWidth || abs(originV + e.centerV - v) > abortHalfWidth))
+		{
+			aborted = 1;
+			return true;
+		}
+		return elapsed >= arg(1, 0);
+	}
+	case PHASE_PWM:
+	{
+		double period = arg(2, 0);
+		bool on = arg(1, 0) >= 1.0 || period <= 0 || fmod((double)elapsed, period) < arg(1, 0) * period;
+		coils = on ? (unsigned char)arg(0, 0) : 0;
+		closedLoop = 0;
+		double abortHalfWidth = arg(4, 0);
+		if (abortHalfWidth > 0 && (abs(originU + e.centerU - u) > abortHalfWidth || abs(originV + e.centerV - v) > abortHalfWidth))
+		{
+			aborted = 1;
+			return true;
+		}
+		return elapsed >= arg(3, 0);
+	}
+	default:
+		return true;
+	}
+}
+
+/**====================================================
+* Function to write the result of the trial and move on to the next one
+* Input: Particle position
+* Output: NULL
+*======================================================*/
+void ExperimentRunner::endTrial(double u, double v)
+{
+	const Experiment& e = experiments[current];
+	if (measuring)
+	{
+		// No record off: the window ends with the trial
+		if (recordingStarted)
+			currentRig->stopRecording = 1;
+		recordingStarted = 0;
+		measuring = 0;
+		measured = 1;
+		measureEnd = loopClock->nowMs();
+		endU = u;
+		endV = v;
+	}
+
+	if (results.is_open())
+	{
+		double window = (double)(measureEnd - measureStart);
+		double displacement = hypot(endU - startU, endV - startV) / mm2pix;
+		results << trial << "," << combination << "," << repetition;
+		for (size_t i = 0; i < e.sweeps.size(); i++)
+			for (size_t j = 0; j < e.sweeps[i].names.size(); j++)
+				results << "," << parameters[e.sweeps[i].names[j]];
+		results << "," << gotoTime;
+		if (measured)
+		{
+			results << "," << startU << "," << startV << "," << endU << "," << endV << "," << window
+				<< "," << displacement << "," << (window > 0 ? displacement * 1000.0 / window : 0.0)
+				<< "," << (errorSamples ? sqrt(errorSquared / errorSamples) / mm2pix : 0.0);
+		}
+		else
+		{
+			results << ",,,,,,,,";
+		}
+		results << "," << aborted << "," << timedOut << endl;
+	}
+
+	trial++;
+	repetition++;
+	if (repetition >= e.repeat)
+	{
+		repetition = 0;
+		combination++;
+	}
+	if (combination >= combinations)
+	{
+		results.close();
+		running = 0;
+		cout << "Finished experiment " << e.name << ": " << trial << " trials" << endl;
+		return;
+	}
+	selectCombination();
+}
+
+/**====================================================
+* Function to open the per trial results of the running experiment
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void ExperimentRunner::openResults()
+{
+	const Experiment& e = experiments[current];
+	auto now = std::chrono::system_clock::now();
+	auto in_time_t = std::chrono::system_clock::to_time_t(now);
+	std::stringstream ss;
+	ss << currentRig->filePrefix << e.name << "_" << std::put_time(std::localtime(&in_time_t), "%Y_%m_%d_%H_%M_%S") << ".csv";
+
+	results.open(ss.str(), ios::out);
+	if (!results.is_open())
+	{
+		cout << "Could not open " << ss.str() << endl;
+		return;
+	}
+	results << "trial,combination,repeat";
+	for (size_t i = 0; i < e.sweeps.size(); i++)
+		for (size_t j = 0; j < e.sweeps[i].names.size(); j++)
+			results << "," << e.sweeps[i].names[j];
+	results << ",goto_ms,start_u,start_v,end_u,end_v,window_ms,displacement_mm,velocity_mm_s,rms_error_mm,aborted,timeout" << endl;
+}
+
+/**====================================================
+* Function to get the abort region of the running actuation
+* Input: Center, half width
+* Output: bool (1 if there is a region)
+*======================================================*/
+bool ExperimentRunner::getRegion(double& u, double& v, double& halfWidth)
+{
+	if (!running || !phaseEntered)
+		return false;
+	int type = experiments[current].phases[phase].type;
+	if (type == PHASE_ACTUATE)
+		halfWidth = arg(2, 0);
+	else if (type == PHASE_PWM)
+		halfWidth = arg(4, 0);
+	else
+		return false;
+	u = originU + experiments[current].centerU;
+	v = originV + experiments[current].centerV;
+	return halfWidth > 0;
+}
+
+/**====================================================
+* Function to get the open loop actuation of the current phase
+* Input: Mask, duty, PWM period (ms), length (ms), actuation id
+* Output: bool (1 if in an actuate or pwm phase)
+*======================================================*/
+bool ExperimentRunner::getActuation(unsigned char& mask, double& duty, double& periodMs, double& ms, int& id)
+{
+	if (!running || !phaseEntered)
+		return false;
+	int type = experiments[current].phases[phase].type;
+	if (type == PHASE_ACTUATE)
+	{
+		duty = 1.0;
+		periodMs = 0;
+		ms = arg(1, 0);
+	}
+	else if (type == PHASE_PWM)
+	{
+		duty = arg(1, 0);
+		periodMs = arg(2, 0);
+		ms = arg(3, 0);
+	}
+	else
+		return false;
+	mask = (unsigned char)arg(0, 0);
+	id = actuations;
+	return true;
+}
+
+std::string ExperimentRunner::getStatus()
+{
+	if (!running)
+		return "";
+	std::stringstream ss;
+	ss << experiments[current].name << " trial " << trial + 1 << "/" << getTrials(current) << ": "
+		<< phaseNames[experiments[current].phases[phase].type];
+	return ss.str();
+}
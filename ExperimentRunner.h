@@ -0,0 +1,138 @@
+#pragma once
+#ifndef EXPERIMENTRUNNER_H
+#define EXPERIMENTRUNNER_H
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+/*	Note: Experiment runner
+*	Experiments are read from a text file (experiments.txt) and listed in file
+*	order, so the position in the file is the experiment id. An experiment is a
+*	sequence of phases run once per trial. Coordinates are in pixels relative to
+*	the origin, times in ms. Lines starting with # are ignored.
+*		origin <u> <v>						arena center, absolute pixels
+*		experiment <name> <description...>	starts an experiment
+*		center <u> <v>						center of the abort region (default 0 0)
+*		repeat <n>							trials per parameter combination
+*		vary <p1,p2..> <a1,a2..> <b1,b2..>	values of the parameters, one tuple per value
+*		goto <u> <v> [tolerance] [timeout]	closed loop until the particle is at the point
+*		hold <u> <v> <ms>					closed loop at the point
+*		wait <ms>							all coils off
+*		actuate <mask> <ms> [abort]			open loop coils, ends early if the particle
+*											leaves the square of half width abort
+*		pwm <mask> <duty> <period> <ms> [abort]	open loop coils switched with a duty
+*											cycle (0 - 1) and a period (ms)
+*		record on|off						video and log, and the measurement window
+*		end
+*	Any value can be $<parameter>. Masks can be written as 0b00001000. tipu<n> and
+*	tipv<n> are the u and v of the tip of coil n (coilTipPixels) relative to the
+*	origin, and can be scaled, e.g. tipu4*0.5 halfway to the origin. Several vary
+*	lines are combined (cartesian product, the first line changes slowest) and
+*	every combination is run repeat times, so a whole batch runs unattended.
+*	step() is called every frame in automatic mode. Closed loop phases only set
+*	the target, the coils are then selected by the solver. Every trial appends a
+*	row to <experiment>_<date>.csv: the parameters, the positions at the start
+*	and end of the measurement window, the displacement and mean velocity (mm,
+*	mm/s), the rms position error of the closed loop phases in the window, and
+*	whether the actuation was aborted or a goto timed out.
+*	With the hardware timed coil output (CoilWaveform.h) every actuate and pwm
+*	phase is played as one pattern on the sample clock (getActuation); otherwise
+*	the mask is applied per frame and a pwm period shorter than a frame aliases.
+*/
+
+#define experimentFile "experiments.txt"
+
+class ExperimentRunner
+{
+public:
+	ExperimentRunner();
+
+	bool Load(const std::string& fileName = experimentFile);
+
+	int size() { return (int)experiments.size(); }
+	int find(const std::string& name);
+	const std::string& getName(int id) { return experiments[id].name; }
+	const std::string& getDescription(int id) { return experiments[id].description; }
+	int getTrials(int id);
+
+	bool start(int id);
+	void stop();
+	bool isRunning() { return running; }
+
+	// Returns 1 if the coils are to be selected by the solver for the target
+	bool step(double u, double v, double& targetU, double& targetV, unsigned char& coils);
+
+	// Abort region of the running experiment, 0 if none
+	bool getRegion(double& u, double& v, double& halfWidth);
+	// Open loop actuation of the current phase, the id changes with every actuation
+	bool getActuation(unsigned char& mask, double& duty, double& periodMs, double& ms, int& id);
+	std::string getStatus();
+
+private:
+	struct Phase
+	{
+		int type;
+		std::vector<std::string> args;
+		int line;
+	};
+
+	struct Sweep
+	{
+		std::vector<std::string> names;
+		std::vector<std::vector<std::string> > values;
+	};
+
+	struct Experiment
+	{
+		std::string name;
+		std::string description;
+		double centerU, centerV;
+		int repeat;
+		std::vector<Sweep> sweeps;
+		std::vector<Phase> phases;
+	};
+
+	bool validate(const Experiment& experiment, const std::string& fileName);
+	bool value(const std::string& token, double& result);
+	double arg(size_t i, double fallback);
+	void selectCombination();
+	void enterPhase(double u, double v);
+	bool runPhase(double u, double v, double& targetU, double& targetV, unsigned char& coils, bool& closedLoop);
+	void endTrial(double u, double v);
+	void openResults();
+
+	std::vector<Experiment> experiments;
+	double originU, originV;
+
+	// Running experiment
+	bool running;
+	int current;
+	int combination, combinations;
+	int repetition;
+	int trial;
+	size_t phase;
+	bool phaseEntered;
+	long long phaseStart;
+	int actuations;
+	std::map<std::string, double> parameters;
+	double phaseArgs[5];
+	size_t phaseArgCount;
+
+	// Measurement of the trial
+	long long trialStart, gotoTime;
+	bool measuring, measured;
+	long long measureStart, measureEnd;
+	double startU, startV, endU, endV;
+	double errorSquared;
+	long errorSamples;
+	bool aborted, timedOut;
+	bool recordingStarted;
+
+	std::ofstream results;
+};
+
+extern thread_local ExperimentRunner MyExperiments;
+
+#endif //EXPERIMENTRUNNER_H
@@ -0,0 +1,422 @@
+/*
+ExperimentScript.cpp - Coroutine experiment scripts and their per-frame scheduler
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "ExperimentScript.h"
+#include "VisualServo.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+thread_local ScriptScheduler MyScripts;
+
+// Coroutine frames of the scripts of this rig
+alignas(std::max_align_t) static thread_local unsigned char frameArena[scriptFrameSlots][scriptFrameSize];
+static thread_local bool frameUsed[scriptFrameSlots];
+
+static const char* operationNames[] = { "", "frame", "reach", "hold", "idle", "actuate" };
+
+void* ScriptTask::promise_type::operator new(std::size_t size) noexcept
+{
+	if (size > scriptFrameSize)
+	{
+		cout << "Experiment script frame of " << size << " bytes is larger than " << scriptFrameSize << endl;
+		return nullptr;
+	}
+	for (int i = 0; i < scriptFrameSlots; i++)
+	{
+		if (!frameUsed[i])
+		{
+			frameUsed[i] = 1;
+			return frameArena[i];
+		}
+	}
+	cout << "No free experiment script frame" << endl;
+	return nullptr;
+}
+
+void ScriptTask::promise_type::operator delete(void* frame, std::size_t) noexcept
+{
+	for (int i = 0; i < scriptFrameSlots; i++)
+		if (frame == frameArena[i])
+			frameUsed[i] = 0;
+}
+
+void ScriptTask::promise_type::unhandled_exception()
+{
+	cout << "Exception in experiment script" << endl;
+	abort();
+}
+
+ScriptTask& ScriptTask::operator=(ScriptTask&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (coroutine)
+			coroutine.destroy();
+		coroutine = other.coroutine;
+		other.coroutine = nullptr;
+	}
+	return *this;
+}
+
+ScriptTask::~ScriptTask()
+{
+	if (coroutine)
+		coroutine.destroy();
+}
+
+void ScriptAwaiter::await_suspend(std::coroutine_handle<>)
+{
+	MyScripts.begin(operation);
+}
+
+bool ScriptAwaiter::await_resume()
+{
+	return MyScripts.result();
+}
+
+Measurement RecordAwaiter::await_resume()
+{
+	return MyScripts.record(on);
+}
+
+ScriptAwaiter reach(double u, double v, double tolerance, long long timeout)
+{
+	ScriptAwaiter a = {};
+	a.operation.type = OP_REACH;
+	a.operation.u = u;
+	a.operation.v = v;
+	a.operation.tolerance = (tolerance > 0) ? tolerance : currentRig->positionErrorTolerance;
+	a.operation.ms = timeout;
+	return a;
+}
+
+ScriptAwaiter hold(long long ms)
+{
+	ScriptAwaiter a = {};
+	a.operation.type = OP_HOLD;
+	a.operation.ms = ms;
+	return a;
+}
+
+ScriptAwaiter idle(long long ms)
+{
+	ScriptAwaiter a = {};
+	a.operation.type = OP_IDLE;
+	a.operation.ms = ms;
+	return a;
+}
+
+ScriptAwaiter actuate(unsigned char mask, long long ms, AbortRegion region)
+{
+	ScriptAwaiter a = {};
+	a.operation.type = OP_ACTUATE;
+	a.operation.mask = mask;
+	a.operation.ms = ms;
+	a.operation.duty = 1.0;
+	a.operation.region = region;
+	return a;
+}
+
+ScriptAwaiter pwm(unsigned char mask, double duty, double periodMs, long long ms, AbortRegion region)
+{
+	ScriptAwaiter a = actuate(mask, ms, region);
+	a.operation.duty = duty;
+	a.operation.periodMs = periodMs;
+	return a;
+}
+
+ScriptAwaiter nextFrame()
+{
+	ScriptAwaiter a = {};
+	a.operation.type = OP_FRAME;
+	return a;
+}
+
+RecordAwaiter record(bool on)
+{
+	RecordAwaiter a;
+	a.on = on;
+	return a;
+}
+
+//Constructor
+ScriptScheduler::ScriptScheduler()
+{
+	running = 0;
+	current = -1;
+	operation = ScriptOperation();
+	operationStart = 0;
+	frame = 0;
+	operationFrame = 0;
+	operationResult = 0;
+	actuations = 0;
+	holdU = holdV = 0;
+	positionU = positionV = 0;
+	measuring = 0;
+	recordingStarted = 0;
+	measureStart = 0;
+	startU = startV = 0;
+}
+
+int ScriptScheduler::size()
+{
+	return nExperimentScripts;
+}
+
+const char* ScriptScheduler::getName(int id)
+{
+	return experimentScripts[id].name;
+}
+
+const char* ScriptScheduler::getDescription(int id)
+{
+	return experimentScripts[id].description;
+}
+
+/**====================================================
+* Function to start a script. It runs up to its first co_await in the next step.
+* Input: Script id
+* Output: bool (1 if started)
+*======================================================*/
+bool ScriptScheduler::start(int id)
+{
+	if (id < 0 || id >= size())
+	{
+		cout << "No experiment script " << id << endl;
+		return false;
+	}
+	if (running)
+		stop();
+
+	task = experimentScripts[id].script();
+	if (!task.valid())
+		return false;
+
+	current = id;
+	running = 1;
+	measuring = 0;
+	recordingStarted = 0;
+	operation = ScriptOperation();
+	operation.type = OP_NONE;
+	cout << "Started experiment " << experimentScripts[id].name << endl;
+	return true;
+}
+
+/**====================================================
+* Function to stop the running script
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void ScriptScheduler::stop()
+{
+	if (!running)
+		return;
+	if (recordingStarted)
+		currentRig->stopRecording = 1;
+	recordingStarted = 0;
+	measuring = 0;
+	task = ScriptTask();
+	running = 0;
+	cout << "Stopped experiment " << experimentScripts[current].name << endl;
+}
+
+/**====================================================
+* Function to run the script for one frame
+* Input: Particle position, target (in/out), coils
+* Output: bool (1 if the coils are to be selected by the solver)
+*======================================================*/
+bool ScriptScheduler::step(double u, double v, double& targetU, double& targetV, unsigned char& coils)
+{
+	bool closedLoop = 0;
+	coils = 0;
+	if (!running)
+		return closedLoop;
+
+	frame++;
+	positionU = u;
+	positionV = v;
+	if (operation.type == OP_NONE)
+	{
+		holdU = targetU;
+		holdV = targetV;
+	}
+
+	// Operations that finish in this frame resume the script in the same frame
+	while (evaluate(u, v, targetU, targetV, coils, closedLoop))
+	{
+		task.resume();
+		if (task.done())
+		{
+			if (recordingStarted)
+				currentRig->stopRecording = 1;
+			recordingStarted = 0;
+			task = ScriptTask();
+			running = 0;
+			cout << "Finished experiment " << experimentScripts[current].name << endl;
+			break;
+		}
+	}
+	return closedLoop;
+}
+
+void ScriptScheduler::begin(const ScriptOperation& next)
+{
+	operation = next;
+	operationStart = loopClock->nowMs();
+	operationFrame = frame;
+	operationResult = 0;
+	if (operation.type == OP_ACTUATE)
+		actuations++;
+	if (operation.type == OP_REACH)
+	{
+		holdU = operation.u;
+		holdV = operation.v;
+	}
+}
+
+/**====================================================
+* Function to evaluate the awaited operation
+* Input: Particle position, target, coils, closed loop flag
+* Output: bool (1 if finished, the script is to be resumed)
+*======================================================*/
+bool ScriptScheduler::evaluate(double u, double v, double& targetU, double& targetV, unsigned char& coils, bool& closedLoop)
+{
+	long long elapsed = loopClock->nowMs() - operationStart;
+
+	switch (operation.type)
+	{
+	case OP_NONE:
+		return true;
+
+	case OP_FRAME:
+		return frame > operationFrame;
+
+	case OP_REACH:
+		targetU = holdU;
+		targetV = holdV;
+		closedLoop = 1;
+		coils = 0;
+		if (abs(holdU - u) < operation.tolerance && abs(holdV - v) < operation.tolerance)
+		{
+			operationResult = 1;
+			return true;
+		}
+		return operation.ms > 0 && elapsed > operation.ms;
+
+	case OP_HOLD:
+		targetU = holdU;
+		targetV = holdV;
+		closedLoop = 1;
+		coils = 0;
+		return elapsed >= operation.ms;
+
+	case OP_IDLE:
+		closedLoop = 0;
+		coils = 0;
+		return elapsed >= operation.ms;
+
+	case OP_ACTUATE:
+		closedLoop = 0;
+		if (operation.duty >= 1.0 || operation.periodMs <= 0 || fmod((double)elapsed, operation.periodMs) < operation.duty * operation.periodMs)
+			coils = operation.mask;
+		else
+			coils = 0;
+		if (operation.region.halfWidth > 0
+			&& (abs(operation.region.u - u) > operation.region.halfWidth || abs(operation.region.v - v) > operation.region.halfWidth))
+		{
+			operationResult = 1;
+			return true;
+		}
+		return elapsed >= operation.ms;
+	}
+	return true;
+}
+
+/**====================================================
+* Function to start or stop the recording and the measurement window
+* Input: 1 to start, 0 to stop
+* Output: Measurement of the window (on stop)
+*======================================================*/
+Measurement ScriptScheduler::record(bool on)
+{
+	Measurement m = {};
+	long long now = loopClock->nowMs();
+	if (on)
+	{
+		if (!currentRig->recording && !recordingStarted)
+		{
+			currentRig->startRecording = 1;
+			recordingStarted = 1;
+		}
+		measuring = 1;
+		measureStart = now;
+		startU = positionU;
+		startV = positionV;
+		return m;
+	}
+
+	if (recordingStarted)
+		currentRig->stopRecording = 1;
+	recordingStarted = 0;
+	if (measuring)
+	{
+		measuring = 0;
+		m.startU = startU;
+		m.startV = startV;
+		m.endU = positionU;
+		m.endV = positionV;
+		m.ms = now - measureStart;
+		m.displacement = hypot(m.endU - m.startU, m.endV - m.startV) / mm2pix;
+		m.velocity = (m.ms > 0) ? m.displacement * 1000.0 / m.ms : 0.0;
+	}
+	return m;
+}
+
+/**====================================================
+* Function to get the abort region of the running actuation
+* Input: Center, half width
+* Output: bool (1 if there is a region)
+*======================================================*/
+bool ScriptScheduler::getRegion(double& u, double& v, double& halfWidth)
+{
+	if (!running || operation.type != OP_ACTUATE || operation.region.halfWidth <= 0)
+		return false;
+	u = operation.region.u;
+	v = operation.region.v;
+	halfWidth = operation.region.halfWidth;
+	return true;
+}
+
+/**====================================================
+* Function to get the running open loop actuation
+* Input: Mask, duty, PWM period (ms), length (ms), actuation id
+* Output: bool (1 if actuating)
+*======================================================*/
+bool ScriptScheduler::getActuation(unsigned char& mask, double& duty, double& periodMs, double& ms, int& id)
+{
+	if (!running || operation.type != OP_ACTUATE)
+		return false;
+	mask = operation.mask;
+	duty = operation.duty;
+	periodMs = operation.periodMs;
+	ms = (double)operation.ms;
+	id = actuations;
+	return true;
+}
+
+const char* ScriptScheduler::getStatus()
+{
+	static thread_local char status[128];
+	if (!running)
+		return "";
+	snprintf(status, sizeof(status), "%s: %s", experimentScripts[current].name, operationNames[operation.type]);
+	return status;
+}
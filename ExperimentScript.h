@@ -0,0 +1,188 @@
+#pragma once
+#ifndef EXPERIMENTSCRIPT_H
+#define EXPERIMENTSCRIPT_H
+
+#include <coroutine>
+#include <cstddef>
+
+/*	Note: Experiment scripts (C++20 coroutines)
+*	An experiment can also be written as a coroutine returning ScriptTask, with
+*	one co_await per phase:
+*		co_await reach(u, v, tol, timeout)	closed loop until the particle is at the point,
+*											returns 0 on timeout
+*		co_await hold(ms)					closed loop at the last target
+*		co_await idle(ms)					all coils off
+*		co_await actuate(mask, ms, region)	open loop, returns 1 if the particle left the region
+*		co_await pwm(mask, duty, period, ms, region)	open loop with a duty cycle (0 - 1)
+*											and a period (ms), returns like actuate
+*		co_await record()					starts the video, log and measurement window
+*		co_await record(false)				stops them and returns the Measurement
+*		co_await nextFrame()
+*	Coordinates are absolute pixels, times ms of the loop clock. The scheduler
+*	(MyScripts) is stepped once per frame like the ExperimentRunner. An awaited
+*	phase only stores its parameters in the scheduler, which evaluates it every
+*	frame and resumes the coroutine in the same frame when it is finished, so a
+*	resume is a plain jump into the coroutine. The coroutine frames come from a
+*	static arena (scriptFrameSlots x scriptFrameSize), not from the heap, and
+*	the scripts themselves keep their data in fixed size arrays.
+*	Scripts are listed in ReferenceExperiments.cpp.
+*/
+
+#define scriptFrameSize 16384	// bytes
+#define scriptFrameSlots 2
+
+class ScriptTask
+{
+public:
+	struct promise_type
+	{
+		ScriptTask get_return_object() { return ScriptTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		static ScriptTask get_return_object_on_allocation_failure() { return ScriptTask(); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception();
+
+		static void* operator new(std::size_t size) noexcept;
+		static void operator delete(void* frame, std::size_t size) noexcept;
+	};
+
+	ScriptTask() : coroutine(nullptr) {}
+	explicit ScriptTask(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
+	ScriptTask(ScriptTask&& other) noexcept : coroutine(other.coroutine) { other.coroutine = nullptr; }
+	ScriptTask& operator=(ScriptTask&& other) noexcept;
+	ScriptTask(const ScriptTask&) = delete;
+	ScriptTask& operator=(const ScriptTask&) = delete;
+	~ScriptTask();
+
+	bool valid() { return coroutine != nullptr; }
+	bool done() { return coroutine.done(); }
+	void resume() { coroutine.resume(); }
+
+private:
+	std::coroutine_handle<promise_type> coroutine;
+};
+
+// Square of half width around a point, 0 for none
+struct AbortRegion
+{
+	double u, v, halfWidth;
+};
+
+struct Measurement
+{
+	double startU, startV;
+	double endU, endV;
+	long long ms;
+	double displacement;	// mm
+	double velocity;		// mm/s
+};
+
+typedef enum {
+	OP_NONE,
+	OP_FRAME,
+	OP_REACH,
+	OP_HOLD,
+	OP_IDLE,
+	OP_ACTUATE
+} ScriptOperationType;
+
+struct ScriptOperation
+{
+	int type;
+	double u, v;
+	double tolerance;
+	long long ms;
+	unsigned char mask;
+	double duty, periodMs;	// actuate: 1, 0
+	AbortRegion region;
+};
+
+// Suspends the script until the scheduler finished the operation
+struct ScriptAwaiter
+{
+	ScriptOperation operation;
+
+	bool await_ready() { return false; }
+	void await_suspend(std::coroutine_handle<>);
+	bool await_resume();
+};
+
+// Starts or stops the recording without suspending the script
+struct RecordAwaiter
+{
+	bool on;
+
+	bool await_ready() { return true; }
+	void await_suspend(std::coroutine_handle<>) {}
+	Measurement await_resume();
+};
+
+ScriptAwaiter reach(double u, double v, double tolerance = 0, long long timeout = 0);
+ScriptAwaiter hold(long long ms);
+ScriptAwaiter idle(long long ms);
+ScriptAwaiter actuate(unsigned char mask, long long ms, AbortRegion region = AbortRegion{ 0, 0, 0 });
+ScriptAwaiter pwm(unsigned char mask, double duty, double periodMs, long long ms, AbortRegion region = AbortRegion{ 0, 0, 0 });
+ScriptAwaiter nextFrame();
+RecordAwaiter record(bool on = true);
+
+struct ScriptInfo
+{
+	const char* name;
+	const char* description;
+	ScriptTask(*script)();
+};
+
+// ReferenceExperiments.cpp
+extern const ScriptInfo experimentScripts[];
+extern const int nExperimentScripts;
+
+class ScriptScheduler
+{
+public:
+	ScriptScheduler();
+
+	int size();
+	const char* getName(int id);
+	const char* getDescription(int id);
+
+	bool start(int id);
+	void stop();
+	bool isRunning() { return running; }
+
+	// Returns 1 if the coils are to be selected by the solver for the target
+	bool step(double u, double v, double& targetU, double& targetV, unsigned char& coils);
+
+	bool getRegion(double& u, double& v, double& halfWidth);
+	bool getActuation(unsigned char& mask, double& duty, double& periodMs, double& ms, int& id);
+	const char* getStatus();
+
+	// Called by the awaiters
+	void begin(const ScriptOperation& next);
+	bool result() { return operationResult; }
+	Measurement record(bool on);
+
+private:
+	bool evaluate(double u, double v, double& targetU, double& targetV, unsigned char& coils, bool& closedLoop);
+
+	ScriptTask task;
+	bool running;
+	int current;
+
+	ScriptOperation operation;
+	long long operationStart;
+	long long frame, operationFrame;
+	bool operationResult;
+	int actuations;
+	double holdU, holdV;
+	double positionU, positionV;
+
+	bool measuring;
+	bool recordingStarted;
+	long long measureStart;
+	double startU, startV;
+};
+
+extern thread_local ScriptScheduler MyScripts;
+
+#endif //EXPERIMENTSCRIPT_H
@@ -0,0 +1,110 @@
+/*
+ForceModel.cpp - Per coil force model file
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "ForceModel.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+//Coil position configuration
+const double coilTipPixels[nModelCoils][2] = {
+	{ 621, 355 },
+	{ 705, 513 },
+	{ 625, 693 },
+	{ 441, 763 },
+	{ 293, 682 },
+	{ 222, 507 },
+	{ 297, 360 },
+	{ 485, 281 }
+};
+
+void DefaultForceModel(ForceModel& model)
+{
+	model.mm2pix = 46.5;
+	for (int i = 0; i < nModelCoils; i++)
+	{
+		model.gain[i] = 2.4675;
+		model.exponent[i] = -0.8652;
+	}
+}
+
+/**====================================================
+* Function to read a force model file. Values not in the file are kept.
+* Input: File name, model
+* Output: bool (1 if the file was read)
+*======================================================*/
+bool ReadForceModel(const std::string& fileName, ForceModel& model)
+{
+	ifstream file(fileName);
+	if (!file.is_open())
+		return false;
+
+	string line;
+	int lineNumber = 0;
+	while (getline(file, line))
+	{
+		lineNumber++;
+		stringstream ss(line);
+		string keyword;
+		if (!(ss >> keyword) || keyword[0] == '#')
+			continue;
+
+		if (keyword == "mm2pix")
+		{
+			double value;
+			if (ss >> value && value > 0)
+				model.mm2pix = value;
+			else
+				cout << fileName << ":" << lineNumber << ": bad mm2pix" << endl;
+		}
+		else if (keyword == "coil")
+		{
+			int i;
+			double gain, exponent;
+			if (ss >> i >> gain >> exponent && i >= 0 && i < nModelCoils && gain > 0)
+			{
+				model.gain[i] = gain;
+				model.exponent[i] = exponent;
+			}
+			else
+			{
+				cout << fileName << ":" << lineNumber << ": bad coil model" << endl;
+			}
+		}
+		else
+		{
+			cout << fileName << ":" << lineNumber << ": unknown keyword " << keyword << endl;
+		}
+	}
+	return true;
+}
+
+/**====================================================
+* Function to write a force model file
+* Input: File name, model, comment (written as # lines)
+* Output: bool (1 if written)
+*======================================================*/
+bool WriteForceModel(const std::string& fileName, const ForceModel& model, const std::string& comment)
+{
+	ofstream file(fileName);
+	if (!file.is_open())
+		return false;
+
+	file << "# Force model, v = gain * d ^ exponent (mm/s, d in mm). See ForceModel.h." << endl;
+	stringstream ss(comment);
+	string line;
+	while (getline(ss, line))
+		file << "# " << line << endl;
+	file << setprecision(6);
+	file << "mm2pix " << model.mm2pix << endl;
+	for (int i = 0; i < nModelCoils; i++)
+		file << "coil " << i << " " << model.gain[i] << " " << model.exponent[i] << endl;
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef FORCEMODEL_H
+#define FORCEMODEL_H
+
+#include <string>
+
+/*	Note: Force model file
+*	The particle velocity produced by coil i at a distance d (mm) from its tip is
+*		v = gain[i] * d ^ exponent[i]	(mm/s, along tip -> particle)
+*	The model is read at startup from force_model.txt, written by the offline fit
+*	(ForceModelFit.cpp) from the logs of the open loop experiments:
+*		mm2pix <pixels per mm>
+*		coil <i> <gain> <exponent>		i = 0..7
+*	Lines starting with # are ignored, missing coils keep their values.
+*	coilTipPixels is the rig geometry shared by the loop and the fit.
+*/
+
+#define forceModelFile "force_model.txt"
+#define nModelCoils 8
+
+struct ForceModel
+{
+	double mm2pix;
+	double gain[nModelCoils];
+	double exponent[nModelCoils];
+};
+
+// Model of the original calibration (same gain and exponent for every coil)
+void DefaultForceModel(ForceModel& model);
+bool ReadForceModel(const std::string& fileName, ForceModel& model);
+bool WriteForceModel(const std::string& fileName, const ForceModel& model, const std::string& comment = "");
+
+extern const double coilTipPixels[nModelCoils][2];	// u, v
+
+#endif //FORCEMODEL_H
@@ -0,0 +1,356 @@
+/*
+ForceModelFit.cpp - Offline fit of the per coil force model from experiment logs
+Date: 2026-10-18
+Author: agent
+*/
+
+/*	Note: Force model fit (separate executable, links ForceModel.cpp only)
+*		ForceModelFit [-o force_model.txt] [-mm2pix 46.5] [-min 0.05] log1.txt log2.txt ...
+*	The logs are the recording logs of the loop (time us, command u, v, CoG u, v,
+*	coil mask). Every pair of consecutive rows with the same single coil mask is a
+*	sample: the CoG velocity projected on the tip -> particle direction against
+*	the distance to the tip at the middle of the step. Samples slower than -min
+*	(mm/s) are dropped. Each coil is fitted on its own samples, so the asymmetry
+*	between the coils ends up in the model: log-log least squares for the start,
+*	then Gauss-Newton on the velocity residual. The rows with several coils are
+*	used to check the superposition of the fitted model against the default one.
+*	The logs are read by one thread per core and the coils are fitted in parallel.
+*/
+
+#include "ForceModel.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define minSamplesPerCoil 20
+#define maxStepUs 1000000	// longer steps are gaps in the log
+
+struct CoilSample
+{
+	double distance;	// mm
+	double speed;		// mm/s
+};
+
+struct CombinationSample
+{
+	double u, v;		// mm
+	double vu, vv;		// mm/s
+	unsigned char mask;
+};
+
+struct FitData
+{
+	vector<CoilSample> coil[nModelCoils];
+	vector<CombinationSample> combinations;
+	long rows;
+	int files;
+};
+
+struct CoilFit
+{
+	double gain, exponent;
+	double rms;
+	bool fitted;
+};
+
+static int singleCoil(unsigned char mask)
+{
+	if (mask == 0 || (mask & (mask - 1)))
+		return -1;
+	int i = 0;
+	while (!(mask & (1 << i)))
+		i++;
+	return i;
+}
+
+/**====================================================
+* Function to read the samples of a log file
+* Input: File name, mm2pix, minimum speed (mm/s), samples
+* Output: bool (1 if the file was read)
+*======================================================*/
+static bool readLog(const string& fileName, double mm2pix, double minSpeed, FitData& data)
+{
+	ifstream file(fileName);
+	if (!file.is_open())
+	{
+		cout << "Could not open " << fileName << endl;
+		return false;
+	}
+
+	string line;
+	bool havePrevious = false;
+	double t0 = 0, u0 = 0, v0 = 0;
+	int mask0 = -1;
+	while (getline(file, line))
+	{
+		double t, cmdU, cmdV, u, v;
+		int mask;
+		if (sscanf(line.c_str(), "%lf,%lf,%lf,%lf,%lf,%d", &t, &cmdU, &cmdV, &u, &v, &mask) != 6)
+			continue;
+		data.rows++;
+
+		double dt = (t - t0) / 1e6;
+		if (havePrevious && mask == mask0 && mask != 0 && dt > 0 && dt * 1e6 < maxStepUs)
+		{
+			double mu = 0.5 * (u + u0), mv = 0.5 * (v + v0);
+			double vu = (u - u0) / dt / mm2pix, vv = (v - v0) / dt / mm2pix;
+			int i = singleCoil((unsigned char)mask);
+			if (i >= 0)
+			{
+				double du = mu - coilTipPixels[i][0], dv = mv - coilTipPixels[i][1];
+				double d = sqrt(du * du + dv * dv);
+				CoilSample s;
+				s.distance = d / mm2pix;
+				s.speed = (vu * du + vv * dv) / d;
+				if (s.speed > minSpeed && s.distance > 0.5)
+					data.coil[i].push_back(s);
+			}
+			else
+			{
+				CombinationSample s;
+				s.u = mu / mm2pix;
+				s.v = mv / mm2pix;
+				s.vu = vu;
+				s.vv = vv;
+				s.mask = (unsigned char)mask;
+				data.combinations.push_back(s);
+			}
+		}
+		havePrevious = true;
+		t0 = t;
+		u0 = u;
+		v0 = v;
+		mask0 = mask;
+	}
+	data.files++;
+	return true;
+}
+
+static double sumSquared(const vector<CoilSample>& samples, double gain, double exponent)
+{
+	double sse = 0;
+	for (size_t k = 0; k < samples.size(); k++)
+	{
+		double r = samples[k].speed - gain * pow(samples[k].distance, exponent);
+		sse += r * r;
+	}
+	return sse;
+}
+
+/**====================================================
+* Function to fit gain * d ^ exponent to the samples of one coil
+* Input: Samples, fit
+* Output: NULL
+*======================================================*/
+static void fitCoil(const vector<CoilSample>& samples, CoilFit& fit)
+{
+	fit.fitted = false;
+	if (samples.size() < minSamplesPerCoil)
+		return;
+
+	// Log-log least squares
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	double n = (double)samples.size();
+	for (size_t k = 0; k < samples.size(); k++)
+	{
+		double x = log(samples[k].distance), y = log(samples[k].speed);
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+	}
+	double var = sxx - sx * sx / n;
+	if (var <= 1e-12)
+		return;
+	double exponent = (sxy - sx * sy / n) / var;
+	double gain = exp((sy - exponent * sx) / n);
+
+	// Gauss-Newton on the velocity residual, halving the step while it does not improve
+	double sse = sumSquared(samples, gain, exponent);
+	for (int iteration = 0; iteration < 20; iteration++)
+	{
+		double a11 = 0, a12 = 0, a22 = 0, b1 = 0, b2 = 0;
+		for (size_t k = 0; k < samples.size(); k++)
+		{
+			double p = pow(samples[k].distance, exponent);
+			double j1 = p, j2 = gain * p * log(samples[k].distance);
+			double r = samples[k].speed - gain * p;
+			a11 += j1 * j1;
+			a12 += j1 * j2;
+			a22 += j2 * j2;
+			b1 += j1 * r;
+			b2 += j2 * r;
+		}
+		double det = a11 * a22 - a12 * a12;
+		if (fabs(det) < 1e-18)
+			break;
+		double dg = (a22 * b1 - a12 * b2) / det;
+		double de = (a11 * b2 - a12 * b1) / det;
+
+		double scale = 1.0, next = sse;
+		while (scale > 1e-3)
+		{
+			next = sumSquared(samples, gain + scale * dg, exponent + scale * de);
+			if (gain + scale * dg > 0 && next < sse)
+				break;
+			scale *= 0.5;
+		}
+		if (scale <= 1e-3)
+			break;
+		gain += scale * dg;
+		exponent += scale * de;
+		bool converged = (sse - next) < 1e-9 * sse;
+		sse = next;
+		if (converged)
+			break;
+	}
+
+	fit.gain = gain;
+	fit.exponent = exponent;
+	fit.rms = sqrt(sse / n);
+	fit.fitted = true;
+}
+
+/**====================================================
+* Function to get the rms velocity error of a model on the combination samples
+* Input: Samples, model
+* Output: rms error (mm/s)
+*======================================================*/
+static double combinationError(const vector<CombinationSample>& samples, const ForceModel& model)
+{
+	if (samples.empty())
+		return 0;
+	double sse = 0;
+	for (size_t k = 0; k < samples.size(); k++)
+	{
+		const CombinationSample& s = samples[k];
+		double pu = 0, pv = 0;
+		for (int i = 0; i < nModelCoils; i++)
+		{
+			if (!(s.mask & (1 << i)))
+				continue;
+			double du = s.u - coilTipPixels[i][0] / model.mm2pix, dv = s.v - coilTipPixels[i][1] / model.mm2pix;
+			double d = sqrt(du * du + dv * dv);
+			double speed = model.gain[i] * pow(d, model.exponent[i]);
+			pu += speed * du / d;
+			pv += speed * dv / d;
+		}
+		sse += (pu - s.vu) * (pu - s.vu) + (pv - s.vv) * (pv - s.vv);
+	}
+	return sqrt(sse / samples.size());
+}
+
+int main(int argc, char* argv[])
+{
+	string output = forceModelFile;
+	double minSpeed = 0.05;
+	ForceModel model;
+	DefaultForceModel(model);
+	vector<string> logs;
+
+	for (int a = 1; a < argc; a++)
+	{
+		string arg = argv[a];
+		if (arg == "-o" && a + 1 < argc)
+			output = argv[++a];
+		else if (arg == "-mm2pix" && a + 1 < argc)
+			model.mm2pix = atof(argv[++a]);
+		else if (arg == "-min" && a + 1 < argc)
+			minSpeed = atof(argv[++a]);
+		else
+			logs.push_back(arg);
+	}
+	if (logs.empty() || model.mm2pix <= 0)
+	{
+		cout << "Usage: ForceModelFit [-o " << forceModelFile << "] [-mm2pix 46.5] [-min 0.05] log1.txt log2.txt ..." << endl;
+		return 1;
+	}
+
+	// Read the logs, one thread per core
+	int nThreads = (int)thread::hardware_concurrency();
+	if (nThreads < 1)
+		nThreads = 1;
+	if (nThreads > (int)logs.size())
+		nThreads = (int)logs.size();
+	vector<FitData> partial(nThreads);
+	vector<thread> threads;
+	for (int t = 0; t < nThreads; t++)
+	{
+		partial[t].rows = 0;
+		partial[t].files = 0;
+		threads.push_back(thread([&, t]() {
+			for (size_t f = t; f < logs.size(); f += nThreads)
+				readLog(logs[f], model.mm2pix, minSpeed, partial[t]);
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	threads.clear();
+
+	FitData data;
+	data.rows = 0;
+	data.files = 0;
+	for (int t = 0; t < nThreads; t++)
+	{
+		for (int i = 0; i < nModelCoils; i++)
+			data.coil[i].insert(data.coil[i].end(), partial[t].coil[i].begin(), partial[t].coil[i].end());
+		data.combinations.insert(data.combinations.end(), partial[t].combinations.begin(), partial[t].combinations.end());
+		data.rows += partial[t].rows;
+		data.files += partial[t].files;
+	}
+	cout << "Read " << data.rows << " rows from " << data.files << " logs" << endl;
+
+	// Fit the coils in parallel
+	CoilFit fits[nModelCoils];
+	for (int i = 0; i < nModelCoils; i++)
+		threads.push_back(thread(fitCoil, cref(data.coil[i]), ref(fits[i])));
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	ForceModel defaultModel = model;
+	cout << fixed << setprecision(4);
+	for (int i = 0; i < nModelCoils; i++)
+	{
+		cout << "Coil " << i + 1 << ": " << data.coil[i].size() << " samples";
+		if (fits[i].fitted)
+		{
+			model.gain[i] = fits[i].gain;
+			model.exponent[i] = fits[i].exponent;
+			cout << ", gain " << fits[i].gain << " exponent " << fits[i].exponent << " rms " << fits[i].rms << "mm/s" << endl;
+		}
+		else
+		{
+			cout << ", not enough for a fit, default kept" << endl;
+		}
+	}
+	if (!data.combinations.empty())
+	{
+		cout << "Coil combinations (" << data.combinations.size() << " samples): rms error "
+			<< combinationError(data.combinations, model) << "mm/s fitted, "
+			<< combinationError(data.combinations, defaultModel) << "mm/s default" << endl;
+	}
+
+	auto now = std::chrono::system_clock::now();
+	auto in_time_t = std::chrono::system_clock::to_time_t(now);
+	std::stringstream comment;
+	comment << "Fitted " << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %H:%M:%S") << " from " << data.files << " logs";
+	if (!WriteForceModel(output, model, comment.str()))
+	{
+		cout << "Could not write " << output << endl;
+		return 1;
+	}
+	cout << "Wrote " << output << endl;
+	return 0;
+}
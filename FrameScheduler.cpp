@@ -0,0 +1,164 @@
+/*
+FrameScheduler.cpp - Deadline based frame scheduler for the control loop
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "FrameScheduler.h"
+#include "Trace.h"
+
+#include <iostream>
+
+using namespace std;
+
+//Constructor
+FrameScheduler::FrameScheduler(LoopClock* clock, double fps, OverrunPolicy overrunPolicy)
+{
+	loopClock = clock;
+	policy = overrunPolicy;
+	setPeriod(fps);
+	frameStart = 0;
+	nextDeadline = 0;
+	lastFrameOverrun = false;
+
+	frames = 0;
+	overruns = 0;
+	droppedFrames = 0;
+	sleptFrames = 0;
+	maxOverrun = 0;
+	maxJitter = 0;
+	jitterSum = 0;
+	for (int i = 0; i < nLatencyBins; i++)
+		latencyHistogram[i] = 0;
+}
+
+/**====================================================
+* Function to set the frame period
+* Input: frames per second
+* Output: NULL
+*======================================================*/
+void FrameScheduler::setPeriod(double fps)
+{
+	period = (long long)(1000000.0 / fps);
+}
+
+/**====================================================
+* Function to anchor the schedule at the current time
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void FrameScheduler::start()
+{
+	nextDeadline = loopClock->now();
+	lastFrameOverrun = false;
+}
+
+/**====================================================
+* Function to mark the start of a frame
+* Input: NULL
+* Output: Start time of the frame (us)
+*======================================================*/
+long long FrameScheduler::beginFrame()
+{
+	frameStart = loopClock->now();
+	if (frames == 0 && nextDeadline == 0)
+		nextDeadline = frameStart;
+	nextDeadline += period;
+	return frameStart;
+}
+
+/**====================================================
+* Function to wait for the frame deadline and record the timing
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void FrameScheduler::endFrame()
+{
+	long long finished = loopClock->now();
+	frames++;
+
+	if (finished > nextDeadline)
+	{
+		long long overrun = finished - nextDeadline;
+		overruns++;
+		TRACE_INSTANT("Frame overrun");
+		if (overrun > maxOverrun)
+			maxOverrun = overrun;
+		lastFrameOverrun = true;
+
+		if (policy == OVERRUN_DROP_FRAME)
+		{
+			//Skip the missed slots, keep the phase of the schedule
+			long long missed = overrun / period + 1;
+			droppedFrames += missed;
+			nextDeadline += missed * period;
+			loopClock->waitUntil(nextDeadline);
+		}
+		else
+		{
+			if (policy == OVERRUN_REPORT)
+			{
+				cout << "Unable to record at " << 1000000.0 / period << " FPS" << endl;
+				cout << "FPS: " << 1000000.0 / ((double)(finished - frameStart)) << endl;
+				cout << "Check USB port version: 3.0 or 2.0? /n Try Grayscale" << endl;
+			}
+			//Restart the schedule from now
+			nextDeadline = finished;
+		}
+		return;
+	}
+
+	lastFrameOverrun = false;
+
+	//Wake up latency of the sleep, measured before the final spin (the spin
+	//ends on the deadline, unless the sleep woke up after it)
+	long long jitter = loopClock->waitUntil(nextDeadline);
+	if (jitter < 0)
+		return;
+	sleptFrames++;
+	if (jitter > maxJitter)
+		maxJitter = jitter;
+	jitterSum += jitter;
+
+	int bin = 0;
+	while ((jitter >> bin) > 0 && bin < nLatencyBins - 1)
+		bin++;
+	latencyHistogram[bin]++;
+}
+
+/**====================================================
+* Functions to query the overrun policy for the current frame
+* Input: NULL
+* Output: bool (1 to skip)
+*======================================================*/
+bool FrameScheduler::skipDisplay()
+{
+	return lastFrameOverrun && policy == OVERRUN_SKIP_DISPLAY;
+}
+
+bool FrameScheduler::skipRecording()
+{
+	return lastFrameOverrun && policy == OVERRUN_SKIP_RECORDING;
+}
+
+/**====================================================
+* Function to print the timing statistics
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void FrameScheduler::PrintReport()
+{
+	cout << "Frames: " << frames << " Overruns: " << overruns << " Dropped: " << droppedFrames
+		<< " Max overrun: " << maxOverrun << "us" << endl;
+	if (sleptFrames > 0)
+		cout << "Sleep wake up latency mean: " << jitterSum / sleptFrames << "us max: " << maxJitter << "us" << endl;
+
+	cout << "Sleep wake up latency histogram (before the spin)" << endl;
+	for (int i = 0; i < nLatencyBins; i++)
+	{
+		if (latencyHistogram[i] == 0)
+			continue;
+		long long upper = (i == 0) ? 0 : (1LL << i) - 1;
+		cout << "  <= " << upper << "us: " << latencyHistogram[i] << endl;
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include "LoopClock.h"
+
+/*	Note: Frame scheduler
+*	Frame deadlines are absolute (start + n * period), so the frame rate does not
+*	drift with the loop duration. The wait sleeps until shortly before the deadline
+*	and spins the rest (see WallClock::waitUntil). The latency statistics are the
+*	wake up error of that sleep, the spin itself always ends on the deadline.
+*	Overrun policies, applied to the frame after an overrun:
+*	OVERRUN_REPORT			print the overrun, restart the schedule from now
+*	OVERRUN_SKIP_DISPLAY	skip the display and flush of the next frame
+*	OVERRUN_SKIP_RECORDING	do not add the next frame to the video
+*	OVERRUN_DROP_FRAME		drop the missed frame slots and keep the frame phase
+*/
+
+typedef enum {
+	OVERRUN_REPORT,
+	OVERRUN_SKIP_DISPLAY,
+	OVERRUN_SKIP_RECORDING,
+	OVERRUN_DROP_FRAME
+} OverrunPolicy;
+
+#define nLatencyBins 24 //log2 bins of the wake up latency in microseconds
+
+class FrameScheduler
+{
+public:
+	//Constructor
+	FrameScheduler(LoopClock* clock, double fps, OverrunPolicy overrunPolicy = OVERRUN_REPORT);
+
+	void start();
+	long long beginFrame();
+	void endFrame();
+
+	bool skipDisplay();
+	bool skipRecording();
+
+	void setPeriod(double fps);
+	void PrintReport();
+
+	OverrunPolicy policy;
+
+private:
+	LoopClock* loopClock;
+
+	long long period;			// us
+	long long frameStart;		// us
+	long long nextDeadline;		// us
+	bool lastFrameOverrun;
+
+	// Statistics
+	long long frames;
+	long long overruns;
+	long long droppedFrames;
+	long long sleptFrames;		// frames with a sleep before the spin
+	long long maxOverrun;
+	long long maxJitter;
+	double jitterSum;
+	long long latencyHistogram[nLatencyBins];
+};
+
+#endif //FRAMESCHEDULER_H
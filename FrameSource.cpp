@@ -0,0 +1,543 @@
+/*
+FrameSource.cpp - Camera, video file and synthetic frame sources
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "FrameSource.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifdef VISP_HAVE_FLYCAPTURE
+/**====================================================
+* Constructor
+* Input: Index of the camera on the bus
+*======================================================*/
+FlyCaptureSource::FlyCaptureSource(int cameraIndex)
+{
+	index = cameraIndex;
+	camera = new vpFlyCaptureGrabber();
+	windowActive = false;
+	windowRefill = false;
+	windowLeft = windowTop = windowWidth = windowHeight = 0;
+}
+
+FlyCaptureSource::~FlyCaptureSource()
+{
+	delete camera;
+}
+
+/**====================================================
+* Function to apply the camera settings before opening
+* Input: size of the image
+* Output: NULL
+*======================================================*/
+void FlyCaptureSource::configure(int width, int height)
+{
+	std::cout << "Number of cameras detected: " << camera->getNumCameras() << std::endl;
+	camera->setCameraIndex(index);		// Selected the first camera
+	camera->getCameraInfo(std::cout);	// Display camera info
+	camera->setShutter(true);			// Turn auto shutter on
+	camera->setGain(true);				// Turn auto gain on
+	camera->setFormat7VideoMode(FlyCapture2::MODE_1, FlyCapture2::PIXEL_FORMAT_RAW8, width, height);
+}
+
+bool FlyCaptureSource::open(vpImage<unsigned char> &I, int width, int height)
+{
+	configure(width, height);
+	camera->open(I);
+	return true;
+}
+
+bool FlyCaptureSource::open(vpImage<vpRGBa> &I, int width, int height)
+{
+	configure(width, height);
+	camera->open(I);
+	return true;
+}
+
+/**====================================================
+* Function to grab a frame with the camera timestamp
+* Input: Image buffer, timestamp (ms)
+* Output: bool (1 if a frame was grabbed)
+*======================================================*/
+bool FlyCaptureSource::acquire(vpImage<unsigned char> &I, double &timestamp)
+{
+	FlyCapture2::TimeStamp stamp;
+	if (windowActive)
+	{
+		camera->acquire(windowGray, stamp);
+		pasteWindow<unsigned char>(I, windowGray, windowBackground);
+	}
+	else
+		camera->acquire(I, stamp);
+	timestamp = stamp.seconds * 1000.0 + stamp.microSeconds / 1000.0;
+	return true;
+}
+
+bool FlyCaptureSource::acquire(vpImage<vpRGBa> &I, double &timestamp)
+{
+	FlyCapture2::TimeStamp stamp;
+	if (windowActive)
+	{
+		camera->acquire(windowColor, stamp);
+		pasteWindow<vpRGBa>(I, windowColor, vpRGBa(windowBackground, windowBackground, windowBackground));
+	}
+	else
+		camera->acquire(I, stamp);
+	timestamp = stamp.seconds * 1000.0 + stamp.microSeconds / 1000.0;
+	return true;
+}
+
+/**====================================================
+* Function to copy the window into the full size image at its offset.
+* The background is redrawn after the window has moved.
+* Input: full size image, window image, background value
+* Output: NULL
+*======================================================*/
+template<typename Type>
+void FlyCaptureSource::pasteWindow(vpImage<Type> &I, const vpImage<Type> &window, Type background)
+{
+	if (windowRefill)
+	{
+		std::fill(I.bitmap, I.bitmap + I.getSize(), background);
+		windowRefill = false;
+	}
+	int rows = std::min((int)window.getHeight(), (int)I.getHeight() - windowTop);
+	int cols = std::min((int)window.getWidth(), (int)I.getWidth() - windowLeft);
+	for (int i = 0; i < rows; i++)
+		memcpy(I[windowTop + i] + windowLeft, window[i], cols * sizeof(Type));
+}
+
+/**====================================================
+* Function to stop the capture, apply a Format7 configuration and restart.
+* If the restart fails (vpFlyCaptureGrabber throws), the full frame of open()
+* is applied again, so the loop keeps its frames.
+* Input: Format7 settings
+* Output: bool (1 if applied)
+*======================================================*/
+bool FlyCaptureSource::applyFormat7(FlyCapture2::Format7ImageSettings &settings)
+{
+	FlyCapture2::Camera *handler = camera->getCameraHandler();
+	FlyCapture2::Format7PacketInfo packetInfo;
+	bool valid = false;
+	FlyCapture2::Error error = handler->ValidateFormat7Settings(&settings, &valid, &packetInfo);
+	if (error != FlyCapture2::PGRERROR_OK || !valid)
+		return false;
+
+	bool applied = true;
+	try
+	{
+		camera->stopCapture();
+		error = handler->SetFormat7Configuration(&settings, packetInfo.recommendedBytesPerPacket);
+		camera->startCapture();
+		if (error != FlyCapture2::PGRERROR_OK)
+		{
+			error.PrintErrorTrace();
+			applied = false;
+		}
+	}
+	catch (const vpException &e)
+	{
+		std::cout << "FlyCapture: could not restart the capture: " << e.getMessage() << std::endl;
+		applied = false;
+	}
+
+	if (!applied && &settings != &fullFrame && !applyFormat7(fullFrame))
+		std::cout << "FlyCapture: could not restore the full frame" << std::endl;
+	return applied;
+}
+
+/**====================================================
+* Function to read only a window of the sensor (Format7 ROI). The window is
+* aligned to the step sizes of the camera. Every change restarts the capture,
+* so the caller moves it only when the particle gets close to its edge.
+* Input: window in image coordinates (adjusted to the applied window)
+* Output: bool (1 if the camera reads the window)
+*======================================================*/
+bool FlyCaptureSource::setWindow(int &left, int &top, int &width, int &height)
+{
+	FlyCapture2::Camera *handler = camera->getCameraHandler();
+	if (!windowActive)
+	{
+		unsigned packetSize;
+		float percentage;
+		if (handler->GetFormat7Configuration(&fullFrame, &packetSize, &percentage) != FlyCapture2::PGRERROR_OK)
+			return false;
+	}
+
+	FlyCapture2::Format7Info info;
+	bool supported = false;
+	info.mode = fullFrame.mode;
+	if (handler->GetFormat7Info(&info, &supported) != FlyCapture2::PGRERROR_OK || !supported)
+		return false;
+
+	// Size rounded up and offsets rounded down to the steps of the sensor
+	int hStep = std::max((int)info.imageHStepSize, 1), vStep = std::max((int)info.imageVStepSize, 1);
+	int xStep = std::max((int)info.offsetHStepSize, 1), yStep = std::max((int)info.offsetVStepSize, 1);
+	width = std::min((width + hStep - 1) / hStep * hStep, (int)fullFrame.width);
+	height = std::min((height + vStep - 1) / vStep * vStep, (int)fullFrame.height);
+	left = std::max(0, std::min(left, (int)fullFrame.width - width)) / xStep * xStep;
+	top = std::max(0, std::min(top, (int)fullFrame.height - height)) / yStep * yStep;
+
+	if (windowActive && left == windowLeft && top == windowTop && width == windowWidth && height == windowHeight)
+		return true;
+
+	FlyCapture2::Format7ImageSettings settings = fullFrame;
+	settings.offsetX = fullFrame.offsetX + left;
+	settings.offsetY = fullFrame.offsetY + top;
+	settings.width = width;
+	settings.height = height;
+	if (!applyFormat7(settings))
+	{
+		//applyFormat7 went back to the full frame
+		windowActive = false;
+		return false;
+	}
+
+	windowLeft = left;
+	windowTop = top;
+	windowWidth = width;
+	windowHeight = height;
+	windowActive = true;
+	windowRefill = true;
+	return true;
+}
+
+void FlyCaptureSource::clearWindow()
+{
+	if (!windowActive)
+		return;
+	windowActive = false;
+	if (!applyFormat7(fullFrame))
+		std::cout << "FlyCapture: could not restore the full frame" << std::endl;
+}
+
+/**====================================================
+* Function to set the frame rate property of the camera, e.g. raised while
+* a window is read
+* Input: frame rate (fps)
+* Output: frame rate applied (fps), 0 if the camera refused it
+*======================================================*/
+double FlyCaptureSource::setFrameRate(double fps)
+{
+	try
+	{
+		return camera->setFrameRate((float)fps);
+	}
+	catch (const vpException &e)
+	{
+		std::cout << "FlyCapture: could not set " << fps << " fps: " << e.getMessage() << std::endl;
+		return 0;
+	}
+}
+
+void FlyCaptureSource::close()
+{
+	camera->close();
+}
+#endif
+
+/**====================================================
+* Constructor
+* Input: Video file or image sequence pattern, playback fps
+* (0 uses the rate stored in the file), loop at the end
+*======================================================*/
+VideoFileSource::VideoFileSource(const std::string &fileName, double playback_fps, bool loop)
+{
+	name = fileName;
+	framePeriodMs = (playback_fps > 0.0) ? 1000.0 / playback_fps : 0.0;
+	loopVideo = loop;
+	frameCount = 0;
+	reader.setFileName(name);
+}
+
+bool VideoFileSource::open(vpImage<unsigned char> &I, int width, int height)
+{
+	reader.open(I);
+	if (framePeriodMs == 0.0)
+		framePeriodMs = (reader.getFramerate() > 0.0) ? 1000.0 / reader.getFramerate() : 100.0;
+	std::cout << "Opened " << name << " (" << I.getWidth() << "x" << I.getHeight() << ")" << std::endl;
+	return true;
+}
+
+bool VideoFileSource::open(vpImage<vpRGBa> &I, int width, int height)
+{
+	reader.open(I);
+	if (framePeriodMs == 0.0)
+		framePeriodMs = (reader.getFramerate() > 0.0) ? 1000.0 / reader.getFramerate() : 100.0;
+	std::cout << "Opened " << name << " (" << I.getWidth() << "x" << I.getHeight() << ")" << std::endl;
+	return true;
+}
+
+/**====================================================
+* Function to compute the timestamp of the next frame.
+* Timestamps follow the playback rate so replays are repeatable.
+* Input: NULL
+* Output: timestamp (ms)
+*======================================================*/
+double VideoFileSource::frameTimestamp()
+{
+	return (frameCount++) * framePeriodMs;
+}
+
+bool VideoFileSource::acquire(vpImage<unsigned char> &I, double &timestamp)
+{
+	if (reader.end())
+	{
+		if (!loopVideo)
+			return false;
+		reader.getFrame(I, reader.getFirstFrameIndex());
+	}
+	else
+	{
+		reader.acquire(I);
+	}
+	timestamp = frameTimestamp();
+	return true;
+}
+
+bool VideoFileSource::acquire(vpImage<vpRGBa> &I, double &timestamp)
+{
+	if (reader.end())
+	{
+		if (!loopVideo)
+			return false;
+		reader.getFrame(I, reader.getFirstFrameIndex());
+	}
+	else
+	{
+		reader.acquire(I);
+	}
+	timestamp = frameTimestamp();
+	return true;
+}
+
+/**====================================================
+* Constructor
+* Input: frame rate used for the timestamps, particle radius (pixels)
+*======================================================*/
+SyntheticSource::SyntheticSource(double fps, double radius)
+{
+	framePeriodMs = 1000.0 / fps;
+	particleRadius = radius;
+	particleU = 0;
+	particleV = 0;
+	externallyDriven = false;
+	motion = NULL;
+	frameCount = 0;
+	noiseSeed = 12345;
+	lastDrawn = 0;
+	imageWidth = imageHeight = 0;
+	drawTop = drawLeft = drawBottom = drawRight = 0;
+	windowRefill = false;
+}
+
+bool SyntheticSource::open(vpImage<unsigned char> &I, int width, int height)
+{
+	I.resize(height, width, background);
+	lastDrawn = 0;
+	imageWidth = width;
+	imageHeight = height;
+	clearWindow();
+	if (!externallyDriven)
+	{
+		particleU = width / 2.0;
+		particleV = height / 2.0;
+	}
+	return true;
+}
+
+bool SyntheticSource::open(vpImage<vpRGBa> &I, int width, int height)
+{
+	I.resize(height, width, vpRGBa(background, background, background));
+	lastDrawn = 0;
+	imageWidth = width;
+	imageHeight = height;
+	clearWindow();
+	if (!externallyDriven)
+	{
+		particleU = width / 2.0;
+		particleV = height / 2.0;
+	}
+	return true;
+}
+
+/**====================================================
+* Function to set the particle position for the next frame
+* Input: u, v in pixels
+* Output: NULL
+*======================================================*/
+void SyntheticSource::setParticlePosition(double u, double v)
+{
+	particleU = u;
+	particleV = v;
+	externallyDriven = true;
+}
+
+void SyntheticSource::getParticlePosition(double &u, double &v)
+{
+	u = particleU;
+	v = particleV;
+}
+
+/**====================================================
+* Function to attach a motion model (e.g. the particle simulator)
+* Input: Motion model, stepped by one frame period before each frame
+* Output: NULL
+*======================================================*/
+void SyntheticSource::setMotion(ParticleMotion *particleMotion)
+{
+	motion = particleMotion;
+	externallyDriven = (motion != NULL);
+}
+
+/**====================================================
+* Function to emulate a sensor window: the particles are only drawn inside
+* Input: window in image coordinates (clipped to the image)
+* Output: bool (1)
+*======================================================*/
+bool SyntheticSource::setWindow(int &left, int &top, int &width, int &height)
+{
+	width = std::min(width, imageWidth);
+	height = std::min(height, imageHeight);
+	left = std::max(0, std::min(left, imageWidth - width));
+	top = std::max(0, std::min(top, imageHeight - height));
+	if (left != drawLeft || top != drawTop || left + width != drawRight || top + height != drawBottom)
+		windowRefill = true;
+	drawLeft = left;
+	drawTop = top;
+	drawRight = left + width;
+	drawBottom = top + height;
+	return true;
+}
+
+void SyntheticSource::clearWindow()
+{
+	drawLeft = 0;
+	drawTop = 0;
+	drawRight = imageWidth;
+	drawBottom = imageHeight;
+}
+
+/**====================================================
+* Function to step the particle motion and the timestamp
+* Input: timestamp (ms)
+* Output: NULL
+*======================================================*/
+void SyntheticSource::advance(double &timestamp)
+{
+	timestamp = frameCount * framePeriodMs;
+	if (motion != NULL)
+	{
+		motion->advance((frameCount > 0) ? framePeriodMs : 0.0, particleU, particleV);
+	}
+	else if (!externallyDriven)
+	{
+		double theta = 2 * M_PI * timestamp / 20000.0;
+		particleU = 470 + 93 * sin(theta);
+		particleV = 532 + 93 * cos(theta);
+	}
+	frameCount++;
+}
+
+/**====================================================
+* Function to draw the particles. Only the area around the previous
+* and the current particles is rewritten, the whole image after the
+* window has moved.
+* Input: image buffer, background and particle values
+* Output: NULL
+*======================================================*/
+template<typename Type>
+void SyntheticSource::render(vpImage<Type> &I, Type bg, Type fg)
+{
+	const int rows = std::min((int)I.getHeight(), drawBottom);
+	const int cols = std::min((int)I.getWidth(), drawRight);
+
+	if (windowRefill)
+	{
+		std::fill(I.bitmap, I.bitmap + I.getSize(), bg);
+		windowRefill = false;
+		lastDrawn = 0;
+	}
+	for (int k = 0; k < lastDrawn; k++)
+		for (int i = std::max(lastTop[k], 0); i <= std::min(lastBottom[k], (int)I.getHeight() - 1); i++)
+			for (int j = std::max(lastLeft[k], 0); j <= std::min(lastRight[k], (int)I.getWidth() - 1); j++)
+				I[i][j] = bg;
+
+	int particles = (motion != NULL) ? std::min(motion->getParticleCount(), maxRenderedParticles) : 1;
+	int margin = (int)ceil(particleRadius) + 1;
+	double r2 = particleRadius * particleRadius;
+	for (int k = 0; k < particles; k++)
+	{
+		double pu = particleU, pv = particleV;
+		if (k > 0)
+			motion->getParticle(k, pu, pv);
+
+		lastTop[k] = (int)floor(pv) - margin;
+		lastBottom[k] = (int)ceil(pv) + margin;
+		lastLeft[k] = (int)floor(pu) - margin;
+		lastRight[k] = (int)ceil(pu) + margin;
+
+		for (int i = std::max(lastTop[k], drawTop); i <= std::min(lastBottom[k], rows - 1); i++)
+		{
+			double dv = i - pv;
+			for (int j = std::max(lastLeft[k], drawLeft); j <= std::min(lastRight[k], cols - 1); j++)
+			{
+				double du = j - pu;
+				if (du * du + dv * dv <= r2)
+					I[i][j] = fg;
+			}
+		}
+	}
+	lastDrawn = particles;
+}
+
+bool SyntheticSource::acquire(vpImage<unsigned char> &I, double &timestamp)
+{
+	advance(timestamp);
+	return regrab(I, timestamp);
+}
+
+bool SyntheticSource::acquire(vpImage<vpRGBa> &I, double &timestamp)
+{
+	advance(timestamp);
+	return regrab(I, timestamp);
+}
+
+/**====================================================
+* Function to draw the particles of the last frame again (e.g. in the whole
+* image after the window was cleared), without stepping the motion
+* Input: image buffer, timestamp (ms, unchanged)
+* Output: bool (1)
+*======================================================*/
+bool SyntheticSource::regrab(vpImage<unsigned char> &I, double &timestamp)
+{
+	render<unsigned char>(I, background, foreground);
+
+	if (noiseAmplitude > 0)
+	{
+		for (int k = 0; k < lastDrawn; k++)
+			for (int i = std::max(lastTop[k], drawTop); i <= std::min(lastBottom[k], drawBottom - 1); i++)
+				for (int j = std::max(lastLeft[k], drawLeft); j <= std::min(lastRight[k], drawRight - 1); j++)
+				{
+					noiseSeed = noiseSeed * 1103515245u + 12345u;
+					int n = (int)((noiseSeed >> 16) % (2 * noiseAmplitude + 1)) - noiseAmplitude;
+					I[i][j] = (unsigned char)std::min(255, std::max(0, I[i][j] + n));
+				}
+	}
+	return true;
+}
+
+bool SyntheticSource::regrab(vpImage<vpRGBa> &I, double &timestamp)
+{
+	render<vpRGBa>(I, vpRGBa(background, background, background), vpRGBa(foreground, foreground, foreground));
+	return true;
+}
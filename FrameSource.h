@@ -0,0 +1,195 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <visp3/core/vpConfig.h>
+#include <visp3/core/vpException.h>
+#include <visp3/core/vpImage.h>
+#include <visp3/core/vpRGBa.h>
+#include <visp3/io/vpVideoReader.h>
+
+#ifdef VISP_HAVE_FLYCAPTURE
+#include <visp3/sensor/vpFlyCaptureGrabber.h>
+#endif
+
+#include <string>
+
+/*	Note: Frame sources
+*	Every source writes into the image buffers owned by Vision. The buffers are
+*	sized once in open() and reused by acquire(), so no allocation happens per frame.
+*	Timestamps are in milliseconds.
+*	Sources that can read a window of the sensor (setWindow, e.g. the Format7
+*	ROI of the camera) keep the full size image: the window is copied at its
+*	offset and the pixels outside keep the background, so image coordinates do
+*	not change for the tracker and the coil tips.
+*/
+
+/**====================================================
+* Motion model that moves the synthetic particle between frames
+*======================================================*/
+class ParticleMotion
+{
+public:
+	virtual ~ParticleMotion() {}
+	virtual void advance(double dt_ms, double &u, double &v) = 0;
+	// Further particles, drawn with the one of advance (particle 0)
+	virtual int getParticleCount() { return 1; }
+	virtual void getParticle(int particle, double &u, double &v) {}
+};
+
+#define maxRenderedParticles 8
+
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	virtual bool open(vpImage<unsigned char> &I, int width, int height) = 0;
+	virtual bool open(vpImage<vpRGBa> &I, int width, int height) = 0;
+
+	virtual bool acquire(vpImage<unsigned char> &I, double &timestamp) = 0;
+	virtual bool acquire(vpImage<vpRGBa> &I, double &timestamp) = 0;
+
+	virtual void close() {}
+	virtual std::string getName() = 0;
+
+	// Window of the sensor in image coordinates, adjusted to what the source can
+	// read. Returns false if the source always reads the full frame.
+	virtual bool setWindow(int &left, int &top, int &width, int &height) { return false; }
+	virtual void clearWindow() {}
+
+	// Frame rate of the source (fps). Returns the rate applied, 0 if the source
+	// has no rate of its own.
+	virtual double setFrameRate(double fps) { return 0; }
+
+	// Grab the current frame again after the window changed. A camera can only
+	// give the next frame.
+	virtual bool regrab(vpImage<unsigned char> &I, double &timestamp) { return acquire(I, timestamp); }
+	virtual bool regrab(vpImage<vpRGBa> &I, double &timestamp) { return acquire(I, timestamp); }
+};
+
+#ifdef VISP_HAVE_FLYCAPTURE
+/**====================================================
+* Point Grey camera through FlyCapture (Format7, RAW8)
+*======================================================*/
+class FlyCaptureSource : public FrameSource
+{
+public:
+	FlyCaptureSource(int cameraIndex = 0);
+	~FlyCaptureSource();
+
+	bool open(vpImage<unsigned char> &I, int width, int height);
+	bool open(vpImage<vpRGBa> &I, int width, int height);
+
+	bool acquire(vpImage<unsigned char> &I, double &timestamp);
+	bool acquire(vpImage<vpRGBa> &I, double &timestamp);
+
+	void close();
+	std::string getName() { return "FlyCapture"; }
+
+	bool setWindow(int &left, int &top, int &width, int &height);
+	void clearWindow();
+	double setFrameRate(double fps);
+
+	vpFlyCaptureGrabber *camera;
+
+	unsigned char windowBackground = 255; // pixels outside the window
+
+private:
+	void configure(int width, int height);
+	bool applyFormat7(FlyCapture2::Format7ImageSettings &settings);
+	template<typename Type> void pasteWindow(vpImage<Type> &I, const vpImage<Type> &window, Type background);
+
+	int index;
+
+	// Format7 ROI
+	FlyCapture2::Format7ImageSettings fullFrame;	// settings of open()
+	bool windowActive;
+	bool windowRefill;								// background to be redrawn
+	int windowLeft, windowTop, windowWidth, windowHeight;
+	vpImage<unsigned char> windowGray;
+	vpImage<vpRGBa> windowColor;
+};
+#endif
+
+/**====================================================
+* Video file or image sequence (e.g. "frames/img%04d.png")
+*======================================================*/
+class VideoFileSource : public FrameSource
+{
+public:
+	VideoFileSource(const std::string &fileName, double playback_fps = 0.0, bool loop = true);
+
+	bool open(vpImage<unsigned char> &I, int width, int height);
+	bool open(vpImage<vpRGBa> &I, int width, int height);
+
+	bool acquire(vpImage<unsigned char> &I, double &timestamp);
+	bool acquire(vpImage<vpRGBa> &I, double &timestamp);
+
+	std::string getName() { return "Video file"; }
+
+private:
+	double frameTimestamp();
+
+	vpVideoReader reader;
+	std::string name;
+	double framePeriodMs;
+	bool loopVideo;
+	long frameCount;
+};
+
+/**====================================================
+* Deterministic synthetic particle renderer
+*======================================================*/
+class SyntheticSource : public FrameSource
+{
+public:
+	SyntheticSource(double fps = 10.0, double radius = 12.0);
+
+	bool open(vpImage<unsigned char> &I, int width, int height);
+	bool open(vpImage<vpRGBa> &I, int width, int height);
+
+	bool acquire(vpImage<unsigned char> &I, double &timestamp);
+	bool acquire(vpImage<vpRGBa> &I, double &timestamp);
+
+	std::string getName() { return "Synthetic"; }
+
+	// Drive the particle externally. Without it the particle follows a fixed circle.
+	void setParticlePosition(double u, double v);
+	void getParticlePosition(double &u, double &v);
+	void setMotion(ParticleMotion *particleMotion);
+
+	// Emulated sensor window: only the pixels inside are drawn
+	bool setWindow(int &left, int &top, int &width, int &height);
+	void clearWindow();
+	// Same instant drawn again, the simulated time does not move
+	bool regrab(vpImage<unsigned char> &I, double &timestamp);
+	bool regrab(vpImage<vpRGBa> &I, double &timestamp);
+
+	unsigned char background = 200;
+	unsigned char foreground = 20;
+	int noiseAmplitude = 0;
+
+private:
+	void advance(double &timestamp);
+	template<typename Type> void render(vpImage<Type> &I, Type bg, Type fg);
+
+	double framePeriodMs;
+	double particleRadius;
+	double particleU, particleV;
+	bool externallyDriven;
+	ParticleMotion *motion;
+	long frameCount;
+	unsigned int noiseSeed;
+
+	// Bounding boxes of the last drawn particles, cleared on the next frame
+	int lastTop[maxRenderedParticles], lastLeft[maxRenderedParticles];
+	int lastBottom[maxRenderedParticles], lastRight[maxRenderedParticles];
+	int lastDrawn;
+
+	// Drawn area (the window or the full frame), bottom and right excluded
+	int imageWidth, imageHeight;
+	int drawTop, drawLeft, drawBottom, drawRight;
+	bool windowRefill;
+};
+
+#endif // FRAMESOURCE_H
@@ -0,0 +1,321 @@
+/*
+Input.cpp - Keyboard and mouse input (hardware or scripted)
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "Vision.h"
+#include "Input.h"
+#include "Profiler.h"
+#include "SpscQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32) && !defined(headless)
+#include <windows.h>
+#define hardwareInput
+#endif
+
+using namespace std;
+
+struct ScriptedEvent
+{
+	long frame;
+	int key;		// -1 for a click
+	int modifier;	// KEY_CONTROL or 0
+	long held;
+	double u, v;
+};
+
+static vector<ScriptedEvent> scriptedEvents;
+static size_t nextEvent = 0;
+static long inputFrame = 0;
+static long holdUntil[256] = {};
+static bool clickPending = false;
+static double clickU = 0, clickV = 0;
+
+// Press events, produced by the input thread (or the script) and drained once per frame
+static SpscQueue<InputEvent, 256> inputQueue;
+static std::atomic<long> droppedEvents(0);
+
+// Thread of the rig that gets the input (ClaimInput)
+static std::atomic<std::thread::id> inputOwner(std::this_thread::get_id());
+
+// Presses drained this frame, cleared when consumed
+static bool framePressed[256] = {};
+static unsigned char frameModifier[256] = {};
+static long long framePressTicks[256] = {};
+
+#ifdef hardwareInput
+static std::atomic<bool> keyHeld[256];
+static std::atomic<bool> inputThreadRunning(false);
+static std::thread inputThread;
+
+/**====================================================
+* Input thread: polls the keyboard every millisecond and queues key presses
+* Input: NULL
+* Output: NULL
+*======================================================*/
+static void InputThreadLoop()
+{
+	vector<int> keys;
+	keys.push_back(KEY_CONTROL);
+	for (int k = '0'; k <= '9'; k++)
+		keys.push_back(k);
+	for (int k = 'A'; k <= 'Z'; k++)
+		keys.push_back(k);
+	for (int k = 0; k < 9; k++)
+		keys.push_back(KEY_NUMPAD1 + k);
+
+	bool previous[256] = {};
+	while (inputThreadRunning.load(std::memory_order_relaxed))
+	{
+		bool control = (GetAsyncKeyState(KEY_CONTROL) & 0x8000) != 0;
+		for (int key : keys)
+		{
+			bool down = (GetAsyncKeyState(key) & 0x8000) != 0;
+			keyHeld[key].store(down, std::memory_order_relaxed);
+			if (down && !previous[key])
+			{
+				InputEvent e;
+				e.key = (unsigned char)key;
+				e.modifier = (control && key != KEY_CONTROL) ? KEY_CONTROL : 0;
+				e.ticks = StageProfiler::now();
+				if (!inputQueue.push(e))
+					droppedEvents++;
+			}
+			previous[key] = down;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+#endif
+
+/**====================================================
+* Function to parse a key name of the input script
+* Input: key name
+* Output: key code, -1 if unknown
+*======================================================*/
+static int ParseKey(const string& name)
+{
+	if (name == "CTRL")
+		return KEY_CONTROL;
+	if (name.size() == 4 && name.compare(0, 3, "NUM") == 0 && name[3] >= '1' && name[3] <= '9')
+		return KEY_NUMPAD1 + (name[3] - '1');
+	if (name.size() == 1 && isalnum((unsigned char)name[0]))
+		return toupper((unsigned char)name[0]);
+	return -1;
+}
+
+/**====================================================
+* Function to load an input script
+* Input: File name
+* Output: bool (1 if loaded)
+*======================================================*/
+bool LoadInputScript(const std::string& fileName)
+{
+	ifstream file(fileName);
+	if (!file.is_open())
+	{
+		cout << "Could not open input script " << fileName << endl;
+		return false;
+	}
+
+	scriptedEvents.clear();
+	string line;
+	while (getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		stringstream ss(line);
+		ScriptedEvent e = { 0, -1, 0, 1, 0, 0 };
+		string name;
+		if (!(ss >> e.frame >> name))
+			continue;
+
+		if (name == "click")
+		{
+			ss >> e.u >> e.v;
+		}
+		else
+		{
+			if (name.compare(0, 5, "CTRL+") == 0)
+			{
+				e.modifier = KEY_CONTROL;
+				name = name.substr(5);
+			}
+			e.key = ParseKey(name);
+			if (e.key < 0)
+			{
+				cout << "Unknown key in input script: " << name << endl;
+				continue;
+			}
+			if (!(ss >> e.held))
+				e.held = 1;
+		}
+		scriptedEvents.push_back(e);
+	}
+
+	nextEvent = 0;
+	inputFrame = 0;
+	cout << "Loaded " << scriptedEvents.size() << " scripted input events" << endl;
+	return true;
+}
+
+/**====================================================
+* Function to start the keyboard thread (scripted input needs no thread)
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void StartInputThread()
+{
+#ifdef hardwareInput
+	if (inputThreadRunning)
+		return;
+	for (int i = 0; i < 256; i++)
+		keyHeld[i] = false;
+	inputThreadRunning = true;
+	inputThread = std::thread(InputThreadLoop);
+#endif
+}
+
+void StopInputThread()
+{
+#ifdef hardwareInput
+	if (!inputThreadRunning)
+		return;
+	inputThreadRunning = false;
+	inputThread.join();
+#endif
+	if (droppedEvents > 0)
+		cout << "Input queue full, dropped " << droppedEvents << " key presses" << endl;
+}
+
+/**====================================================
+* Function to give the keyboard, the clicks and the input script to the rig
+* running on the calling thread. The other threads see no input.
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void ClaimInput()
+{
+	inputOwner = std::this_thread::get_id();
+}
+
+static bool isInputOwner()
+{
+	return std::this_thread::get_id() == inputOwner.load(std::memory_order_relaxed);
+}
+
+/**====================================================
+* Function to advance the input by one frame: plays the script and drains the
+* queued key presses. Presses not consumed in the frame are discarded.
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void NextInputFrame()
+{
+	if (!isInputOwner())
+		return;
+	inputFrame++;
+	while (nextEvent < scriptedEvents.size() && scriptedEvents[nextEvent].frame <= inputFrame)
+	{
+		const ScriptedEvent& e = scriptedEvents[nextEvent++];
+		if (e.key < 0)
+		{
+			clickPending = true;
+			clickU = e.u;
+			clickV = e.v;
+		}
+		else
+		{
+			holdUntil[e.key] = inputFrame + e.held;
+			if (e.modifier)
+				holdUntil[e.modifier] = inputFrame + e.held;
+
+			InputEvent press;
+			press.key = (unsigned char)e.key;
+			press.modifier = (unsigned char)e.modifier;
+			press.ticks = StageProfiler::now();
+			if (!inputQueue.push(press))
+				droppedEvents++;
+		}
+	}
+
+	for (int i = 0; i < 256; i++)
+		framePressed[i] = false;
+
+	InputEvent e;
+	while (inputQueue.pop(e))
+	{
+		framePressed[e.key] = true;
+		frameModifier[e.key] = e.modifier;
+		framePressTicks[e.key] = e.ticks;
+	}
+}
+
+/**====================================================
+* Function to check if a key was pressed since the last frame. The press is
+* consumed, so only the first handler asking for it reacts.
+* Input: Key code, modifier that must be held (KEY_CONTROL or 0)
+* Output: bool (1 if pressed)
+*======================================================*/
+bool KeyPressed(int key, int modifier)
+{
+	if (key < 0 || key >= 256 || !isInputOwner() || !framePressed[key])
+		return false;
+	if (modifier && frameModifier[key] != modifier)
+		return false;
+
+	framePressed[key] = false;
+	MyProfiler.record(STAGE_INPUT, StageProfiler::now() - framePressTicks[key]);
+	return true;
+}
+
+/**====================================================
+* Function to get a scripted click (consumed once read)
+* Input: Click position (output)
+* Output: bool (1 if there was a click)
+*======================================================*/
+bool GetScriptedClick(double& u, double& v)
+{
+	if (!clickPending || !isInputOwner())
+		return false;
+	u = clickU;
+	v = clickV;
+	clickPending = false;
+	return true;
+}
+
+/**====================================================
+* Function to check if a key is held down
+* Input: Key code
+* Output: bool (1 if held)
+*======================================================*/
+bool KeyDown(int key)
+{
+	if (key < 0 || key >= 256 || !isInputOwner())
+		return false;
+#ifdef hardwareInput
+	return keyHeld[key].load(std::memory_order_relaxed);
+#else
+	return inputFrame < holdUntil[key];
+#endif
+}
+
+/**====================================================
+* Function to sleep
+* Input: milliseconds
+* Output: NULL
+*======================================================*/
+void SleepMs(int ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
@@ -0,0 +1,46 @@
+#pragma once
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <string>
+
+/*	Note: Keyboard and mouse input
+*	On Windows an input thread polls the keyboard every millisecond and pushes a
+*	time stamped event on every key press into a lock-free queue. The loop drains the
+*	queue once per frame (NextInputFrame) and handlers react to KeyPressed, so holding
+*	a key never stalls the loop. KeyDown gives the held state for the keys that act
+*	while held (numpad coils, I/D). The time from the press to KeyPressed is recorded
+*	as the Input stage of the latency report.
+*	In a headless build (or on a platform without the keyboard API) the keys and
+*	clicks come from an input script, one event per line:
+*		<frame> <key> [frames held]		e.g. "10 M", "50 NUM4 20", "12 CTRL+K"
+*		<frame> click <u> <v>
+*	Keys are a letter or digit, CTRL, or NUM1 - NUM9 (numpad).
+*	With several rigs in the process only the thread that called ClaimInput
+*	(the main thread by default) sees the input.
+*/
+
+#define KEY_CONTROL 0x11
+#define KEY_NUMPAD1 0x61
+
+struct InputEvent
+{
+	unsigned char key;
+	unsigned char modifier;	// KEY_CONTROL or 0
+	long long ticks;		// StageProfiler::now() at the press
+};
+
+void StartInputThread();
+void StopInputThread();
+void ClaimInput();
+
+void NextInputFrame();
+bool KeyPressed(int key, int modifier = 0);
+bool KeyDown(int key);
+
+bool LoadInputScript(const std::string& fileName);
+bool GetScriptedClick(double& u, double& v);
+
+void SleepMs(int ms);
+
+#endif //INPUT_H
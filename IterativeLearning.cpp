@@ -0,0 +1,125 @@
+/*
+IterativeLearning.cpp - Iterative learning control over repeated trajectories
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "IterativeLearning.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+thread_local IterativeLearning MyLearning;
+
+//Constructor
+IterativeLearning::IterativeLearning()
+{
+	gain = 0.5;
+	maxCorrection = 30.0;
+	trajectory = -1;
+	n = 0;
+	iteration = 0;
+}
+
+/**====================================================
+* Function to start an iteration. Keeps the corrections if the trajectory
+* and its sampling did not change.
+* Input: Trajectory id, number of path samples
+* Output: NULL
+*======================================================*/
+void IterativeLearning::prepare(int trajectoryId, int samples)
+{
+	if (trajectoryId != trajectory || samples != n)
+	{
+		trajectory = trajectoryId;
+		n = samples;
+		reset();
+	}
+	errorSumU.assign(n, 0.0f);
+	errorSumV.assign(n, 0.0f);
+	hits.assign(n, 0);
+}
+
+void IterativeLearning::reset()
+{
+	correctionU.assign(n, 0.0f);
+	correctionV.assign(n, 0.0f);
+	errorSumU.assign(n, 0.0f);
+	errorSumV.assign(n, 0.0f);
+	hits.assign(n, 0);
+	iteration = 0;
+}
+
+void IterativeLearning::record(int sample, double errorU, double errorV)
+{
+	if (sample < 0 || sample >= n || hits[sample] == 0xFFFF)
+		return;
+	errorSumU[sample] += (float)errorU;
+	errorSumV[sample] += (float)errorV;
+	hits[sample]++;
+}
+
+void IterativeLearning::correction(int sample, double& u, double& v)
+{
+	if (sample < 0 || sample >= n)
+	{
+		u = 0;
+		v = 0;
+		return;
+	}
+	u = correctionU[sample];
+	v = correctionV[sample];
+}
+
+/**====================================================
+* Function to update the corrections from the errors of the iteration
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void IterativeLearning::endIteration()
+{
+	if (n == 0)
+		return;
+
+	double sumSquared = 0;
+	int visited = 0;
+	vector<float> u(correctionU), v(correctionV);
+	for (int j = 0; j < n; j++)
+	{
+		if (hits[j] == 0)
+			continue;
+		double eu = errorSumU[j] / hits[j];
+		double ev = errorSumV[j] / hits[j];
+		sumSquared += eu * eu + ev * ev;
+		visited++;
+		u[j] -= (float)(gain * eu);
+		v[j] -= (float)(gain * ev);
+	}
+
+	// Q filter along the path, then clamp
+	for (int j = 0; j < n; j++)
+	{
+		int a = max(j - 1, 0), b = min(j + 1, n - 1);
+		double cu = 0.25 * u[a] + 0.5 * u[j] + 0.25 * u[b];
+		double cv = 0.25 * v[a] + 0.5 * v[j] + 0.25 * v[b];
+		double norm = hypot(cu, cv);
+		if (norm > maxCorrection)
+		{
+			cu *= maxCorrection / norm;
+			cv *= maxCorrection / norm;
+		}
+		correctionU[j] = (float)cu;
+		correctionV[j] = (float)cv;
+	}
+
+	iteration++;
+	cout << "ILC iteration " << iteration << ": rms error " << (visited ? sqrt(sumSquared / visited) : 0.0)
+		<< "px over " << visited << " of " << n << " samples" << endl;
+
+	errorSumU.assign(n, 0.0f);
+	errorSumV.assign(n, 0.0f);
+	hits.assign(n, 0);
+}
@@ -0,0 +1,136 @@
+/*
+LoopClock.cpp - Wall and virtual clocks for the control loop
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "LoopClock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+using namespace std;
+
+//Constructor
+WallClock::WallClock()
+{
+	origin = chrono::steady_clock::now();
+#ifdef _WIN32
+	timeBeginPeriod(1); // 1 ms Sleep granularity
+	spinMargin = 2000;
+#endif
+}
+
+/**====================================================
+* Function to get the current time
+* Input: NULL
+* Output: microseconds since construction
+*======================================================*/
+long long WallClock::now()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - origin).count();
+}
+
+/**====================================================
+* Function to sleep until a deadline (coarse, may wake up late)
+* Input: deadline in microseconds
+* Output: NULL
+*======================================================*/
+void WallClock::sleepUntil(long long deadline)
+{
+#ifdef _WIN32
+	long long remaining = deadline - now();
+	if (remaining >= 1000)
+		Sleep((DWORD)(remaining / 1000));
+#else
+	// steady_clock is CLOCK_MONOTONIC, so the deadline can be used as an absolute time
+	long long target = chrono::duration_cast<chrono::nanoseconds>(origin.time_since_epoch()).count() + deadline * 1000;
+	struct timespec ts;
+	ts.tv_sec = target / 1000000000;
+	ts.tv_nsec = target % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#endif
+}
+
+/**====================================================
+* Function to wait until a deadline. Sleeps until shortly
+* before the deadline and spins the rest.
+* Input: deadline in microseconds
+* Output: wake up error of the sleep (us, before the spin), -1 if only spun
+*======================================================*/
+long long WallClock::waitUntil(long long deadline)
+{
+	long long wakeUpError = -1;
+	if (deadline - now() > spinMargin)
+	{
+		sleepUntil(deadline - spinMargin);
+		wakeUpError = now() - (deadline - spinMargin);
+		if (wakeUpError < 0)
+			wakeUpError = 0;
+	}
+	while (now() < deadline);
+	return wakeUpError;
+}
+
+//Constructor
+VirtualClock::VirtualClock()
+{
+	currentTime = 0;
+}
+
+long long VirtualClock::now()
+{
+	return currentTime;
+}
+
+/**====================================================
+* Function to jump to a deadline. Never moves backwards.
+* Input: deadline in microseconds
+* Output: -1 (never sleeps)
+*======================================================*/
+long long VirtualClock::waitUntil(long long deadline)
+{
+	if (deadline > currentTime)
+		currentTime = deadline;
+	return -1;
+}
+
+/**====================================================
+* Function to advance the clock
+* Input: time step in microseconds
+* Output: NULL
+*======================================================*/
+void VirtualClock::advance(long long dt)
+{
+	if (dt > 0)
+		currentTime += dt;
+}
+
+/**====================================================
+* Function to pin the calling thread to a core
+* Input: Core number
+* Output: bool (1 if pinned)
+*======================================================*/
+bool PinThread(int core)
+{
+	if (core < 0 || core >= 64)
+		return false;
+#ifdef _WIN32
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
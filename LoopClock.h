@@ -0,0 +1,72 @@
+#pragma once
+#ifndef LOOPCLOCK_H
+#define LOOPCLOCK_H
+
+#include <chrono>
+
+/*	Note: Loop clocks
+*	All control loop timing (frame deadlines, experiment durations, log timestamps)
+*	goes through a LoopClock. WallClock follows real time. VirtualClock only moves
+*	when the loop waits for the next frame, so a simulation or a replay steps as
+*	fast as the computation allows while every duration check sees frame-exact time.
+*	Times are in microseconds since the clock was created.
+*/
+
+class LoopClock
+{
+public:
+	virtual ~LoopClock() {}
+
+	virtual long long now() = 0;
+	// Returns how late the sleep woke up (us), -1 if the wait did not sleep
+	virtual long long waitUntil(long long deadline) = 0;
+	virtual bool isVirtual() = 0;
+
+	long long nowMs() { return now() / 1000; }
+};
+
+/**====================================================
+* Real time clock (steady clock)
+*======================================================*/
+class WallClock : public LoopClock
+{
+public:
+	WallClock();
+
+	long long now();
+	long long waitUntil(long long deadline);
+	bool isVirtual() { return false; }
+
+	// The last part of a wait (us) is spun instead of slept
+	long long spinMargin = 200;
+
+private:
+	void sleepUntil(long long deadline);
+
+	std::chrono::steady_clock::time_point origin;
+};
+
+/**====================================================
+* Simulated time, advanced by waitUntil or advance
+*======================================================*/
+class VirtualClock : public LoopClock
+{
+public:
+	VirtualClock();
+
+	long long now();
+	long long waitUntil(long long deadline);
+	void advance(long long dt);
+	bool isVirtual() { return true; }
+
+private:
+	long long currentTime;
+};
+
+// Clock of the rig running on this thread (set by RigSession::run)
+extern thread_local LoopClock* loopClock;
+
+// Keeps the calling thread on one core (the loop of a rig, VisualServo.h)
+bool PinThread(int core);
+
+#endif //LOOPCLOCK_H
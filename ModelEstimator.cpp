@@ -0,0 +1,152 @@
+/*
+ModelEstimator.cpp - Online recursive least squares of the coil force model
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "ModelEstimator.h"
+
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+thread_local ModelEstimator MyEstimator;
+
+extern thread_local double mm2pix;
+extern thread_local double coilGain[nModelCoils];
+extern thread_local double coilExponent[nModelCoils];
+
+//Constructor
+ModelEstimator::ModelEstimator()
+{
+	forgetting = 0.995;
+	minSpeed = 0.05;
+	maxResidual = 1.0;
+	maxCovariance = 10.0;
+	gainRange = 4.0;
+	minExponent = -2.0;
+	maxExponent = -0.2;
+	lastMask = 0;
+	anchored = false;
+	for (int i = 0; i < nModelCoils; i++)
+	{
+		logGain[i] = 0;
+		exponent[i] = 0;
+		P[i][0] = P[i][2] = 0;
+		P[i][1] = 0;
+		minLogGain[i] = maxLogGain[i] = 0;
+		samples[i] = 0;
+	}
+}
+
+/**====================================================
+* Function to take the gain bounds from the loaded force model
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void ModelEstimator::anchor()
+{
+	for (int i = 0; i < nModelCoils; i++)
+	{
+		minLogGain[i] = log(coilGain[i]) - log(gainRange);
+		maxLogGain[i] = log(coilGain[i]) + log(gainRange);
+	}
+	anchored = true;
+}
+
+/**====================================================
+* Function to restart the estimation from the current model
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void ModelEstimator::reset()
+{
+	//The bounds stay on the loaded model, so toggling A cannot move them
+	if (!anchored)
+		anchor();
+	for (int i = 0; i < nModelCoils; i++)
+	{
+		logGain[i] = log(coilGain[i]);
+		exponent[i] = coilExponent[i];
+		P[i][0] = 0.1;
+		P[i][1] = 0;
+		P[i][2] = 0.1;
+		samples[i] = 0;
+	}
+	lastMask = 0;
+}
+
+/**====================================================
+* Function to update the model of the coil that moved the particle
+* Input: CoG, previous CoG (pixels), step (s), coil mask of the step
+* Output: NULL
+*======================================================*/
+void ModelEstimator::update(double u, double v, double prevU, double prevV, double dt, unsigned char mask)
+{
+	// Only a single coil that was already on before the step (no drag transient)
+	bool steady = (mask == lastMask);
+	lastMask = mask;
+	if (!steady || mask == 0 || (mask & (mask - 1)) || dt <= 0 || dt > 0.5)
+		return;
+	int i = 0;
+	while (!(mask & (1 << i)))
+		i++;
+
+	double mu = 0.5 * (u + prevU) - coilTipPixels[i][0];
+	double mv = 0.5 * (v + prevV) - coilTipPixels[i][1];
+	double d = sqrt(mu * mu + mv * mv);
+	if (d < 0.5 * mm2pix)
+		return;
+	double speed = ((u - prevU) * mu + (v - prevV) * mv) / d / dt / mm2pix;
+	if (speed < minSpeed)
+		return;
+
+	double x = log(d / mm2pix);
+	double y = log(speed);
+	double residual = y - (logGain[i] + exponent[i] * x);
+	if (fabs(residual) > maxResidual)
+		return;
+
+	// K = P phi / (lambda + phi' P phi), phi = [1, x]
+	double p00 = P[i][0], p01 = P[i][1], p11 = P[i][2];
+	double Pphi0 = p00 + p01 * x;
+	double Pphi1 = p01 + p11 * x;
+	double denominator = forgetting + Pphi0 + x * Pphi1;
+	double k0 = Pphi0 / denominator;
+	double k1 = Pphi1 / denominator;
+
+	logGain[i] += k0 * residual;
+	exponent[i] += k1 * residual;
+
+	// P = (P - K phi' P) / lambda
+	p00 = (p00 - k0 * Pphi0) / forgetting;
+	p01 = (p01 - k0 * Pphi1) / forgetting;
+	p11 = (p11 - k1 * Pphi1) / forgetting;
+	double trace = p00 + p11;
+	if (trace > maxCovariance)
+	{
+		double scale = maxCovariance / trace;
+		p00 *= scale;
+		p01 *= scale;
+		p11 *= scale;
+	}
+	P[i][0] = p00;
+	P[i][1] = p01;
+	P[i][2] = p11;
+
+	if (logGain[i] < minLogGain[i]) logGain[i] = minLogGain[i];
+	if (logGain[i] > maxLogGain[i]) logGain[i] = maxLogGain[i];
+	if (exponent[i] < minExponent) exponent[i] = minExponent;
+	if (exponent[i] > maxExponent) exponent[i] = maxExponent;
+
+	coilGain[i] = exp(logGain[i]);
+	coilExponent[i] = exponent[i];
+	samples[i]++;
+}
+
+void ModelEstimator::print()
+{
+	for (int i = 0; i < nModelCoils; i++)
+		cout << "Coil " << i + 1 << ": v = " << coilGain[i] << " * d^" << coilExponent[i] << " (" << samples[i] << " samples)" << endl;
+}
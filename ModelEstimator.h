@@ -0,0 +1,54 @@
+#pragma once
+#ifndef MODELESTIMATOR_H
+#define MODELESTIMATOR_H
+
+#include "ForceModel.h"
+
+/*	Note: Online force model estimation
+*	Recursive least squares on the log of the force law of every coil,
+*		ln v = ln gain + exponent * ln d
+*	with one 2x2 covariance per coil, so an update is a fixed handful of
+*	operations. A frame is a sample of a coil when the same single coil mask was
+*	on for the whole step before it: v is the CoG velocity along tip -> particle
+*	(mm/s), d the distance to the tip (mm). Samples slower than minSpeed and
+*	residuals larger than maxResidual (log) are skipped. Old samples are
+*	forgotten with forgetting (per sample of the coil) and the covariance trace
+*	is kept below maxCovariance so it cannot wind up while a coil is not used.
+*	The estimates are clamped to gainRange times the loaded gain and to
+*	[minExponent, maxExponent], and written to the model used by lpModel
+*	(coilGain, coilExponent) after every update.
+*/
+
+class ModelEstimator
+{
+public:
+	ModelEstimator();
+
+	// Take the gain bounds from the loaded model
+	void anchor();
+	// Restart from the current model, bounds stay on the loaded model
+	void reset();
+	// One frame: CoG now and one step earlier (pixels), step (s), mask written before the step
+	void update(double u, double v, double prevU, double prevV, double dt, unsigned char mask);
+	void print();
+
+	double forgetting;
+	double minSpeed;		// mm/s
+	double maxResidual;
+	double maxCovariance;
+	double gainRange;
+	double minExponent, maxExponent;
+
+private:
+	double logGain[nModelCoils];
+	double exponent[nModelCoils];
+	double P[nModelCoils][3];	// covariance: P00, P01, P11
+	double minLogGain[nModelCoils], maxLogGain[nModelCoils];
+	long samples[nModelCoils];
+	unsigned char lastMask;
+	bool anchored;		//bounds taken from the loaded model
+};
+
+extern thread_local ModelEstimator MyEstimator;
+
+#endif //MODELESTIMATOR_H
@@ -0,0 +1,233 @@
+/*
+MultiParticle.cpp - Coil mask scheduling for several particles
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "MultiParticle.h"
+
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+thread_local MultiParticleScheduler MyMultiParticle;
+
+extern thread_local double mm2pix;
+double coilVelocityModel(int coil, double distance_mm);
+
+// Lowest coil of every mask
+static thread_local int lowestCoil[nMasks];
+
+//Constructor
+MultiParticleScheduler::MultiParticleScheduler()
+{
+	mode = SCHEDULE_JOINT;
+	sliceFrames = 5;
+	tolerance = 3.0;
+	orthogonalWeight = 0.25;
+	holdWeight = 0.5;
+	count = 0;
+	frames = 0;
+	slicedParticle = -1;
+	sliceLeft = 0;
+	for (int k = 0; k < maxParticles; k++)
+	{
+		targetU[k] = targetV[k] = 0;
+		weight[k] = 1.0;
+		distance[k] = startDistance[k] = 0;
+		reached[k] = false;
+		reachedFrame[k] = -1;
+	}
+	lowestCoil[0] = -1;
+	for (int m = 1; m < nMasks; m++)
+	{
+		int i = 0;
+		while (!(m & (1 << i)))
+			i++;
+		lowestCoil[m] = i;
+	}
+}
+
+/**====================================================
+* Function to start scheduling. Every particle holds its position until it
+* gets a target.
+* Input: Number of particles, positions (pixels)
+* Output: NULL
+*======================================================*/
+void MultiParticleScheduler::start(int particles, const double u[], const double v[])
+{
+	count = (particles < maxParticles) ? particles : maxParticles;
+	frames = 0;
+	slicedParticle = -1;
+	sliceLeft = 0;
+	for (int k = 0; k < count; k++)
+	{
+		targetU[k] = u[k];
+		targetV[k] = v[k];
+		weight[k] = 1.0;
+		distance[k] = startDistance[k] = 0;
+		reached[k] = true;
+		reachedFrame[k] = 0;
+	}
+}
+
+void MultiParticleScheduler::stop()
+{
+	if (count)
+		report();
+	count = 0;
+}
+
+void MultiParticleScheduler::setTarget(int particle, double u, double v, double w)
+{
+	if (particle < 0 || particle >= count)
+		return;
+	targetU[particle] = u;
+	targetV[particle] = v;
+	weight[particle] = (w > 0) ? w : 1.0;
+	startDistance[particle] = -1; //set on the next frame
+	reached[particle] = false;
+	reachedFrame[particle] = -1;
+}
+
+void MultiParticleScheduler::getTarget(int particle, double& u, double& v)
+{
+	u = targetU[particle];
+	v = targetV[particle];
+}
+
+/**====================================================
+* Function to add the score of every mask for one particle
+* Input: Particle, positions, frame length (s), coil tips, weight, 1 to hold it
+* Output: NULL
+*======================================================*/
+void MultiParticleScheduler::score(int k, const double u[], const double v[], double frameSeconds, const double coilTip[][2], double w, bool holding)
+{
+	// Velocity of each coil at the particle (pixels/s)
+	double coilU[8], coilV[8];
+	for (int i = 0; i < 8; i++)
+	{
+		double MPu = u[k] - coilTip[i][0];
+		double MPv = v[k] - coilTip[i][1];
+		double MP_norm = sqrt(MPu * MPu + MPv * MPv);
+		if (MP_norm < mm2pix * 0.5)
+			MP_norm = mm2pix * 0.5;
+		double speed = coilVelocityModel(i, MP_norm / mm2pix) * mm2pix;
+		coilU[i] = speed * MPu / MP_norm;
+		coilV[i] = speed * MPv / MP_norm;
+	}
+
+	// Every mask is a smaller mask plus its lowest coil
+	maskU[0] = 0;
+	maskV[0] = 0;
+	for (int m = 1; m < nMasks; m++)
+	{
+		int i = lowestCoil[m];
+		maskU[m] = maskU[m & (m - 1)] + coilU[i];
+		maskV[m] = maskV[m & (m - 1)] + coilV[i];
+	}
+
+	if (holding)
+	{
+		double c = -holdWeight * w;
+		for (int m = 0; m < nMasks; m++)
+			maskScore[m] += c * sqrt(maskU[m] * maskU[m] + maskV[m] * maskV[m]);
+		return;
+	}
+
+	double eu = (targetU[k] - u[k]) / distance[k];
+	double ev = (targetV[k] - v[k]) / distance[k];
+	double maxAlong = distance[k] / frameSeconds;
+	for (int m = 0; m < nMasks; m++)
+	{
+		double along = maskU[m] * eu + maskV[m] * ev;
+		double side = fabs(maskV[m] * eu - maskU[m] * ev);
+		if (along > maxAlong)
+			along = maxAlong;
+		maskScore[m] += w * (along - orthogonalWeight * side);
+	}
+}
+
+/**====================================================
+* Function to select the coil mask of the frame
+* Input: Positions (pixels), frame length (s), coil tips
+* Output: Coil mask
+*======================================================*/
+unsigned char MultiParticleScheduler::selectMask(const double u[], const double v[], double frameSeconds, const double coilTip[][2])
+{
+	frames++;
+	bool allReached = true;
+	bool wasReached = true;
+	for (int k = 0; k < count; k++)
+	{
+		wasReached = wasReached && reached[k];
+		distance[k] = hypot(targetU[k] - u[k], targetV[k] - v[k]);
+		if (startDistance[k] < 0)
+			startDistance[k] = distance[k];
+		reached[k] = distance[k] < tolerance;
+		if (reached[k] && reachedFrame[k] < 0)
+			reachedFrame[k] = frames;
+		allReached = allReached && reached[k];
+	}
+	if (allReached && !wasReached)
+	{
+		cout << "All particles at their targets after " << frames << " frames" << endl;
+		report();
+	}
+	if (frameSeconds <= 0)
+		frameSeconds = 0.1;
+
+	for (int m = 0; m < nMasks; m++)
+		maskScore[m] = 0;
+
+	if (mode == SCHEDULE_TIME_SLICE)
+	{
+		if (sliceLeft <= 0 || slicedParticle < 0 || slicedParticle >= count || reached[slicedParticle])
+		{
+			slicedParticle = -1;
+			double largest = 0;
+			for (int k = 0; k < count; k++)
+			{
+				if (!reached[k] && weight[k] * distance[k] > largest)
+				{
+					largest = weight[k] * distance[k];
+					slicedParticle = k;
+				}
+			}
+			sliceLeft = sliceFrames;
+		}
+		sliceLeft--;
+		for (int k = 0; k < count; k++)
+			score(k, u, v, frameSeconds, coilTip, weight[k], k != slicedParticle);
+	}
+	else
+	{
+		for (int k = 0; k < count; k++)
+			score(k, u, v, frameSeconds, coilTip, weight[k], reached[k]);
+	}
+
+	// Coils off unless a mask does better
+	int best = 0;
+	for (int m = 1; m < nMasks; m++)
+		if (maskScore[m] > maskScore[best])
+			best = m;
+	return (unsigned char)best;
+}
+
+/**====================================================
+* Function to print the progress of every particle
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void MultiParticleScheduler::report()
+{
+	for (int k = 0; k < count; k++)
+	{
+		cout << "Particle " << k + 1 << ": " << distance[k] / mm2pix << "mm to target, moved "
+			<< (startDistance[k] - distance[k]) / mm2pix << "mm of " << startDistance[k] / mm2pix << "mm";
+		if (reachedFrame[k] >= 0)
+			cout << ", reached at frame " << reachedFrame[k];
+		cout << endl;
+	}
+}
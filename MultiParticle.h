@@ -0,0 +1,75 @@
+#pragma once
+#ifndef MULTIPARTICLE_H
+#define MULTIPARTICLE_H
+
+/*	Note: Multi particle coil scheduling
+*	All the particles share the 8 coils, so one mask is chosen per frame for all
+*	of them instead of one LP per particle. For every particle the velocity of
+*	each coil is evaluated once with the force model (coilVelocityModel), the
+*	velocity of all 256 masks is then built by adding one coil to a smaller mask,
+*	and the masks are scored in one pass over flat arrays:
+*		SCHEDULE_JOINT		sum over the particles of weight * progress
+*		SCHEDULE_TIME_SLICE	progress of one particle for sliceFrames frames while
+*							the others are held, then the particle with the
+*							largest weight * distance left
+*	progress is the velocity towards the target (limited to reaching it within
+*	the frame) minus orthogonalWeight times the sideways velocity. Particles
+*	already within tolerance (and held ones) score -holdWeight times their speed,
+*	so the others are moved with masks that leave them in place. Up to maxParticles.
+*/
+
+#define maxParticles 8
+#define nMasks 256
+
+typedef enum {
+	SCHEDULE_JOINT,
+	SCHEDULE_TIME_SLICE
+} ScheduleMode;
+
+class MultiParticleScheduler
+{
+public:
+	MultiParticleScheduler();
+
+	// Particles start with their target at their position
+	void start(int count, const double u[], const double v[]);
+	void stop();
+	int getCount() { return count; }
+
+	void setTarget(int particle, double u, double v, double weight = 1.0);
+	void getTarget(int particle, double& u, double& v);
+	bool isReached(int particle) { return reached[particle]; }
+	double getDistance(int particle) { return distance[particle]; }	// pixels
+
+	// Mask for the particle positions (pixels), frame length (s), coil tips (u, v pixels)
+	unsigned char selectMask(const double u[], const double v[], double frameSeconds, const double coilTip[][2]);
+	void report();
+
+	int mode;
+	int sliceFrames;
+	double tolerance;		// pixels
+	double orthogonalWeight;
+	double holdWeight;
+
+private:
+	void score(int particle, const double u[], const double v[], double frameSeconds, const double coilTip[][2], double weight, bool holding);
+
+	int count;
+	double targetU[maxParticles], targetV[maxParticles];
+	double weight[maxParticles];
+	double distance[maxParticles];
+	double startDistance[maxParticles];
+	bool reached[maxParticles];
+	long reachedFrame[maxParticles];
+	long frames;
+	int slicedParticle;
+	int sliceLeft;
+
+	// Velocity of every mask for one particle, and the summed score of every mask
+	double maskU[nMasks], maskV[nMasks];
+	double maskScore[nMasks];
+};
+
+extern thread_local MultiParticleScheduler MyMultiParticle;
+
+#endif //MULTIPARTICLE_H
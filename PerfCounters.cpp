@@ -0,0 +1,158 @@
+/*
+PerfCounters.cpp - Hardware performance counters per pipeline stage
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "PerfCounters.h"
+
+#include <iostream>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#endif
+
+using namespace std;
+
+thread_local PerfCounters MyPerfCounters;
+
+//Constructor
+PerfCounters::PerfCounters()
+{
+	for (int i = 0; i < PERF_LAST; i++)
+		fd[i] = -1;
+	opened = false;
+
+	for (int s = 0; s < STAGE_LAST; s++)
+	{
+		samples[s] = 0;
+		for (int i = 0; i < PERF_LAST; i++)
+			totals[s][i] = 0;
+	}
+}
+
+PerfCounters::~PerfCounters()
+{
+	close();
+}
+
+/**====================================================
+* Function to open the counter group for the calling thread
+* Input: NULL
+* Output: bool (1 if the counters are available)
+*======================================================*/
+bool PerfCounters::open()
+{
+#ifdef __linux__
+	const unsigned long long config[PERF_LAST] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	for (int i = 0; i < PERF_LAST; i++)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = config[i];
+		attr.disabled = (i == 0);		// the leader starts the group
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, (i == 0) ? -1 : fd[0], 0);
+		if (fd[i] < 0)
+		{
+			cout << "perf_event_open failed for counter " << i << " (check /proc/sys/kernel/perf_event_paranoid)" << endl;
+			close();
+			return false;
+		}
+	}
+
+	ioctl(fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	opened = true;
+	cout << "Hardware performance counters enabled" << endl;
+	return true;
+#else
+	cout << "Hardware performance counters are only available on Linux" << endl;
+	return false;
+#endif
+}
+
+void PerfCounters::close()
+{
+#ifdef __linux__
+	for (int i = PERF_LAST - 1; i >= 0; i--)
+	{
+		if (fd[i] >= 0)
+			::close(fd[i]);
+		fd[i] = -1;
+	}
+#endif
+	opened = false;
+}
+
+/**====================================================
+* Function to read the whole group at once
+* Input: Array receiving the counter values
+* Output: bool (1 if read)
+*======================================================*/
+bool PerfCounters::read(unsigned long long values[PERF_LAST])
+{
+#ifdef __linux__
+	unsigned long long buffer[1 + PERF_LAST];
+	if (::read(fd[0], buffer, sizeof(buffer)) != (ssize_t)sizeof(buffer) || buffer[0] != PERF_LAST)
+		return false;
+	for (int i = 0; i < PERF_LAST; i++)
+		values[i] = buffer[1 + i];
+	return true;
+#else
+	return false;
+#endif
+}
+
+void PerfCounters::add(Stage stage, const unsigned long long start[PERF_LAST], const unsigned long long end[PERF_LAST])
+{
+	for (int i = 0; i < PERF_LAST; i++)
+		totals[stage][i] += end[i] - start[i];
+	samples[stage]++;
+}
+
+/**====================================================
+* Function to print the counters per stage (per call averages)
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void PerfCounters::PrintReport()
+{
+	if (!opened)
+		return;
+
+	cout << left << setw(12) << "Stage" << right << setw(10) << "Calls" << setw(14) << "Cycles" << setw(14) << "Instr"
+		<< setw(8) << "IPC" << setw(12) << "LLC miss" << setw(12) << "Br miss" << endl;
+	cout << fixed << setprecision(2);
+	for (int s = 0; s < STAGE_LAST; s++)
+	{
+		if (samples[s] == 0)
+			continue;
+		double n = (double)samples[s];
+		double ipc = totals[s][PERF_CYCLES] ? (double)totals[s][PERF_INSTRUCTIONS] / totals[s][PERF_CYCLES] : 0.0;
+		cout << left << setw(12) << StageProfiler::stageName((Stage)s) << right << setw(10) << samples[s]
+			<< setw(14) << totals[s][PERF_CYCLES] / n
+			<< setw(14) << totals[s][PERF_INSTRUCTIONS] / n
+			<< setw(8) << ipc
+			<< setw(12) << totals[s][PERF_LLC_MISSES] / n
+			<< setw(12) << totals[s][PERF_BRANCH_MISSES] / n << endl;
+	}
+	cout.unsetf(ios::floatfield);
+	cout << setprecision(6);
+}
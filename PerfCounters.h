@@ -0,0 +1,75 @@
+#pragma once
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include "Profiler.h"
+
+/*	Note: Hardware performance counters (Linux only)
+*	PerfCounters opens one perf_event_open group (cycles, instructions, LLC misses,
+*	branch misses) for the loop thread, user space only. PERF_STAGE(stage) reads the
+*	group at the start and end of a scope and adds the difference to the stage.
+*	Each read is a system call (~1 us), so the counters are opt-in and only placed on
+*	the threshold, tracking, solver and display stages. PERF_STAGE is opened before
+*	PROFILE_STAGE, so the reads fall outside the profiled stage time. On other platforms open()
+*	returns 0 and PERF_STAGE does nothing.
+*/
+
+typedef enum {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_LLC_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_LAST
+} PerfEvent;
+
+class PerfCounters
+{
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	bool open();
+	void close();
+	bool isOpen() { return opened; }
+
+	bool read(unsigned long long values[PERF_LAST]);
+	void add(Stage stage, const unsigned long long start[PERF_LAST], const unsigned long long end[PERF_LAST]);
+
+	void PrintReport();
+
+private:
+	int fd[PERF_LAST];
+	bool opened;
+
+	unsigned long long totals[STAGE_LAST][PERF_LAST];
+	unsigned long long samples[STAGE_LAST];
+};
+
+extern thread_local PerfCounters MyPerfCounters;
+
+/**====================================================
+* Scoped counter read
+*======================================================*/
+class PerfScope
+{
+public:
+	PerfScope(Stage s) : stage(s)
+	{
+		active = MyPerfCounters.isOpen() && MyPerfCounters.read(start);
+	}
+	~PerfScope()
+	{
+		unsigned long long end[PERF_LAST];
+		if (active && MyPerfCounters.read(end))
+			MyPerfCounters.add(stage, start, end);
+	}
+
+private:
+	Stage stage;
+	bool active;
+	unsigned long long start[PERF_LAST];
+};
+
+#define PERF_STAGE(stage) PerfScope PROFILE_CONCAT(perfScope, __LINE__)(stage)
+
+#endif //PERFCOUNTERS_H
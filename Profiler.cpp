@@ -0,0 +1,179 @@
+/*
+Profiler.cpp - Per stage latency histograms for the control loop
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "Profiler.h"
+#include "Trace.h"
+
+#include <iostream>
+#include <iomanip>
+
+using namespace std;
+
+thread_local StageProfiler MyProfiler;
+thread_local std::atomic<const char*> loopScope(NULL);
+
+/**====================================================
+* Constructor. Calibrates the TSC against steady_clock.
+*======================================================*/
+StageProfiler::StageProfiler()
+{
+	nsPerTick = 1.0;
+	for (int i = 0; i < STAGE_LAST; i++)
+		lastNs[i] = 0;
+#ifdef profilerUseTSC
+	chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+	long long c0 = now();
+	while (chrono::steady_clock::now() - t0 < chrono::milliseconds(20));
+	long long c1 = now();
+	long long elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count();
+	if (c1 > c0)
+		nsPerTick = (double)elapsed / (double)(c1 - c0);
+#endif
+}
+
+//Constructor
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+void LatencyHistogram::reset()
+{
+	for (int i = 0; i < histogramBins; i++)
+		bins[i] = 0;
+	count = 0;
+	sum = 0;
+	maxValue = 0;
+}
+
+/**====================================================
+* Function to map a value to its bin. Values below 2^subBits
+* get their own bin, above that 2^subBits bins per power of two.
+* Input: value
+* Output: bin index
+*======================================================*/
+int LatencyHistogram::binIndex(long long value)
+{
+	if (value < (1LL << histogramSubBits))
+		return (int)(value < 0 ? 0 : value);
+
+	int msb = 63;
+	while (!((unsigned long long)value >> msb))
+		msb--;
+
+	int shift = msb - histogramSubBits;
+	int sub = (int)((value >> shift) & ((1 << histogramSubBits) - 1));
+	return ((shift + 1) << histogramSubBits) + sub;
+}
+
+/**====================================================
+* Function to get the lower bound of a bin
+* Input: bin index
+* Output: value
+*======================================================*/
+long long LatencyHistogram::binValue(int index)
+{
+	int major = index >> histogramSubBits;
+	long long sub = index & ((1 << histogramSubBits) - 1);
+	if (major == 0)
+		return sub;
+	return ((1LL << histogramSubBits) + sub) << (major - 1);
+}
+
+void LatencyHistogram::record(long long value)
+{
+	bins[binIndex(value)]++;
+	count++;
+	sum += value;
+	if (value > maxValue)
+		maxValue = value;
+}
+
+/**====================================================
+* Function to get a percentile
+* Input: percentile (0 - 100)
+* Output: lower bound of the bin holding the percentile
+*======================================================*/
+long long LatencyHistogram::percentile(double p)
+{
+	if (count == 0)
+		return 0;
+
+	long long rank = (long long)(p / 100.0 * count + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	long long seen = 0;
+	for (int i = 0; i < histogramBins; i++)
+	{
+		seen += bins[i];
+		if (seen >= rank)
+			return binValue(i);
+	}
+	return maxValue;
+}
+
+const char* StageProfiler::stageName(Stage stage)
+{
+	switch (stage)
+	{
+	case STAGE_ACQUIRE: return "Acquire";
+	case STAGE_THRESHOLD: return "Threshold";
+	case STAGE_TRACKING: return "Tracking";
+	case STAGE_SOLVER: return "Solver";
+	case STAGE_DAQ: return "DAQ";
+	case STAGE_DISPLAY: return "Display";
+	case STAGE_FLUSH: return "Flush";
+	case STAGE_RECORDING: return "Recording";
+	case STAGE_INPUT: return "Input";
+	case STAGE_COMMAND: return "Command";
+	case STAGE_WINDOW: return "Window";
+	case STAGE_FRAME: return "Frame";
+	default: return "Unknown";
+	}
+}
+
+/**====================================================
+* Function to record a stage into its histogram and the trace
+* Input: stage, start and end (ticks)
+* Output: NULL
+*======================================================*/
+void StageProfiler::record(Stage stage, long long startTicks, long long endTicks)
+{
+	lastNs[stage] = (long long)((endTicks - startTicks) * nsPerTick);
+	histograms[stage].record(lastNs[stage]);
+	MyTrace.complete(stageName(stage), startTicks, endTicks);
+}
+
+void StageProfiler::reset()
+{
+	for (int i = 0; i < STAGE_LAST; i++)
+		histograms[i].reset();
+}
+
+/**====================================================
+* Function to print p50/p99/max of every stage
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void StageProfiler::PrintLatencyReport()
+{
+	cout << left << setw(12) << "Stage" << right << setw(10) << "Count" << setw(12) << "p50(us)"
+		<< setw(12) << "p99(us)" << setw(12) << "max(us)" << endl;
+	cout << fixed << setprecision(1);
+	for (int i = 0; i < STAGE_LAST; i++)
+	{
+		LatencyHistogram& h = histograms[i];
+		if (h.getCount() == 0)
+			continue;
+		cout << left << setw(12) << stageName((Stage)i) << right << setw(10) << h.getCount()
+			<< setw(12) << h.percentile(50) / 1000.0
+			<< setw(12) << h.percentile(99) / 1000.0
+			<< setw(12) << h.getMax() / 1000.0 << endl;
+	}
+	cout.unsetf(ios::floatfield);
+	cout << setprecision(6);
+}
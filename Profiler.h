@@ -0,0 +1,133 @@
+#pragma once
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define profilerUseTSC
+#endif
+
+/*	Note: Stage profiler
+*	PROFILE_STAGE(stage) times the rest of the enclosing scope and records it in a
+*	fixed size log-linear (HDR style) histogram: 16 linear sub-bins per power of two,
+*	so every recorded value is within 1/16 (6.25%) of its bin. Recording is a few
+*	shifts and an increment, no allocation. Values are in nanoseconds.
+*	On x86-64 the timers read the TSC (calibrated once against steady_clock at
+*	startup), which keeps a timer pair to a few tens of nanoseconds.
+*/
+
+typedef enum {
+	STAGE_ACQUIRE,
+	STAGE_THRESHOLD,
+	STAGE_TRACKING,
+	STAGE_SOLVER,
+	STAGE_DAQ,
+	STAGE_DISPLAY,
+	STAGE_FLUSH,
+	STAGE_RECORDING,
+	STAGE_INPUT,
+	STAGE_COMMAND,
+	STAGE_WINDOW,
+	STAGE_FRAME,
+	STAGE_LAST
+} Stage;
+
+#define histogramSubBits 4
+#define histogramBins ((64 - histogramSubBits) << histogramSubBits)
+
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void record(long long value);
+	void reset();
+
+	long long percentile(double p);
+	long long getMax() { return maxValue; }
+	long long getCount() { return count; }
+	double getMean() { return count ? (double)sum / count : 0.0; }
+
+private:
+	static int binIndex(long long value);
+	static long long binValue(int index);
+
+	long long bins[histogramBins];
+	long long count;
+	long long sum;
+	long long maxValue;
+};
+
+class StageProfiler
+{
+public:
+	StageProfiler();
+
+	void record(Stage stage, long long ticks)
+	{
+		lastNs[stage] = (long long)(ticks * nsPerTick);
+		histograms[stage].record(lastNs[stage]);
+	}
+	void record(Stage stage, long long startTicks, long long endTicks);
+	void PrintLatencyReport();
+	void reset();
+
+	static const char* stageName(Stage stage);
+	long long getLast(Stage stage) { return lastNs[stage]; } // most recent value (ns)
+
+	// Raw timestamp in ticks, convert with toNs
+	static long long now()
+	{
+#ifdef profilerUseTSC
+		return (long long)__rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+	long long toNs(long long ticks) { return (long long)(ticks * nsPerTick); }
+
+private:
+	LatencyHistogram histograms[STAGE_LAST];
+	long long lastNs[STAGE_LAST];
+	double nsPerTick;
+};
+
+extern thread_local StageProfiler MyProfiler;
+
+// Innermost profiled stage or traced scope of this thread, read by the watchdog (Watchdog.h)
+extern thread_local std::atomic<const char*> loopScope;
+
+/**====================================================
+* Scoped stage timer
+*======================================================*/
+class StageTimer
+{
+public:
+	StageTimer(Stage s) : stage(s), start(StageProfiler::now()), outer(loopScope.load(std::memory_order_relaxed))
+	{
+		loopScope.store(StageProfiler::stageName(s), std::memory_order_relaxed);
+	}
+	~StageTimer()
+	{
+		MyProfiler.record(stage, start, StageProfiler::now());
+		loopScope.store(outer, std::memory_order_relaxed);
+	}
+
+private:
+	Stage stage;
+	long long start;
+	const char* outer;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_STAGE(stage) StageTimer PROFILE_CONCAT(stageTimer, __LINE__)(stage)
+
+#endif //PROFILER_H
@@ -0,0 +1,152 @@
+/*
+ReferenceExperiments.cpp - The rig experiments written as coroutine scripts
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "ExperimentScript.h"
+#include "ForceModel.h"
+
+#include <iostream>
+
+using namespace std;
+
+//center coordinates
+static const double MX = 470;
+static const double MY = 532;
+
+static void printTrial(const char* name, int point, int iteration, const Measurement& m, bool aborted)
+{
+	cout << name << " point " << point + 1 << " iteration " << iteration + 1 << ": " << m.displacement << "mm in "
+		<< m.ms << "ms, " << m.velocity << "mm/s" << (aborted ? " (left the region)" : "") << endl;
+}
+
+/**=============================================================================
+* Function to perform open loop infinity test
+* Input: NULL
+* Output: Script
+*==============================================================================*/
+ScriptTask openLoopInfinityScript()
+{
+	const int maxIterations = 6;
+	for (int nIterations = 0; nIterations < maxIterations; nIterations++)
+	{
+		co_await reach(MX, MY + 80);
+		co_await hold(1000);
+		co_await record();
+		co_await actuate(0b00001000, 10000);
+		Measurement m = co_await record(false);
+		printTrial("Infinity", 0, nIterations, m, false);
+	}
+}
+
+/**=============================================================================
+* Function to perform open loop different distance vs velocity experiments
+* Input: NULL
+* Output: Script
+*==============================================================================*/
+ScriptTask openLoopDifferentDistancesScript()
+{
+	const int maxIterations = 6;
+	const int steps = 5;
+	const double coilTipU = coilTipPixels[3][0]; //coil 4
+	const double radius = 120.0;
+	const double noEntryRadius = 140.0;
+	const double tlr = 20;
+
+	for (int k = 0; k < steps; k++)
+	{
+		double u = coilTipU + (MX - coilTipU) * k / (steps - 1);
+		double v = (MY + radius - tlr) + (2 * tlr - 2 * radius) * k / (steps - 1);
+		for (int nIterations = 0; nIterations < maxIterations; nIterations++)
+		{
+			co_await reach(u, v);
+			co_await hold(1000);
+			co_await idle(1000);
+			co_await record();
+			bool aborted = co_await actuate(0b00001000, 10000, AbortRegion{ MX, MY, noEntryRadius });
+			Measurement m = co_await record(false);
+			printTrial("Distances", k, nIterations, m, aborted);
+		}
+	}
+}
+
+/**=============================================================================
+* Function to perform open loop voltage vs velocity experiments
+* Input: NULL
+* Output: Script
+*==============================================================================*/
+ScriptTask openLoopDifferentVoltageScript()
+{
+	const int maxIterations = 6;
+	const double centerU = 450;
+	const double radius = 120.0;
+	const double tlr = 40;
+
+	for (int nIterations = 0; nIterations < maxIterations; nIterations++)
+	{
+		co_await reach(centerU, MY + radius - tlr);
+		co_await idle(1000);
+		co_await record();
+		bool aborted = co_await actuate(0b00001000, 10000, AbortRegion{ centerU, MY, radius });
+		Measurement m = co_await record(false);
+		printTrial("Voltage", 0, nIterations, m, aborted);
+	}
+}
+
+/**=============================================================================
+* Function to perform open loop different combination vs velocity experiments
+* Input: NULL
+* Output: Script
+*==============================================================================*/
+ScriptTask openLoopDifferentCombinationsScript()
+{
+	const int maxIterations = 7;
+	const unsigned char combinations[] = { 0b00001000, 0b00000100, 0b00001100, 0b00011100, 0b00001110 };
+	const double radius = 120.0;
+
+	for (int k = 0; k < 5; k++)
+	{
+		for (int nIterations = 0; nIterations < maxIterations; nIterations++)
+		{
+			co_await reach(MX, MY);
+			co_await hold(1000);
+			co_await idle(1000);
+			co_await record();
+			bool aborted = co_await actuate(combinations[k], 10000, AbortRegion{ MX, MY, radius });
+			Measurement m = co_await record(false);
+			printTrial("Combinations", k, nIterations, m, aborted);
+		}
+	}
+}
+
+/**=============================================================================
+* Function to perform closed loop positioning experiment
+* Input: NULL
+* Output: Script
+*==============================================================================*/
+ScriptTask closedLoopPositioningScript()
+{
+	const int steps = 3;
+	const double radius = 10.0;
+	const double tlr = 9;
+
+	for (int k = 0; k < steps; k++)
+	{
+		co_await reach(MX - tlr + tlr * k, MY + radius - radius * k);
+		co_await hold(2000);
+		co_await record();
+		co_await hold(60000);
+		Measurement m = co_await record(false);
+		printTrial("Positioning", k, 0, m, false);
+	}
+}
+
+const ScriptInfo experimentScripts[] = {
+	{ "INFINITY_SCRIPT", "Open loop infinity test (script)", openLoopInfinityScript },
+	{ "DISTANCES_SCRIPT", "Open loop velocity at different distances from coil 4 (script)", openLoopDifferentDistancesScript },
+	{ "VOLTAGE_SCRIPT", "Open loop velocity at the coil voltage set on the supply (script)", openLoopDifferentVoltageScript },
+	{ "COMBINATIONS_SCRIPT", "Open loop velocity of different coil combinations (script)", openLoopDifferentCombinationsScript },
+	{ "POSITIONING_SCRIPT", "Closed loop positioning accuracy (script)", closedLoopPositioningScript }
+};
+const int nExperimentScripts = sizeof(experimentScripts) / sizeof(experimentScripts[0]);
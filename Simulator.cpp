@@ -0,0 +1,159 @@
+/*
+Simulator.cpp - Ferrofludic manipulator particle simulator
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "Simulator.h"
+
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+//Constructor
+ParticleSimulator::ParticleSimulator() : generator(2021), noise(0.0, 1.0)
+{
+	particles = 1;
+	u[0] = v[0] = 0;
+	vu[0] = vv[0] = 0;
+	activeCoils = 0;
+}
+
+/**====================================================
+* Function to initialize the simulator
+* Input: Positions of the coil tips, initial particle position
+* Output: NULL
+*======================================================*/
+void ParticleSimulator::Initialize(vpImagePoint coilTip[], vpImagePoint startPosition)
+{
+	for (int i = 0; i < 8; i++)
+		coils[i] = coilTip[i];
+	getForceModel(plant);
+
+	particles = 1;
+	u[0] = startPosition.get_u();
+	v[0] = startPosition.get_v();
+	vu[0] = vv[0] = 0;
+	activeCoils = 0;
+	arenaCenter = startPosition;
+	generator.seed(2021);
+}
+
+/**====================================================
+* Function to add a particle, moved by the same coils
+* Input: Initial position
+* Output: bool (0 if there are already maxSimParticles)
+*======================================================*/
+bool ParticleSimulator::addParticle(vpImagePoint position)
+{
+	if (particles >= maxSimParticles)
+		return false;
+	u[particles] = position.get_u();
+	v[particles] = position.get_v();
+	vu[particles] = vv[particles] = 0;
+	particles++;
+	return true;
+}
+
+/**====================================================
+* Function to apply a coil mask (replaces the DAQ write)
+* Input: unsigned 8 bit int for the digital output
+* Output: NULL
+*======================================================*/
+void ParticleSimulator::setCoils(uInt8 data)
+{
+	activeCoils = data;
+}
+
+uInt8 ParticleSimulator::getCoils()
+{
+	return activeCoils;
+}
+
+vpImagePoint ParticleSimulator::getPosition(int particle)
+{
+	return vpImagePoint(v[particle], u[particle]);
+}
+
+void ParticleSimulator::getParticle(int particle, double &pu, double &pv)
+{
+	pu = u[particle];
+	pv = v[particle];
+}
+
+/**====================================================
+* Function to integrate the particle motion
+* Input: time step (ms)
+* Output: NULL
+*======================================================*/
+void ParticleSimulator::step(double dt_ms)
+{
+	double remaining = dt_ms;
+
+	while (remaining > 0)
+	{
+		double h = (remaining < substep ? remaining : substep) / 1000.0;
+		remaining -= substep;
+
+		for (int k = 0; k < particles; k++)
+		{
+			//Steady state velocity from the active coils (pixels/s)
+			double targetU = 0.0;
+			double targetV = 0.0;
+			for (int i = 0; i < 8; i++)
+			{
+				if (!(activeCoils & (1 << i)))
+					continue;
+
+				double MPu = u[k] - coils[i].get_u();
+				double MPv = v[k] - coils[i].get_v();
+				double MP_norm = sqrt(MPu * MPu + MPv * MPv);
+				if (MP_norm < mm2pix * 0.5)
+					MP_norm = mm2pix * 0.5;
+
+				double speed = gainScale * plant.gain[i] * pow(MP_norm / mm2pix, plant.exponent[i]) * mm2pix;
+				targetU += speed * MPu / MP_norm;
+				targetV += speed * MPv / MP_norm;
+			}
+
+			if (noiseStd > 0)
+			{
+				targetU += noiseStd * mm2pix * noise(generator);
+				targetV += noiseStd * mm2pix * noise(generator);
+			}
+
+			//First order drag lag
+			double a = h / (dragTimeConstant + h);
+			vu[k] += a * (targetU - vu[k]);
+			vv[k] += a * (targetV - vv[k]);
+
+			u[k] += vu[k] * h;
+			v[k] += vv[k] * h;
+
+			//Stop at the wall of the dish
+			double du = u[k] - arenaCenter.get_u();
+			double dv = v[k] - arenaCenter.get_v();
+			double r = sqrt(du * du + dv * dv);
+			if (r > arenaRadius)
+			{
+				u[k] = arenaCenter.get_u() + du * arenaRadius / r;
+				v[k] = arenaCenter.get_v() + dv * arenaRadius / r;
+				vu[k] = 0;
+				vv[k] = 0;
+			}
+		}
+	}
+}
+
+/**====================================================
+* Function to move the synthetic camera particle by one frame
+* Input: time step (ms), particle position (output)
+* Output: NULL
+*======================================================*/
+void ParticleSimulator::advance(double dt_ms, double &pu, double &pv)
+{
+	step(dt_ms);
+	pu = u[0];
+	pv = v[0];
+}
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include "Vision.h"
+#include "Controller.h"
+
+#include <random>
+
+/*	Note: Particle simulator
+*	Stands in for the DAQ and the camera. The coil mask written by Controller is
+*	applied to a copy of the force model used by lpModel, taken at Initialize so
+*	the online estimation (ModelEstimator.h) does not change the plant. Every
+*	particle follows it with a first order drag lag (the particles do not
+*	interact) and the positions are rendered by SyntheticSource on the next frame.
+*	Particle 0 is the one of Initialize, more can be added with addParticle.
+*/
+
+#define maxSimParticles 8
+
+class ParticleSimulator : public ParticleMotion
+{
+public:
+	//Constructor
+	ParticleSimulator();
+
+	void Initialize(vpImagePoint coilTip[], vpImagePoint startPosition);
+
+	bool addParticle(vpImagePoint position);
+
+	void setCoils(uInt8 data);
+	void step(double dt_ms);
+	void advance(double dt_ms, double &u, double &v);
+
+	vpImagePoint getPosition(int particle = 0);
+	int getParticleCount() { return particles; }
+	void getParticle(int particle, double &u, double &v);
+	uInt8 getCoils();
+
+	// Time constant (s) of the drag lag between the model velocity and the particle velocity
+	double dragTimeConstant = 0.05;
+	// Gain of the simulated coils relative to the model (drift of the rig)
+	double gainScale = 1.0;
+	// Standard deviation of the velocity noise (mm/s)
+	double noiseStd = 0.0;
+	// Integration step (ms)
+	double substep = 1.0;
+	// Dish around the centre, the particle stops at the wall (pixels)
+	vpImagePoint arenaCenter;
+	double arenaRadius = 250.0;
+
+private:
+	vpImagePoint coils[8];
+	ForceModel plant;
+	int particles;
+	double u[maxSimParticles], v[maxSimParticles];		// position (pixels)
+	double vu[maxSimParticles], vv[maxSimParticles];	// velocity (pixels/s)
+	uInt8 activeCoils;
+
+	std::mt19937 generator;
+	std::normal_distribution<double> noise;
+};
+
+#endif //SIMULATOR_H
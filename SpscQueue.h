@@ -0,0 +1,48 @@
+#pragma once
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+/*	Note: Single producer, single consumer queue
+*	Fixed size ring (capacity must be a power of two), no locks and no allocation.
+*	The producer only writes tail and the consumer only writes head, each on its own
+*	cache line. push() returns 0 when the queue is full, the item is then dropped.
+*/
+
+template <typename T, size_t capacity>
+class SpscQueue
+{
+	static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	bool push(const T& item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == capacity)
+			return false;
+		items[t & (capacity - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		item = items[h & (capacity - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+	T items[capacity];
+};
+
+#endif //SPSCQUEUE_H
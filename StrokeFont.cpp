@@ -0,0 +1,217 @@
+/*
+StrokeFont.cpp - Stroke font, text layout and stroke ordering
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "StrokeFont.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+struct Glyph
+{
+	char c;
+	const char* strokes;	// polylines of (u, v) digit pairs, separated by spaces
+};
+
+static const Glyph font[] = {
+	{ 'A', "062046 1333" },
+	{ 'B', "060030414233033344453606" },
+	{ 'C', "40301001051646" },
+	{ 'D', "06002042442606" },
+	{ 'E', "40000646 0333" },
+	{ 'F', "400006 0333" },
+	{ 'G', "400006464323" },
+	{ 'H', "0006 4046 0343" },
+	{ 'I', "0040 2026 0646" },
+	{ 'J', "4045361605" },
+	{ 'K', "0006 400346" },
+	{ 'L', "000646" },
+	{ 'M', "0600224046" },
+	{ 'N', "06004640" },
+	{ 'O', "0006464000" },
+	{ 'P', "0600404303" },
+	{ 'Q', "0006464000 2446" },
+	{ 'R', "0600404303 2346" },
+	{ 'S', "400003434606" },
+	{ 'T', "0040 2026" },
+	{ 'U', "00064640" },
+	{ 'V', "002640" },
+	{ 'W', "0016233640" },
+	{ 'X', "0046 4006" },
+	{ 'Y', "002340 2326" },
+	{ 'Z', "00400646" },
+	{ '0', "0040460600" },
+	{ '1', "112026 0646" },
+	{ '2', "004043030646" },
+	{ '3', "00404606 0343" },
+	{ '4', "000343 4046" },
+	{ '5', "400003434606" },
+	{ '6', "400006464303" },
+	{ '7', "004026" },
+	{ '8', "0040460600 0343" },
+	{ '9', "430300404606" },
+	{ '-', "0343" },
+	{ '.', "2526" },
+	{ ' ', "" }
+};
+
+static const Glyph* findGlyph(char c)
+{
+	c = (char)toupper((unsigned char)c);
+	for (size_t i = 0; i < sizeof(font) / sizeof(font[0]); i++)
+		if (font[i].c == c)
+			return &font[i];
+	return NULL;
+}
+
+/**====================================================
+* Function to lay out a string on one line
+* Input: Text, pixels per grid unit, maximum width (pixels)
+* Output: Strokes in glyph order, pixels relative to the center of the text
+*======================================================*/
+std::vector<Stroke> LayoutText(const std::string& text, double unit, double maxWidth)
+{
+	vector<Stroke> strokes;
+	if (text.empty())
+		return strokes;
+
+	double width = (double)(glyphAdvance * text.size() - (glyphAdvance - glyphWidth));
+	if (width * unit > maxWidth)
+		unit = maxWidth / width;
+	double left = -width * unit / 2;
+	double top = -glyphHeight * unit / 2;
+
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		const Glyph* glyph = findGlyph(text[i]);
+		if (!glyph)
+		{
+			cout << "No glyph for '" << text[i] << "'" << endl;
+			continue;
+		}
+
+		Stroke stroke;
+		for (const char* p = glyph->strokes; ; p++)
+		{
+			if (*p == ' ' || *p == '\0')
+			{
+				if (stroke.size() >= 4)
+					strokes.push_back(stroke);
+				stroke.clear();
+				if (*p == '\0')
+					break;
+				continue;
+			}
+			stroke.push_back(left + (glyphAdvance * i + (p[0] - '0')) * unit);
+			stroke.push_back(top + (p[1] - '0') * unit);
+			p++;
+		}
+	}
+	return strokes;
+}
+
+static double distance(const Stroke& a, bool aEnd, const Stroke& b, bool bEnd)
+{
+	size_t i = aEnd ? a.size() - 2 : 0;
+	size_t j = bEnd ? b.size() - 2 : 0;
+	return hypot(a[i] - b[j], a[i + 1] - b[j + 1]);
+}
+
+static void reverseStroke(Stroke& s)
+{
+	for (size_t i = 0, j = s.size() - 2; i < j; i += 2, j -= 2)
+	{
+		swap(s[i], s[j]);
+		swap(s[i + 1], s[j + 1]);
+	}
+}
+
+/**====================================================
+* Function to get the travel between consecutive strokes
+* Input: Strokes in drawing order
+* Output: Travel (pixels)
+*======================================================*/
+double StrokeTravel(const std::vector<Stroke>& strokes)
+{
+	double travel = 0;
+	for (size_t i = 1; i < strokes.size(); i++)
+		travel += distance(strokes[i - 1], true, strokes[i], false);
+	return travel;
+}
+
+/**====================================================
+* Function to order and orient the strokes to minimize the travel between them
+* Input: Strokes (reordered in place)
+* Output: NULL
+*======================================================*/
+void OrderStrokes(std::vector<Stroke>& strokes)
+{
+	size_t n = strokes.size();
+	if (n < 2)
+		return;
+
+	// Greedy nearest neighbour from the first stroke
+	vector<Stroke> ordered;
+	vector<bool> used(n, false);
+	ordered.push_back(strokes[0]);
+	used[0] = true;
+	for (size_t k = 1; k < n; k++)
+	{
+		const Stroke& last = ordered.back();
+		size_t best = 0;
+		bool bestReversed = false;
+		double bestDistance = 1e300;
+		for (size_t i = 0; i < n; i++)
+		{
+			if (used[i])
+				continue;
+			double d = distance(last, true, strokes[i], false);
+			double r = distance(last, true, strokes[i], true);
+			if (d < bestDistance) { bestDistance = d; best = i; bestReversed = false; }
+			if (r < bestDistance) { bestDistance = r; best = i; bestReversed = true; }
+		}
+		used[best] = true;
+		ordered.push_back(strokes[best]);
+		if (bestReversed)
+			reverseStroke(ordered.back());
+	}
+
+	// 2-opt: reverse the order and direction of a run of strokes while it shortens the travel
+	bool improved = true;
+	for (int pass = 0; improved && pass < 100; pass++)
+	{
+		improved = false;
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t j = i; j < n; j++)
+			{
+				double before = 0, after = 0;
+				if (i > 0)
+				{
+					before += distance(ordered[i - 1], true, ordered[i], false);
+					after += distance(ordered[i - 1], true, ordered[j], true);
+				}
+				if (j + 1 < n)
+				{
+					before += distance(ordered[j], true, ordered[j + 1], false);
+					after += distance(ordered[i], false, ordered[j + 1], false);
+				}
+				if (after < before - 1e-9)
+				{
+					reverse(ordered.begin() + i, ordered.begin() + j + 1);
+					for (size_t k = i; k <= j; k++)
+						reverseStroke(ordered[k]);
+					improved = true;
+				}
+			}
+		}
+	}
+
+	strokes = ordered;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#ifndef STROKEFONT_H
+#define STROKEFONT_H
+
+#include <string>
+#include <vector>
+
+/*	Note: Stroke font
+*	Every glyph is a few polylines on a 4 x 6 grid (u to the right, v down), the
+*	same proportions as the hand-coded letters (120 x 180 px at 30 px per unit).
+*	LayoutText places the glyphs of a string on one line centered at (0, 0),
+*	shrinking the unit if the string is wider than maxWidth. OrderStrokes then
+*	chooses the order and direction of the strokes to minimize the travel between
+*	them (greedy nearest neighbour, then 2-opt). Letters are lower or upper case
+*	(both drawn upper case), digits, space, '-' and '.'.
+*/
+
+#define glyphWidth 4
+#define glyphHeight 6
+#define glyphAdvance 6
+#define glyphUnit 30.0		// pixels per grid unit
+#define textMaxWidth 370.0	// pixels
+
+typedef std::vector<double> Stroke;	// u0, v0, u1, v1, ...
+
+std::vector<Stroke> LayoutText(const std::string& text, double unit = glyphUnit, double maxWidth = textMaxWidth);
+double StrokeTravel(const std::vector<Stroke>& strokes);
+void OrderStrokes(std::vector<Stroke>& strokes);
+
+#endif //STROKEFONT_H
@@ -0,0 +1,228 @@
+/*
+Telemetry.cpp - Shared memory telemetry stream
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "Telemetry.h"
+
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/**====================================================
+* Function to map the shared telemetry region
+* Input: Region name, create (writer) or open (reader), mapping handle (output)
+* Output: Region, NULL on failure
+*======================================================*/
+static TelemetryRegion* mapRegion(const std::string& name, bool create, void*& mapping)
+{
+	mapping = NULL;
+#ifdef _WIN32
+	HANDLE handle;
+	std::string path = "Local\\" + name;
+	if (create)
+		handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(TelemetryRegion), path.c_str());
+	else
+		handle = OpenFileMappingA(FILE_MAP_READ, FALSE, path.c_str());
+	if (handle == NULL)
+		return NULL;
+	void* address = MapViewOfFile(handle, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, sizeof(TelemetryRegion));
+	if (address == NULL)
+	{
+		CloseHandle(handle);
+		return NULL;
+	}
+	mapping = handle;
+	return (TelemetryRegion*)address;
+#else
+	std::string path = "/" + name;
+	int fd = create ? shm_open(path.c_str(), O_CREAT | O_RDWR, 0644) : shm_open(path.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	if (create && ftruncate(fd, sizeof(TelemetryRegion)) != 0)
+	{
+		::close(fd);
+		return NULL;
+	}
+	void* address = mmap(NULL, sizeof(TelemetryRegion), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (address == MAP_FAILED)
+		return NULL;
+	return (TelemetryRegion*)address;
+#endif
+}
+
+static void unmapRegion(TelemetryRegion* region, void* mapping)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(region);
+	CloseHandle((HANDLE)mapping);
+#else
+	(void)mapping; // no handle to close on POSIX
+	munmap(region, sizeof(TelemetryRegion));
+#endif
+}
+
+//Constructor
+TelemetryPublisher::TelemetryPublisher()
+{
+	region = NULL;
+	mapping = NULL;
+}
+
+TelemetryPublisher::~TelemetryPublisher()
+{
+	close();
+}
+
+/**====================================================
+* Function to create the shared region
+* Input: Region name
+* Output: bool (1 if created)
+*======================================================*/
+bool TelemetryPublisher::open(const std::string& name)
+{
+	if (region)
+		return true;
+
+	region = mapRegion(name, true, mapping);
+	if (!region)
+	{
+		cout << "Could not create the telemetry shared memory" << endl;
+		return false;
+	}
+
+	new (region) TelemetryRegion();
+	for (int i = 0; i < telemetrySlots; i++)
+		region->slots[i].sequence.store(0, std::memory_order_relaxed);
+	region->header.published.store(0, std::memory_order_relaxed);
+	region->header.slots = telemetrySlots;
+	region->header.frameSize = sizeof(TelemetryFrame);
+	region->header.version = telemetryVersion;
+	std::atomic_thread_fence(std::memory_order_release);
+	region->header.magic = telemetryMagic;
+
+	regionName = name;
+	cout << "Publishing telemetry to shared memory " << name << endl;
+	return true;
+}
+
+void TelemetryPublisher::close()
+{
+	if (!region)
+		return;
+	unmapRegion(region, mapping);
+#ifndef _WIN32
+	shm_unlink(("/" + regionName).c_str());
+#endif
+	region = NULL;
+	mapping = NULL;
+}
+
+/**====================================================
+* Function to publish one frame (never blocks)
+* Input: Frame (the frame number is filled in)
+* Output: NULL
+*======================================================*/
+void TelemetryPublisher::publish(const TelemetryFrame& frame)
+{
+	if (!region)
+		return;
+
+	uint64_t n = region->header.published.load(std::memory_order_relaxed);
+	TelemetrySlot& slot = region->slots[n & (telemetrySlots - 1)];
+	uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(&slot.data, &frame, sizeof(TelemetryFrame));
+	slot.data.frame = n;
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+
+	region->header.published.store(n + 1, std::memory_order_release);
+}
+
+//Constructor
+TelemetryReader::TelemetryReader()
+{
+	region = NULL;
+	mapping = NULL;
+}
+
+TelemetryReader::~TelemetryReader()
+{
+	close();
+}
+
+/**====================================================
+* Function to attach to the region of a running loop
+* Input: Region name
+* Output: bool (1 if attached and the layout matches)
+*======================================================*/
+bool TelemetryReader::open(const std::string& name)
+{
+	if (region)
+		return true;
+
+	region = mapRegion(name, false, mapping);
+	if (!region)
+		return false;
+
+	if (region->header.magic != telemetryMagic || region->header.version != telemetryVersion
+		|| region->header.slots != telemetrySlots || region->header.frameSize != sizeof(TelemetryFrame))
+	{
+		cout << "Telemetry layout mismatch" << endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void TelemetryReader::close()
+{
+	if (!region)
+		return;
+	unmapRegion(region, mapping);
+	region = NULL;
+	mapping = NULL;
+}
+
+uint64_t TelemetryReader::published()
+{
+	return region ? region->header.published.load(std::memory_order_acquire) : 0;
+}
+
+/**====================================================
+* Function to read a frame by number
+* Input: Frame number, frame (output)
+* Output: bool (0 if not published yet or already overwritten)
+*======================================================*/
+bool TelemetryReader::read(uint64_t index, TelemetryFrame& frame)
+{
+	if (!region || index >= published())
+		return false;
+
+	const TelemetrySlot& slot = region->slots[index & (telemetrySlots - 1)];
+	for (int attempt = 0; attempt < 100; attempt++)
+	{
+		uint32_t before = slot.sequence.load(std::memory_order_acquire);
+		if (before & 1)
+			continue; // being written
+		memcpy(&frame, (const void*)&slot.data, sizeof(TelemetryFrame));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) == before)
+			return frame.frame == index;
+	}
+	return false;
+}
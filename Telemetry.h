@@ -0,0 +1,104 @@
+#pragma once
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "Profiler.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+/*	Note: Shared memory telemetry
+*	Every frame the loop publishes a TelemetryFrame into a ring of telemetrySlots
+*	slots in shared memory (POSIX shm "/ferro_telemetry", or the named file mapping
+*	"Local\ferro_telemetry" on Windows). Each slot is a seqlock: the writer makes
+*	the slot sequence odd, copies the frame, then makes it even again. It never waits
+*	for readers. A reader copies a slot and keeps the copy only if the sequence was
+*	even and unchanged. Readers that fall more than telemetrySlots frames behind
+*	lose frames but never see torn ones. TelemetryReader is the reader side, for
+*	plotting and analysis tools. Every rig of a bench publishes to its own region
+*	(telemetryName + "_" + rig name, see VisualServo.h).
+*/
+
+#define telemetryName "ferro_telemetry"
+#define telemetryMagic 0x4D4C4554	// "TELM"
+#define telemetryVersion 2			// 2: Window stage
+#define telemetrySlots 1024			// power of two
+
+struct TelemetryFrame
+{
+	uint64_t frame;
+	double timestamp_ms;	// frame timestamp of the source
+	float cogU, cogV;		// pixels
+	float velocityU, velocityV;	// pixels/s, finite difference of the CoG
+	float targetU, targetV;	// pixels
+	uint8_t coils;			// activation mask written to the DAQ
+	uint8_t automatic;		// 1 tracking, 0 manual
+	uint8_t recording;
+	uint8_t tracked;
+	float stageUs[STAGE_LAST];	// latest time of every stage (us)
+};
+
+struct TelemetrySlot
+{
+	std::atomic<uint32_t> sequence;
+	TelemetryFrame data;
+};
+
+struct TelemetryHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t frameSize;
+	std::atomic<uint64_t> published;	// number of frames written
+};
+
+struct TelemetryRegion
+{
+	TelemetryHeader header;
+	alignas(64) TelemetrySlot slots[telemetrySlots];
+};
+
+/**====================================================
+* Writer (control loop)
+*======================================================*/
+class TelemetryPublisher
+{
+public:
+	TelemetryPublisher();
+	~TelemetryPublisher();
+
+	bool open(const std::string& name = telemetryName);
+	void close();
+	bool isOpen() { return region != NULL; }
+
+	void publish(const TelemetryFrame& frame);
+
+private:
+	TelemetryRegion* region;
+	void* mapping;
+	std::string regionName;
+};
+
+/**====================================================
+* Reader (external tools)
+*======================================================*/
+class TelemetryReader
+{
+public:
+	TelemetryReader();
+	~TelemetryReader();
+
+	bool open(const std::string& name = telemetryName);
+	void close();
+
+	uint64_t published();
+	bool read(uint64_t index, TelemetryFrame& frame);
+
+private:
+	TelemetryRegion* region;
+	void* mapping;
+};
+
+#endif //TELEMETRY_H
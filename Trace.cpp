@@ -0,0 +1,103 @@
+/*
+Trace.cpp - Chrome trace-event export of the control loop timeline
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "Trace.h"
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+thread_local TraceBuffer MyTrace;
+
+//Constructor
+TraceBuffer::TraceBuffer()
+{
+	head = 0;
+	wrapped = false;
+	enabled = false;
+	written = false;
+	origin = 0;
+}
+
+/**====================================================
+* Function to allocate the buffer and start tracing
+* Input: Number of events kept in memory
+* Output: NULL
+*======================================================*/
+void TraceBuffer::enable(size_t capacity)
+{
+	events.assign(capacity, TraceEvent());
+	head = 0;
+	wrapped = false;
+	written = false;
+	origin = StageProfiler::now();
+	enabled = true;
+	cout << "Tracing enabled (" << capacity << " events)" << endl;
+}
+
+/**====================================================
+* Function to write the trace to a time stamped file
+* Input: NULL
+* Output: bool (1 if written)
+*======================================================*/
+bool TraceBuffer::WriteChromeTrace()
+{
+	if (!enabled || written)
+		return false;
+	auto now = std::chrono::system_clock::now();
+	auto in_time_t = std::chrono::system_clock::to_time_t(now);
+	std::stringstream ss;
+	ss << std::put_time(std::localtime(&in_time_t), "%Y_%m_%d_%H_%M_%S");
+	return WriteChromeTrace("trace_" + ss.str() + ".json");
+}
+
+/**====================================================
+* Function to write the trace as Chrome trace-event JSON. Later calls
+* write nothing, so the exit paths cannot produce a second file.
+* Input: File name
+* Output: bool (1 if written)
+*======================================================*/
+bool TraceBuffer::WriteChromeTrace(const std::string& fileName)
+{
+	if (!enabled || written)
+		return false;
+
+	ofstream file(fileName, ios::out);
+	if (!file.is_open())
+	{
+		cout << "Could not open " << fileName << endl;
+		return false;
+	}
+
+	size_t first = wrapped ? head : 0;
+	size_t n = wrapped ? events.size() : head;
+
+	file << fixed << setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"VisionServoing\"}}";
+	for (size_t k = 0; k < n; k++)
+	{
+		const TraceEvent& e = events[(first + k) % events.size()];
+		double ts = MyProfiler.toNs(e.start - origin) / 1000.0;
+
+		file << ",\n{\"name\":\"" << e.name << "\",\"pid\":1,\"tid\":" << e.tid << ",\"ts\":" << ts;
+		if (e.duration < 0)
+			file << ",\"ph\":\"i\",\"s\":\"g\"}";
+		else
+			file << ",\"ph\":\"X\",\"dur\":" << MyProfiler.toNs(e.duration) / 1000.0 << "}";
+	}
+	file << "\n]}" << endl;
+	file.close();
+	written = true;
+
+	cout << "Wrote " << n << " trace events to " << fileName << endl;
+	return true;
+}
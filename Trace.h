@@ -0,0 +1,105 @@
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "Profiler.h"
+
+#include <string>
+#include <vector>
+
+/*	Note: Timeline tracing
+*	When enabled, every profiled stage, DAQ write, mode change and recording start or
+*	stop is stored in a preallocated ring buffer (the oldest events are overwritten).
+*	WriteChromeTrace dumps it as Chrome trace-event JSON, which opens in
+*	chrome://tracing or ui.perfetto.dev. Event names must be string literals.
+*/
+
+struct TraceEvent
+{
+	const char* name;
+	long long start;	// ticks
+	long long duration;	// ticks, -1 for instant events
+	int tid;
+};
+
+class TraceBuffer
+{
+public:
+	TraceBuffer();
+
+	void enable(size_t capacity = (1 << 21));
+	bool isEnabled() { return enabled; }
+
+	void complete(const char* name, long long startTicks, long long endTicks, int tid = 1)
+	{
+		if (!enabled)
+			return;
+		TraceEvent& e = events[head];
+		e.name = name;
+		e.start = startTicks;
+		e.duration = endTicks - startTicks;
+		e.tid = tid;
+		advance();
+	}
+	void instant(const char* name, int tid = 1)
+	{
+		if (!enabled)
+			return;
+		TraceEvent& e = events[head];
+		e.name = name;
+		e.start = StageProfiler::now();
+		e.duration = -1;
+		e.tid = tid;
+		advance();
+	}
+
+	bool WriteChromeTrace(const std::string& fileName);
+	bool WriteChromeTrace();
+
+private:
+	void advance()
+	{
+		head++;
+		if (head == events.size())
+		{
+			head = 0;
+			wrapped = true;
+		}
+	}
+
+	std::vector<TraceEvent> events;
+	size_t head;
+	bool wrapped;
+	bool enabled;
+	bool written;	// the trace is written once, at exit
+	long long origin;
+};
+
+extern thread_local TraceBuffer MyTrace;
+
+/**====================================================
+* Scoped trace event
+*======================================================*/
+class TraceScope
+{
+public:
+	TraceScope(const char* n) : name(n), start(StageProfiler::now()), outer(loopScope.load(std::memory_order_relaxed))
+	{
+		loopScope.store(n, std::memory_order_relaxed);
+	}
+	~TraceScope()
+	{
+		MyTrace.complete(name, start, StageProfiler::now());
+		loopScope.store(outer, std::memory_order_relaxed);
+	}
+
+private:
+	const char* name;
+	long long start;
+	const char* outer;
+};
+
+#define TRACE_SCOPE(name) TraceScope PROFILE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_INSTANT(name) MyTrace.instant(name)
+
+#endif //TRACE_H
@@ -0,0 +1,552 @@
+/*
+TrajectoryLibrary.cpp - Trajectories loaded from file and compiled into paths
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "TrajectoryLibrary.h"
+#include "StrokeFont.h"
+
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+thread_local TrajectoryLibrary MyTrajectories;
+
+typedef enum {
+	PRIM_MOVE,
+	PRIM_LINE,
+	PRIM_ARC,
+	PRIM_SPLINE,
+	PRIM_SPIRAL
+} PrimitiveType;
+
+//Constructor
+TrajectoryLibrary::TrajectoryLibrary()
+{
+	originU = 0;
+	originV = 0;
+	compiledStepsize = 0;
+}
+
+/**====================================================
+* Function to load the trajectories from a file
+* Input: File name
+* Output: bool (1 if at least one trajectory was loaded)
+*======================================================*/
+bool TrajectoryLibrary::Load(const std::string& fileName)
+{
+	ifstream file(fileName);
+	if (!file.is_open())
+	{
+		cout << "Could not open trajectory file " << fileName << endl;
+		return false;
+	}
+
+	trajectories.clear();
+	textCache.clear();
+	points.clear();
+	compiledStepsize = 0;
+
+	string line;
+	int lineNumber = 0;
+	Trajectory* current = NULL;
+	while (getline(file, line))
+	{
+		lineNumber++;
+		stringstream ss(line);
+		string keyword;
+		if (!(ss >> keyword) || keyword[0] == '#')
+			continue;
+
+		if (keyword == "origin")
+		{
+			ss >> originU >> originV;
+			continue;
+		}
+		if (keyword == "text")
+		{
+			string name, text;
+			ss >> name;
+			getline(ss >> ws, text);
+			AddText(text, name);
+			current = NULL;
+			continue;
+		}
+		if (keyword == "trajectory")
+		{
+			Trajectory t;
+			ss >> t.name;
+			getline(ss >> ws, t.description);
+			if (t.description.empty())
+				t.description = t.name;
+			t.show = false;
+			t.offset = 0;
+			t.count = 0;
+			trajectories.push_back(t);
+			current = &trajectories.back();
+			continue;
+		}
+		if (!current)
+		{
+			cout << fileName << ":" << lineNumber << ": " << keyword << " outside of a trajectory" << endl;
+			continue;
+		}
+		if (keyword == "end")
+		{
+			current = NULL;
+			continue;
+		}
+		if (keyword == "show")
+		{
+			current->show = true;
+			continue;
+		}
+
+		Primitive p;
+		size_t nArgs;
+		if (keyword == "move") { p.type = PRIM_MOVE; nArgs = 2; }
+		else if (keyword == "line") { p.type = PRIM_LINE; nArgs = 2; }
+		else if (keyword == "arc") { p.type = PRIM_ARC; nArgs = 3; }
+		else if (keyword == "spline") { p.type = PRIM_SPLINE; nArgs = 0; }
+		else if (keyword == "spiral") { p.type = PRIM_SPIRAL; nArgs = 5; }
+		else
+		{
+			cout << fileName << ":" << lineNumber << ": unknown keyword " << keyword << endl;
+			continue;
+		}
+
+		double value;
+		while (ss >> value)
+			p.args.push_back(value);
+		bool valid = (nArgs > 0) ? (p.args.size() == nArgs) : (p.args.size() >= 2 && p.args.size() % 2 == 0);
+		if (!valid)
+		{
+			cout << fileName << ":" << lineNumber << ": wrong number of values for " << keyword << endl;
+			continue;
+		}
+		current->primitives.push_back(p);
+	}
+
+	cout << "Loaded " << trajectories.size() << " trajectories from " << fileName << endl;
+	return !trajectories.empty();
+}
+
+/**====================================================
+* Function to find a trajectory by name
+* Input: Name
+* Output: id, -1 if not found
+*======================================================*/
+int TrajectoryLibrary::find(const std::string& name)
+{
+	for (size_t i = 0; i < trajectories.size(); i++)
+		if (trajectories[i].name == name)
+			return (int)i;
+	return -1;
+}
+
+/**====================================================
+* Function to add a trajectory writing a string (cached per string)
+* Input: Text, trajectory name (the text if empty)
+* Output: id of the trajectory, -1 if nothing can be drawn
+*======================================================*/
+int TrajectoryLibrary::AddText(const std::string& text, const std::string& name)
+{
+	map<string, int>::iterator cached = textCache.find(text);
+	if (cached != textCache.end())
+		return cached->second;
+
+	vector<Stroke> strokes = LayoutText(text);
+	if (strokes.empty())
+		return -1;
+	double glyphOrderTravel = StrokeTravel(strokes);
+	OrderStrokes(strokes);
+
+	Trajectory t;
+	t.name = name.empty() ? text : name;
+	t.description = "Write " + text;
+	t.show = false;
+	t.offset = 0;
+	t.count = 0;
+	for (size_t i = 0; i < strokes.size(); i++)
+	{
+		const Stroke& stroke = strokes[i];
+		for (size_t k = 0; k < stroke.size(); k += 2)
+		{
+			Primitive p;
+			p.type = (i == 0 && k == 0) ? PRIM_MOVE : PRIM_LINE;
+			p.args.assign({ stroke[k], stroke[k + 1] });
+			t.primitives.push_back(p);
+		}
+	}
+	trajectories.push_back(t);
+	compiledStepsize = 0; // compile again before use
+
+	int id = (int)trajectories.size() - 1;
+	textCache[text] = id;
+	cout << "Text \"" << text << "\": " << strokes.size() << " strokes, travel " << StrokeTravel(strokes)
+		<< " px (" << glyphOrderTravel << " px in glyph order)" << endl;
+	return id;
+}
+
+/**====================================================
+* Function to sample a primitive densely (relative coordinates)
+* Input: Primitive, current point (updated to its end), dense points (output)
+* Output: NULL
+*======================================================*/
+void TrajectoryLibrary::tessellate(const Primitive& primitive, double& u, double& v, std::vector<double>& dense)
+{
+	const vector<double>& a = primitive.args;
+	dense.clear();
+
+	switch (primitive.type)
+	{
+	case PRIM_LINE:
+		dense.insert(dense.end(), { u, v, a[0], a[1] });
+		break;
+
+	case PRIM_ARC:
+	{
+		double radius = hypot(u - a[0], v - a[1]);
+		double start = atan2(v - a[1], u - a[0]);
+		double sweep = a[2] * M_PI / 180.0;
+		int n = max(4, (int)ceil(fabs(a[2])));	// 1 degree
+		for (int i = 0; i <= n; i++)
+		{
+			double angle = start + sweep * i / n;
+			dense.push_back(a[0] + radius * cos(angle));
+			dense.push_back(a[1] + radius * sin(angle));
+		}
+		break;
+	}
+
+	case PRIM_SPLINE:
+	{
+		// Catmull-Rom through the current point and the given points
+		vector<double> p = { u, v };
+		p.insert(p.end(), a.begin(), a.end());
+		int n = (int)p.size() / 2;
+		const int samples = 32;
+		for (int s = 0; s + 1 < n; s++)
+		{
+			int i0 = max(s - 1, 0), i1 = s, i2 = s + 1, i3 = min(s + 2, n - 1);
+			for (int k = (s == 0) ? 0 : 1; k <= samples; k++)
+			{
+				double t = (double)k / samples, t2 = t * t, t3 = t2 * t;
+				for (int c = 0; c < 2; c++)
+				{
+					double p0 = p[2 * i0 + c], p1 = p[2 * i1 + c], p2 = p[2 * i2 + c], p3 = p[2 * i3 + c];
+					dense.push_back(0.5 * (2 * p1 + (p2 - p0) * t + (2 * p0 - 5 * p1 + 4 * p2 - p3) * t2 + (3 * p1 - p0 - 3 * p2 + p3) * t3));
+				}
+			}
+		}
+		break;
+	}
+
+	case PRIM_SPIRAL:
+	{
+		double end = 2 * M_PI * a[4];
+		int n = max(4, (int)ceil(end / 0.02));
+		for (int i = 0; i <= n; i++)
+		{
+			double theta = end * i / n;
+			double radius = a[2] + a[3] * theta / (2 * M_PI);
+			dense.push_back(a[0] + radius * cos(theta));
+			dense.push_back(a[1] + radius * sin(theta));
+		}
+		break;
+	}
+	}
+
+	if (dense.size() >= 2)
+	{
+		u = dense[dense.size() - 2];
+		v = dense[dense.size() - 1];
+	}
+}
+
+/**====================================================
+* Function to append a dense polyline resampled at equal arc length.
+* The first point is not appended, the last point is kept exactly.
+* Input: Dense points, step size (pixels)
+* Output: NULL
+*======================================================*/
+void TrajectoryLibrary::resample(const std::vector<double>& dense, double stepsize)
+{
+	size_t n = dense.size() / 2;
+	vector<double> length(n, 0.0);
+	for (size_t i = 1; i < n; i++)
+		length[i] = length[i - 1] + hypot(dense[2 * i] - dense[2 * i - 2], dense[2 * i + 1] - dense[2 * i - 1]);
+
+	double total = length[n - 1];
+	if (total <= 1e-9)
+		return;
+
+	int steps = max(1, (int)ceil(total / stepsize - 1e-9));
+	size_t segment = 0;
+	for (int i = 1; i < steps; i++)
+	{
+		double s = total * i / steps;
+		while (segment + 2 < n && length[segment + 1] < s)
+			segment++;
+		double ds = length[segment + 1] - length[segment];
+		double t = (ds > 0) ? (s - length[segment]) / ds : 0.0;
+		points.push_back((float)(originU + dense[2 * segment] + t * (dense[2 * segment + 2] - dense[2 * segment])));
+		points.push_back((float)(originV + dense[2 * segment + 1] + t * (dense[2 * segment + 3] - dense[2 * segment + 1])));
+	}
+	points.push_back((float)(originU + dense[2 * n - 2]));
+	points.push_back((float)(originV + dense[2 * n - 1]));
+}
+
+/**====================================================
+* Function to compile all trajectories at a step size
+* Input: Step size (pixels)
+* Output: NULL
+*======================================================*/
+void TrajectoryLibrary::Compile(double stepsize)
+{
+	points.clear();
+	arcLength.clear();
+	vector<double> dense;
+
+	for (size_t t = 0; t < trajectories.size(); t++)
+	{
+		Trajectory& trajectory = trajectories[t];
+		trajectory.offset = points.size() / 2;
+		double u = 0, v = 0;
+
+		for (size_t p = 0; p < trajectory.primitives.size(); p++)
+		{
+			const Primitive& primitive = trajectory.primitives[p];
+			if (primitive.type == PRIM_MOVE)
+			{
+				u = primitive.args[0];
+				v = primitive.args[1];
+				dense.assign({ u, v });
+			}
+			else
+			{
+				tessellate(primitive, u, v, dense);
+			}
+
+			// Start point of the trajectory, or a jump to the start of this primitive
+			size_t count = points.size() / 2 - trajectory.offset;
+			float startU = (float)(originU + dense[0]), startV = (float)(originV + dense[1]);
+			if (count == 0 || points[points.size() - 2] != startU || points[points.size() - 1] != startV)
+			{
+				points.push_back(startU);
+				points.push_back(startV);
+			}
+			if (dense.size() >= 4)
+				resample(dense, stepsize);
+		}
+		trajectory.count = (int)(points.size() / 2 - trajectory.offset);
+	}
+
+	// Cumulative arc length of every point from the start of its trajectory
+	arcLength.assign(points.size() / 2, 0.0f);
+	for (size_t t = 0; t < trajectories.size(); t++)
+	{
+		size_t first = trajectories[t].offset;
+		for (size_t i = first + 1; i < first + trajectories[t].count; i++)
+			arcLength[i] = arcLength[i - 1] + (float)hypot(points[2 * i] - points[2 * i - 2], points[2 * i + 1] - points[2 * i - 1]);
+		buildGrid(trajectories[t]);
+	}
+
+	compiledStepsize = stepsize;
+	cout << "Compiled " << trajectories.size() << " trajectories at " << stepsize << " px (" << points.size() / 2 << " points)" << endl;
+}
+
+const float* TrajectoryLibrary::getPath(int id, int& n)
+{
+	if (id < 0 || id >= (int)trajectories.size() || trajectories[id].count == 0)
+	{
+		n = 0;
+		return NULL;
+	}
+	n = trajectories[id].count;
+	return &points[2 * trajectories[id].offset];
+}
+
+const float* TrajectoryLibrary::getArcLength(int id)
+{
+	if (id < 0 || id >= (int)trajectories.size() || trajectories[id].count == 0)
+		return NULL;
+	return &arcLength[trajectories[id].offset];
+}
+
+/**====================================================
+* Function to build the segment grid of a compiled trajectory
+* Input: Trajectory
+* Output: NULL
+*======================================================*/
+void TrajectoryLibrary::buildGrid(Trajectory& trajectory)
+{
+	trajectory.cellStart.clear();
+	trajectory.cellSegments.clear();
+	trajectory.gridCols = 0;
+	trajectory.gridRows = 0;
+	if (trajectory.count < 2)
+		return;
+
+	const float* p = &points[2 * trajectory.offset];
+	double minU = p[0], maxU = p[0], minV = p[1], maxV = p[1];
+	for (int i = 1; i < trajectory.count; i++)
+	{
+		minU = min(minU, (double)p[2 * i]);
+		maxU = max(maxU, (double)p[2 * i]);
+		minV = min(minV, (double)p[2 * i + 1]);
+		maxV = max(maxV, (double)p[2 * i + 1]);
+	}
+	trajectory.gridU = minU;
+	trajectory.gridV = minV;
+	trajectory.gridCols = (int)((maxU - minU) / gridCellSize) + 1;
+	trajectory.gridRows = (int)((maxV - minV) / gridCellSize) + 1;
+
+	// Two passes (count, then fill) so every cell is a contiguous run
+	int nCells = trajectory.gridCols * trajectory.gridRows;
+	trajectory.cellStart.assign(nCells + 1, 0);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		vector<int> fill(trajectory.cellStart.begin(), trajectory.cellStart.end() - 1);
+		for (int i = 0; i + 1 < trajectory.count; i++)
+		{
+			int c0 = (int)((min(p[2 * i], p[2 * i + 2]) - minU) / gridCellSize);
+			int c1 = (int)((max(p[2 * i], p[2 * i + 2]) - minU) / gridCellSize);
+			int r0 = (int)((min(p[2 * i + 1], p[2 * i + 3]) - minV) / gridCellSize);
+			int r1 = (int)((max(p[2 * i + 1], p[2 * i + 3]) - minV) / gridCellSize);
+			for (int r = r0; r <= r1; r++)
+				for (int c = c0; c <= c1; c++)
+				{
+					if (pass == 0)
+						trajectory.cellStart[r * trajectory.gridCols + c + 1]++;
+					else
+						trajectory.cellSegments[fill[r * trajectory.gridCols + c]++] = i;
+				}
+		}
+		if (pass == 0)
+		{
+			for (int c = 0; c < nCells; c++)
+				trajectory.cellStart[c + 1] += trajectory.cellStart[c];
+			trajectory.cellSegments.resize(trajectory.cellStart[nCells]);
+		}
+	}
+}
+
+/**====================================================
+* Function to get the point at an arc length (clamped to the path)
+* Input: Trajectory id, arc length, point (output)
+* Output: NULL
+*======================================================*/
+void TrajectoryLibrary::pointAt(int id, double s, double& u, double& v)
+{
+	int n;
+	const float* p = getPath(id, n);
+	const float* arc = getArcLength(id);
+	if (n == 0)
+		return;
+	if (s <= 0 || n == 1)
+	{
+		u = p[0];
+		v = p[1];
+		return;
+	}
+
+	// Segment by binary search on the arc length
+	int i = (int)(upper_bound(arc, arc + n, (float)s) - arc) - 1;
+	if (i >= n - 1)
+	{
+		u = p[2 * n - 2];
+		v = p[2 * n - 1];
+		return;
+	}
+	double segment = arc[i + 1] - arc[i];
+	double t = (segment > 0) ? (s - arc[i]) / segment : 0.0;
+	u = p[2 * i] + t * (p[2 * i + 2] - p[2 * i]);
+	v = p[2 * i + 1] + t * (p[2 * i + 3] - p[2 * i + 1]);
+}
+
+int TrajectoryLibrary::indexAt(int id, double s)
+{
+	int n;
+	getPath(id, n);
+	const float* arc = getArcLength(id);
+	if (n == 0)
+		return -1;
+	int i = (int)(lower_bound(arc, arc + n, (float)s) - arc);
+	if (i >= n)
+		return n - 1;
+	if (i > 0 && s - arc[i - 1] < arc[i] - s)
+		return i - 1;
+	return i;
+}
+
+/**====================================================
+* Function to find the closest point of the path to a point. Only the
+* segments between the arc lengths sFrom and sTo are considered, so a path
+* crossing itself does not make the projection jump.
+* Input: Trajectory id, point, arc length window, arc length and distance (output)
+* Output: bool (0 if there is no segment in the window)
+*======================================================*/
+bool TrajectoryLibrary::project(int id, double u, double v, double sFrom, double sTo, double& s, double& distance)
+{
+	int n;
+	const float* p = getPath(id, n);
+	const float* arc = getArcLength(id);
+	if (n < 2)
+		return false;
+	const Trajectory& trajectory = trajectories[id];
+
+	int col = (int)((u - trajectory.gridU) / gridCellSize);
+	int row = (int)((v - trajectory.gridV) / gridCellSize);
+	col = min(max(col, 0), trajectory.gridCols - 1);
+	row = min(max(row, 0), trajectory.gridRows - 1);
+	int maxRing = max(trajectory.gridCols, trajectory.gridRows);
+
+	double best = 1e300;
+	for (int ring = 0; ring <= maxRing; ring++)
+	{
+		for (int r = row - ring; r <= row + ring; r++)
+		{
+			if (r < 0 || r >= trajectory.gridRows)
+				continue;
+			for (int c = col - ring; c <= col + ring; c++)
+			{
+				if (c < 0 || c >= trajectory.gridCols)
+					continue;
+				if (abs(r - row) != ring && abs(c - col) != ring)
+					continue; // inner cells were searched already
+				int cell = r * trajectory.gridCols + c;
+				for (int k = trajectory.cellStart[cell]; k < trajectory.cellStart[cell + 1]; k++)
+				{
+					int i = trajectory.cellSegments[k];
+					if (arc[i] > sTo || arc[i + 1] < sFrom)
+						continue;
+					double du = p[2 * i + 2] - p[2 * i], dv = p[2 * i + 3] - p[2 * i + 1];
+					double length2 = du * du + dv * dv;
+					double t = (length2 > 0) ? ((u - p[2 * i]) * du + (v - p[2 * i + 1]) * dv) / length2 : 0.0;
+					t = min(max(t, 0.0), 1.0);
+					double d = hypot(u - p[2 * i] - t * du, v - p[2 * i + 1] - t * dv);
+					if (d < best)
+					{
+						best = d;
+						s = min(max(arc[i] + t * (arc[i + 1] - arc[i]), sFrom), sTo);
+					}
+				}
+			}
+		}
+		// Cells further out are at least ring cells away
+		if (best <= ring * gridCellSize)
+			break;
+	}
+
+	if (best == 1e300)
+		return false;
+	distance = best;
+	return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef TRAJECTORYLIBRARY_H
+#define TRAJECTORYLIBRARY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*	Note: Trajectory library
+*	Trajectories are read from a text file (trajectories.txt) and listed in file
+*	order, so the position in the file is the trajectory id. Coordinates are in
+*	pixels relative to the origin. Lines starting with # are ignored.
+*		origin <u> <v>						arena center, absolute pixels
+*		trajectory <name> <description...>	starts a trajectory
+*		move <u> <v>						start point (or a jump)
+*		line <u> <v>						straight line to the point
+*		arc <cu> <cv> <sweep deg>			arc around the center from the current point
+*		spline <u1> <v1> <u2> <v2> ...		Catmull-Rom spline through the points
+*		spiral <cu> <cv> <a> <b> <turns>	Archimedean spiral r = a + b * turns
+*		show								draw the path on the display
+*		end
+*		text <name> <string...>				a whole trajectory writing the string
+*	Compile() resamples every primitive by arc length at the step size (corners
+*	are kept) into one flat array of (u, v) pairs shared by all trajectories.
+*	Following a trajectory is then an index into that array. Each compiled path
+*	also gets a uniform grid (gridCellSize) of its segments, so project() only
+*	looks at the segments in the cells around the query point.
+*	AddText turns a string into one trajectory with the stroke font (StrokeFont.h):
+*	the strokes are ordered to minimize the travel between them and joined by
+*	straight lines. The result is cached per string.
+*/
+
+#define trajectoryFile "trajectories.txt"
+#define gridCellSize 16.0	// pixels
+
+class TrajectoryLibrary
+{
+public:
+	TrajectoryLibrary();
+
+	bool Load(const std::string& fileName = trajectoryFile);
+	void Compile(double stepsize);
+	double getStepsize() { return compiledStepsize; }
+
+	int size() { return (int)trajectories.size(); }
+	int find(const std::string& name);
+	int AddText(const std::string& text, const std::string& name = "");
+	const std::string& getName(int id) { return trajectories[id].name; }
+	const std::string& getDescription(int id) { return trajectories[id].description; }
+	bool isShown(int id) { return trajectories[id].show; }
+
+	// Compiled path: n points, u at path[2i], v at path[2i + 1]
+	const float* getPath(int id, int& n);
+	// Arc length (pixels) from the start of the trajectory to every point
+	const float* getArcLength(int id);
+
+	// Point at an arc length along the path
+	void pointAt(int id, double s, double& u, double& v);
+	// Path sample closest to an arc length
+	int indexAt(int id, double s);
+	// Closest point of the path between arc lengths sFrom and sTo (grid index)
+	bool project(int id, double u, double v, double sFrom, double sTo, double& s, double& distance);
+
+private:
+	struct Primitive
+	{
+		int type;
+		std::vector<double> args;
+	};
+
+	struct Trajectory
+	{
+		std::string name;
+		std::string description;
+		bool show;
+		std::vector<Primitive> primitives;
+		size_t offset;	// first point in the compiled array
+		int count;
+
+		// Uniform grid over the compiled path: segments (point i to i + 1) per cell
+		double gridU, gridV;
+		int gridCols, gridRows;
+		std::vector<int> cellStart;	// gridCols * gridRows + 1
+		std::vector<int> cellSegments;
+	};
+
+	void tessellate(const Primitive& primitive, double& u, double& v, std::vector<double>& dense);
+	void resample(const std::vector<double>& dense, double stepsize);
+	void buildGrid(Trajectory& trajectory);
+
+	std::vector<Trajectory> trajectories;
+	std::map<std::string, int> textCache;	// text -> trajectory id
+	std::vector<float> points;
+	std::vector<float> arcLength;
+	double originU, originV;
+	double compiledStepsize;
+};
+
+extern thread_local TrajectoryLibrary MyTrajectories;
+
+#endif //TRAJECTORYLIBRARY_H
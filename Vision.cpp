@@ -5,17 +5,23 @@ Modified by: P. A. Diluka Harischandra
 */
 
 #include "Vision.h"
+#include "Trace.h"
+#include "Input.h"
+
+#include <algorithm>
  
 // Default constructor
-Vision::Vision() {}
+Vision::Vision() { source = NULL; windowActive = false; windowRefill = false; windowUnsupported = false; }
 
 /**====================================================
 * Overloaded constructor
-* Input: Image type, Display mode and recording frames 
-* per second
+* Input: Image type, Display mode, recording frames 
+* per second, camera index and file prefix
 *======================================================*/
-Vision::Vision(bool imgType, bool halfDisplay, double recording_fps) :cameraPosition("CameraPosition.log")
+Vision::Vision(bool imgType, bool halfDisplay, double recording_fps, int cameraIndex, const std::string &prefix) :cameraPosition(prefix + "CameraPosition.log")
 {
+	filePrefix = prefix;
+
 	// video variables
 	recordingVideoFPS = recording_fps;
 	isColor = imgType;
@@ -26,9 +32,20 @@ Vision::Vision(bool imgType, bool halfDisplay, double recording_fps) :cameraPosi
 	templateTracker = NULL;
 	dotTracker = NULL;
 	
-	camera = new vpFlyCaptureGrabber();		
-
-#ifdef usingOpenCVDisplay
+#if defined(usingCamera) && defined(VISP_HAVE_FLYCAPTURE)
+	source = new FlyCaptureSource(cameraIndex);
+#else
+	source = new SyntheticSource(recording_fps);
+#endif
+	frameTimestamp = 0;
+	windowActive = false;
+	windowRefill = false;
+	windowUnsupported = false;
+	windowLeft = windowTop = windowWidth = windowHeight = 0;
+
+#if defined(headless)
+	// no display
+#elif defined(usingOpenCVDisplay)
 	display = new vpDisplayOpenCV();
 	binaryDisplay = new vpDisplayOpenCV();
 #else
@@ -47,46 +64,44 @@ Vision::Vision(bool imgType, bool halfDisplay, double recording_fps) :cameraPosi
 
 /**====================================================
 * Function to initialize the vision module (open the camera and initialize the display)
-* Input: size of the image
+* Input: size of the image, window title
 * Output: NULL
 *======================================================*/
 
-void Vision::Initialize(int width, int height)
+void Vision::Initialize(int width, int height, const std::string &title)
 {
-	std::cout << "Number of cameras detected: " << camera->getNumCameras() << std::endl;
-	camera->setCameraIndex(0);			// Selected the first camera
-	camera->getCameraInfo(std::cout);	// Display camera info
-	camera->setShutter(true);			// Turn auto shutter on
-	camera->setGain(true);				// Turn auto gain on
-	camera->setFormat7VideoMode(FlyCapture2::MODE_1, FlyCapture2::PIXEL_FORMAT_RAW8, width, height);
+	std::cout << "Frame source: " << source->getName() << std::endl;
 
 	// 0: gray scale image - 1: color image
 	if (isColor)
 	{
-		camera->open(colorImage);
+		source->open(colorImage, width, height);
 		if (useHalfDisplay)
-		{
 			colorImage.halfSizeImage(colorImageHalf);
-			display->init(colorImageHalf, 0, 0, "NegMag");
-		}
-		else
-		{
-			display->init(colorImage, 0, 0, "NegMag");
-		}
 	}
 	else
 	{
-		camera->open(grayImage);
+		source->open(grayImage, width, height);
 		if (useHalfDisplay)
-		{
 			grayImage.halfSizeImage(grayImageHalf);
-			display->init(grayImageHalf, 0, 0, "NegMag");
-		}
+	}
+
+#ifndef headless
+	if (isColor)
+	{
+		if (useHalfDisplay)
+			display->init(colorImageHalf, 0, 0, title);
 		else
-		{
-			display->init(grayImage, 0, 0, "NegMag");
-		}
+			display->init(colorImage, 0, 0, title);
 	}
+	else
+	{
+		if (useHalfDisplay)
+			display->init(grayImageHalf, 0, 0, title);
+		else
+			display->init(grayImage, 0, 0, title);
+	}
+#endif
 }
 
 /**====================================================
@@ -115,8 +130,16 @@ int Vision::getImageRows()
 *======================================================*/
 bool Vision::getClickedPosition(vpImagePoint* clickPos)
 {
+	TRACE_SCOPE("getClick");
 	bool userClicked = 0;
 	vpImagePoint tmp;
+#ifdef headless
+	double u, v;
+	userClicked = GetScriptedClick(u, v);
+	if (!userClicked)
+		return false;
+	tmp.set_uv(u, v);
+#else
 	if(isColor)
 	{
 		userClicked = vpDisplay::getClick(colorImage,tmp , false);
@@ -125,10 +148,12 @@ bool Vision::getClickedPosition(vpImagePoint* clickPos)
 	{
 		userClicked = vpDisplay::getClick(grayImage, tmp, false);
 	}
+#endif
 	*clickPos = tmp;
 	return userClicked;
 }
 
+#ifndef headless
 /**====================================================
 * Function to draw circles
 * Input: center point, color, fill status.
@@ -231,6 +256,7 @@ void Vision::drawCross(vpImagePoint center, vpColor color)
 		}
 	}
 }
+#endif // headless
 
 
 /**====================================================
@@ -242,7 +268,9 @@ void Vision::drawCross(vpImagePoint center, vpColor color)
 void Vision::InitializeBinary(int threshold)
 {
 	ConvertToBinary(threshold); 
+#ifndef headless
 	binaryDisplay->init(binaryImage, 0, 0, "Binary image");	// Init the display
+#endif
 }
 
 /**====================================================
@@ -254,21 +282,35 @@ void Vision::InitializeBinary(int threshold)
 void Vision::InitializeBinary2()
 {
 	vpImageConvert::convert(particleDetectorBinaryImageOpenCVSub, binaryImage2);
+#ifndef headless
 	binaryDisplay2->init(binaryImage, 0, 0, "Binary image 2");	// Init the display
+#endif
 }
 
 
 /**====================================================
-* Function to grab an image
-* Input: NULL
+* Function to replace the frame source (call before Initialize)
+* Input: Frame source, owned by Vision afterwards
 * Output: NULL
 *======================================================*/
+void Vision::SetFrameSource(FrameSource *frameSource)
+{
+	delete source;
+	source = frameSource;
+}
+
+/**====================================================
+* Function to grab an image
+* Input: 1 to grab the current frame again (FrameSource::regrab)
+* Output: bool (0 if the source has no frame, e.g. the end of a video file)
+*======================================================*/
 
-void Vision::AcquireImage()
+bool Vision::AcquireImage(bool again)
 {
 	if (isColor)
 	{
-		camera->acquire(colorImage);
+		if (!(again ? source->regrab(colorImage, frameTimestamp) : source->acquire(colorImage, frameTimestamp)))
+			return false;
 		if (useHalfDisplay)
 		{
 			colorImage.halfSizeImage(colorImageHalf);
@@ -276,12 +318,24 @@ void Vision::AcquireImage()
 	}
 	else
 	{
-		camera->acquire(grayImage);
+		if (!(again ? source->regrab(grayImage, frameTimestamp) : source->acquire(grayImage, frameTimestamp)))
+			return false;
 		if (useHalfDisplay)
 		{
 			grayImage.halfSizeImage(grayImageHalf);
 		}
 	}
+	return true;
+}
+
+/**====================================================
+* Function to get the timestamp of the last grabbed image
+* Input: NULL
+* Output: timestamp (ms)
+*======================================================*/
+double Vision::GetFrameTimestamp()
+{
+	return frameTimestamp;
 }
 
 /**====================================================
@@ -291,6 +345,23 @@ void Vision::AcquireImage()
 *======================================================*/
 void Vision::ConvertToBinary(int threshold)
 {
+	// With a sensor window only the window changes (full size image)
+	if (windowActive && !windowRefill && !useHalfDisplay)
+	{
+		for (int i = windowTop; i < windowTop + windowHeight; i++)
+			for (int j = windowLeft; j < windowLeft + windowWidth; j++)
+			{
+				if (isColor)
+				{
+					const vpRGBa &p = colorImage[i][j];
+					grayImage[i][j] = (unsigned char)(0.2126 * p.R + 0.7152 * p.G + 0.0722 * p.B);
+				}
+				binaryImage[i][j] = (grayImage[i][j] > threshold) ? 255 : 0;
+			}
+		return;
+	}
+	windowRefill = false;
+
 	if (isColor)
 	{
 		if (useHalfDisplay)
@@ -326,6 +397,92 @@ void Vision::ConvertToBinary(int threshold)
 	}
 }
 
+/**====================================================
+* Function to read only a window of the sensor around a point. The image keeps
+* its full size (the window is copied at its offset), so the tracker, the coil
+* tips and the display use the same coordinates.
+* A source that refuses a window is not asked again until ResetSensorWindow.
+* Input: center of the window, size (pixels)
+* Output: bool (1 if the source reads the window)
+*======================================================*/
+bool Vision::SetSensorWindow(const vpImagePoint &center, int size)
+{
+	if (windowUnsupported)
+		return false;
+	int cols = isColor ? (int)colorImage.getWidth() : (int)grayImage.getWidth();
+	int rows = isColor ? (int)colorImage.getHeight() : (int)grayImage.getHeight();
+	int width = std::min(size, cols);
+	int height = std::min(size, rows);
+	int left = std::max(0, std::min((int)(center.get_u() - width / 2.0 + 0.5), cols - width));
+	int top = std::max(0, std::min((int)(center.get_v() - height / 2.0 + 0.5), rows - height));
+
+	bool applied;
+	{
+		//Every change restarts the capture of the camera
+		PROFILE_STAGE(STAGE_WINDOW);
+		applied = source->setWindow(left, top, width, height);
+	}
+	if (!applied)
+	{
+		std::cout << "The " << source->getName() << " source cannot read a sensor window, using full frames" << std::endl;
+		windowActive = false;
+		windowUnsupported = true;
+		return false;
+	}
+	if (!windowActive || left != windowLeft || top != windowTop || width != windowWidth || height != windowHeight)
+		windowRefill = true;
+	windowLeft = left;
+	windowTop = top;
+	windowWidth = width;
+	windowHeight = height;
+	windowActive = true;
+	return true;
+}
+
+/**====================================================
+* Function to keep the particle in the sensor window. The window is centered
+* again only when the predicted position gets within the margin of its edge.
+* Input: predicted position, size and margin (pixels)
+* Output: bool (1 if the source reads a window)
+*======================================================*/
+bool Vision::FollowSensorWindow(const vpImagePoint &predicted, int size, int margin)
+{
+	if (windowActive
+		&& predicted.get_u() >= windowLeft + margin && predicted.get_u() < windowLeft + windowWidth - margin
+		&& predicted.get_v() >= windowTop + margin && predicted.get_v() < windowTop + windowHeight - margin)
+		return true;
+	TRACE_SCOPE("MoveSensorWindow");
+	return SetSensorWindow(predicted, size);
+}
+
+void Vision::ClearSensorWindow()
+{
+	if (!windowActive)
+		return;
+	{
+		PROFILE_STAGE(STAGE_WINDOW);
+		source->clearWindow();
+	}
+	windowActive = false;
+}
+
+/**====================================================
+* Function to close the sensor window and ask the source again next time
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void Vision::ResetSensorWindow()
+{
+	ClearSensorWindow();
+	windowUnsupported = false;
+}
+
+vpRect Vision::GetSensorWindow()
+{
+	return vpRect(windowLeft, windowTop, windowWidth, windowHeight);
+}
+
+#ifndef headless
 /**====================================================
 * Function to add the last grabbed image to the display
 * Input: NULL
@@ -416,6 +573,7 @@ void Vision::FlushBinary2()
 {
 	binaryDisplay2->flush(binaryImage2);
 }
+#endif // headless
 
 
 
@@ -427,6 +585,7 @@ void Vision::FlushBinary2()
 *======================================================*/
 int Vision::InitializeBlobTracking()
 {
+	TRACE_SCOPE("InitializeBlobTracking");
 	try{
 	dotTracker = NULL;
 	dotTracker = new vpDot();
@@ -436,6 +595,15 @@ int Vision::InitializeBlobTracking()
 	}
 
 	vpImagePoint tmp;
+#ifdef headless
+	double u, v;
+	if (!GetScriptedClick(u, v))
+	{
+		std::cout << "No scripted click to initialize the tracker" << std::endl;
+		return 0;
+	}
+	tmp.set_uv(u, v);
+#else
 	if (isColor)
 	{
 		vpDisplay::getClick(colorImage, tmp, true);
@@ -444,10 +612,13 @@ int Vision::InitializeBlobTracking()
 	{
 		vpDisplay::getClick(grayImage, tmp, true);
 	}
+#endif
 	
 	dotTracker->initTracking(binaryImage,tmp);
 
+#ifndef headless
 	dotTracker->setGraphics(true);
+#endif
 	}
 	catch (...)
 	{
@@ -473,7 +644,9 @@ int Vision::InitializeBlobTrackingViaIP(vpImagePoint &ip)
 
 		dotTracker->initTracking(binaryImage, ip);
 
+#ifndef headless
 		dotTracker->setGraphics(true);
+#endif
 	}
 	catch (...)
 	{
@@ -484,6 +657,98 @@ int Vision::InitializeBlobTrackingViaIP(vpImagePoint &ip)
 }
 
 
+/**====================================================
+* Function to initialize the tracking of several particles. With the display
+* every left click adds a particle and a right click ends, headless the next
+* maxCount scripted clicks are used.
+* Input: Maximum number of particles
+* Output: Number of tracked particles
+*======================================================*/
+int Vision::InitializeParticleTracking(int maxCount)
+{
+	TRACE_SCOPE("InitializeParticleTracking");
+	ClearParticleTrackers();
+
+	vpImagePoint tmp;
+	while (getParticleCount() < maxCount)
+	{
+#ifdef headless
+		double u, v;
+		if (!GetScriptedClick(u, v))
+			break;
+		tmp.set_uv(u, v);
+#else
+		vpMouseButton::vpMouseButtonType clickButton;
+		if (isColor)
+			vpDisplay::getClick(colorImage, tmp, clickButton, true);
+		else
+			vpDisplay::getClick(grayImage, tmp, clickButton, true);
+		if (clickButton != vpMouseButton::button1)
+			break;
+#endif
+		if (AddParticleTracker(tmp))
+			std::cout << "Particle " << getParticleCount() << " at " << tmp.get_u() << " " << tmp.get_v() << std::endl;
+	}
+	return getParticleCount();
+}
+
+/**====================================================
+* Function to add a particle tracker at a point of the binary image
+* Input: Image point
+* Output: 1 : Initialized, 0 :Cannot Initialize
+*======================================================*/
+int Vision::AddParticleTracker(vpImagePoint &ip)
+{
+	vpDot *tracker = new vpDot();
+	try {
+		tracker->initTracking(binaryImage, ip);
+#ifndef headless
+		tracker->setGraphics(true);
+#endif
+	}
+	catch (...)
+	{
+		std::cout << "Could not initialize tracker" << std::endl;
+		delete tracker;
+		return 0;
+	}
+	particleTrackers.push_back(tracker);
+	return 1;
+}
+
+void Vision::ClearParticleTrackers()
+{
+	for (size_t k = 0; k < particleTrackers.size(); k++)
+		delete particleTrackers[k];
+	particleTrackers.clear();
+}
+
+/**====================================================
+* Function to track all the particles
+* Input: NULL
+* Output: 1 : All tracking, 0 : At least one lost
+*======================================================*/
+int Vision::TrackParticles()
+{
+	for (size_t k = 0; k < particleTrackers.size(); k++)
+	{
+		try
+		{
+			particleTrackers[k]->track(binaryImage);
+		}
+		catch (...)
+		{
+			return 0;
+		}
+	}
+	return !particleTrackers.empty();
+}
+
+void Vision::GetParticleCoG(int particle, vpImagePoint &ip_Track)
+{
+	ip_Track = particleTrackers[particle]->getCog();
+}
+
 /**====================================================
 * Function to track the template in the current image
 * Input: NULL
@@ -532,6 +797,7 @@ int Vision::TrackBlob()
 	//dotTracker->track(grayImage);
 }
 
+#ifndef headless
 /**====================================================
 * Function to display the tracker in the image
 * Input: NULL
@@ -580,6 +846,34 @@ void Vision::DisplayBlobTracker()
 	}
 }
 
+/**====================================================
+* Function to display the particle trackers in the image
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void Vision::DisplayParticleTrackers()
+{
+	for (size_t k = 0; k < particleTrackers.size(); k++)
+	{
+		std::list<vpImagePoint> edges = particleTrackers[k]->getEdges();
+		vpImagePoint cog = particleTrackers[k]->getCog();
+		if (isColor)
+		{
+			if (useHalfDisplay)
+				particleTrackers[k]->display(colorImageHalf, cog, edges, vpColor::darkRed, 1);
+			else
+				particleTrackers[k]->display(colorImage, cog, edges, vpColor::darkRed, 1);
+		}
+		else
+		{
+			if (useHalfDisplay)
+				particleTrackers[k]->display(grayImageHalf, cog, edges, vpColor::red, 1);
+			else
+				particleTrackers[k]->display(grayImage, cog, edges, vpColor::red, 1);
+		}
+	}
+}
+
 /**====================================================
 * Function to display the tracker in the image
 * Input: NULL
@@ -591,6 +885,7 @@ void Vision::DisplayBlobTrackerBinary()
 	vpImagePoint cog = dotTracker->getCog();
 	dotTracker->display(binaryImage, cog, edges, vpColor::darkRed, 1);
 }
+#endif // headless
 
 /**====================================================
 * Function to fill the tracking center variable with the last tracked position
@@ -656,6 +951,7 @@ void Vision::FillHomographyVector(std::vector<double> &x_Vector, std::vector<dou
 	y_Vector.push_back(ip_Track.get_v());
 }
 
+#ifndef headless
 /**====================================================
 * Function to display a list of points
 * Input: vector containing the x coordinate, vector containing the y coordinates
@@ -1093,6 +1389,7 @@ void Vision::ShowClickedPositionBinary()
 	display->displayText(binaryImage, binaryClickPoint.get_v(), binaryClickPoint.get_u(), s, vpColor::red);
 	//std::cout << binaryClickPoint.get_u() << " " << binaryClickPoint.get_v() << std::endl;
 }
+#endif // headless
 
 
 
@@ -1103,6 +1400,7 @@ void Vision::ShowClickedPositionBinary()
 *======================================================*/
 void Vision::StartRecordingVideo()
 {
+	TRACE_SCOPE("StartRecordingVideo");
 	writer = new vpVideoWriter();
 	writer->setFramerate(recordingVideoFPS);
 	//writer->setCodec(CV_FOURCC('H', '2', '6', '4')); // MPEG-1 codec
@@ -1118,7 +1416,7 @@ void Vision::StartRecordingVideo()
 	strftime(opt_videoname, sizeof(opt_videoname), "%Y_%m_%d_%H_%M_%S.mp4", now);
 	//sprintf(opt_videoname, "video%04d.avi", num);
 	//std::string opt_videoname = "video-recorded.avi";
-	writer->setFileName(opt_videoname);
+	writer->setFileName(filePrefix + opt_videoname);
 
 	if (isColor)
 	{
@@ -8,6 +8,10 @@
 #define BinaryDebugDisplay
 #undef BinaryDebugDisplay
 
+// Headless build: no display, scripted keyboard and mouse (Input.h)
+#define headless
+#undef headless
+
 #include "opencv2/imgproc.hpp"
 // basic visp include
 #include <visp3/core/vpConfig.h>
@@ -15,20 +19,21 @@
 #include <visp3/core/vpHomogeneousMatrix.h>
 #include <visp3/core/vpIoTools.h>
 #include <visp3/core/vpMath.h>
+#include <visp3/core/vpDisplay.h>
+#ifndef headless
 #include <visp3/gui/vpDisplayGDI.h>
 #include <visp3/gui/vpDisplayOpenCV.h>
+#endif
 #include <visp3/io/vpImageIo.h>
 #include <visp3/core/vpImage.h>
 #include <visp3/io/vpParseArgv.h>
-#include <visp3\core\vpImageConvert.h>
-#include <visp3\blob\vpDot.h>
+#include <visp3/core/vpImageConvert.h>
+#include <visp3/blob/vpDot.h>
 
 #include <visp3/core/vpTime.h>
-#include <visp3/gui/vpDisplayX.h>
 #include <visp3/io/vpVideoWriter.h>
 
 //Includes for testing performance of Detection and tracking algorithms
-#include <visp3/gui/vpDisplayX.h>
 #include <visp3/imgproc/vpImgproc.h>
 #include <visp3/core/vpImageTools.h>
 #include <visp3/blob/vpDot2.h>
@@ -57,7 +62,7 @@
 
 
 // camera include
-#include <visp3/sensor/vpFlyCaptureGrabber.h>
+#include "FrameSource.h"
 
 
 #include <visp3/io/vpVideoWriter.h>
@@ -95,26 +100,28 @@ public:
 
 	// Constructor
 	Vision();
-	Vision(bool imgType, bool halfDisplay, double recording_fps);
+	Vision(bool imgType, bool halfDisplay, double recording_fps, int cameraIndex = 0, const std::string &prefix = "");
 
 	// Initialize function
-	void Initialize(int width, int height);
+	void Initialize(int width, int height, const std::string &title = "NegMag");
 	void InitializeBinary(int threshold);
 	void InitializeBinary2();
 //	void InitializeVideo(const std::string fileName);
 
 
-	// Acquisition and display function
-	void AcquireImage();
+	// Acquisition function
+	void SetFrameSource(FrameSource *frameSource);
+	bool AcquireImage(bool again = false);	// again: the same frame after the window changed
+	double GetFrameTimestamp();
 	void ConvertToBinary(int threshold);
 
-	void DisplayImage();
-	void DisplayBinary();
-	void DisplayBinary2();
-
-	void Flush();
-	void FlushBinary();
-	void FlushBinary2();
+	// Sensor window (ROI) around the particle, image coordinates unchanged
+	bool SetSensorWindow(const vpImagePoint &center, int size);
+	bool FollowSensorWindow(const vpImagePoint &predicted, int size, int margin);
+	void ClearSensorWindow();
+	void ResetSensorWindow();
+	bool isSensorWindowActive() { return windowActive; }
+	vpRect GetSensorWindow();
 
 	// Tracking function
 	int InitializeBlobTracking();
@@ -124,9 +131,13 @@ public:
 
 	int InitializeBlobTrackingViaIP(vpImagePoint &ip);
 
-	void DisplayTemplateTracker();
-	void DisplayBlobTracker();
-	void DisplayBlobTrackerBinary();
+	// Tracking of several particles (one vpDot each)
+	int InitializeParticleTracking(int maxCount);
+	int AddParticleTracker(vpImagePoint &ip);
+	void ClearParticleTrackers();
+	int TrackParticles();
+	int getParticleCount() { return (int)particleTrackers.size(); }
+	void GetParticleCoG(int particle, vpImagePoint &ip_Track);
 
 	void GetTemplateTrackerCoG(vpImagePoint &ip_Track);
 	void GetBlobTrackerCoG(vpImagePoint &ip_Track);
@@ -136,6 +147,38 @@ public:
 	// Homography function
 	void FillHomographyVector(std::vector<double> &x_Vector, std::vector<double> &y_Vector, vpImagePoint ip_Track);
 
+	// Recording function
+	void StartRecordingVideo();
+	void StartRecordingVideoBinary();
+
+	void AddFrameToVideo();
+	void AddFrameToVideoBinary();
+
+	void StopRecordingVideo();
+	void StopRecordingVideoBinary();
+
+	void TakeAScreenShot();
+	void TakeAScreenShotBinary();
+	
+	int getImageCols();
+	int getImageRows();
+	bool getClickedPosition(vpImagePoint *clickPos);
+
+#ifndef headless
+	// Display function
+	void DisplayImage();
+	void DisplayBinary();
+	void DisplayBinary2();
+
+	void Flush();
+	void FlushBinary();
+	void FlushBinary2();
+
+	void DisplayTemplateTracker();
+	void DisplayBlobTracker();
+	void DisplayBlobTrackerBinary();
+	void DisplayParticleTrackers();
+
 	// Utility function
 	void DisplayPointList(std::vector<double> uList, std::vector<double> vList, vpColor color);
 	void DisplayPointList(vpMatrix iMatrix, vpColor color);
@@ -149,40 +192,61 @@ public:
 	void DisplayArrow(vpImagePoint srcImagePoint, vpImagePoint destImagePoint, vpColor color);
 	void DisplayArrow(vpColVector srcVector, vpColVector destVector, vpColor color);
 
-	
-
 	void DisplayText(std::string txt);
 	void DisplayText(std::string txt, int x, int y, vpColor color);
 
 	void ShowClickedPosition();
 	void ShowClickedPositionBinary();
 
-	// Recording function
-	void StartRecordingVideo();
-	void StartRecordingVideoBinary();
-
-	void AddFrameToVideo();
-	void AddFrameToVideoBinary();
-
-	void StopRecordingVideo();
-	void StopRecordingVideoBinary();
-
-	void TakeAScreenShot();
-	void TakeAScreenShotBinary();
-	
-	int getImageCols();
-	int getImageRows();
-	bool getClickedPosition(vpImagePoint *clickPos);
 	void drawCircle(vpImagePoint center, vpColor color, bool fill);
-
 	void drawCircleWithRadius(vpImagePoint center, int radius, vpColor color, bool fill);
 	void drawCross(vpImagePoint center, vpColor color);
 	void drawRectangle(vpRect rect, vpColor color, bool fill);
+#else
+	// Display function (headless: no display, compiled out)
+	void DisplayImage() {}
+	void DisplayBinary() {}
+	void DisplayBinary2() {}
+
+	void Flush() {}
+	void FlushBinary() {}
+	void FlushBinary2() {}
+
+	void DisplayTemplateTracker() {}
+	void DisplayBlobTracker() {}
+	void DisplayBlobTrackerBinary() {}
+	void DisplayParticleTrackers() {}
+
+	void DisplayPointList(const std::vector<double> &, const std::vector<double> &, const vpColor &) {}
+	void DisplayPointList(const vpMatrix &, const vpColor &) {}
+
+	void DisplayPoint(double, double) {}
+	void DisplayPoint(const vpImagePoint &) {}
+	void DisplayPointBinary(double, double) {}
+	void DisplayPointBinary(const vpImagePoint &) {}
+
+	void DisplayArrow(const vpImagePoint &, const vpImagePoint &) {}
+	void DisplayArrow(const vpImagePoint &, const vpImagePoint &, const vpColor &) {}
+	void DisplayArrow(const vpColVector &, const vpColVector &, const vpColor &) {}
+
+	void DisplayText(const std::string &) {}
+	void DisplayText(const std::string &, int, int, const vpColor &) {}
+
+	void ShowClickedPosition() {}
+	void ShowClickedPositionBinary() {}
+
+	void drawCircle(const vpImagePoint &, const vpColor &, bool) {}
+	void drawCircleWithRadius(const vpImagePoint &, int, const vpColor &, bool) {}
+	void drawCross(const vpImagePoint &, const vpColor &) {}
+	void drawRectangle(const vpRect &, const vpColor &, bool) {}
+#endif
 
 	// Variables
-	vpFlyCaptureGrabber *camera;
+	FrameSource *source;
 
-#ifdef	usingOpenCVDisplay
+#if defined(headless)
+		// no display
+#elif defined(usingOpenCVDisplay)
 		vpDisplayOpenCV *binaryDisplay;
 		vpDisplayOpenCV *display;
 #else
@@ -195,6 +259,7 @@ public:
 	vpImagePoint binaryClickPoint;
 
 	vpDot *dotTracker;
+	std::vector<vpDot *> particleTrackers;
 
 private:
 	vpImage<unsigned char> grayImage;
@@ -225,9 +290,11 @@ private:
 
 	double videoFPS;
 	double recordingVideoFPS;
+	double frameTimestamp;
 
 
 	std::ofstream cameraPosition;
+	std::string filePrefix;	// prefix of the video and log files (rig name)
 
 	int minDetectRadius;
 	int	maxDetectRadius;
@@ -248,6 +315,12 @@ private:
 
 	bool white_foreground = false;
 
+	// Sensor window (SetSensorWindow), only this area changes between frames
+	bool windowActive;
+	bool windowRefill;		// the next binary image is converted whole
+	bool windowUnsupported;	// the source refused a window, full frames until ResetSensorWindow
+	int windowLeft, windowTop, windowWidth, windowHeight;
+
 	int num;
 };
 
@@ -6,124 +6,213 @@ Author: P. A. Diluka Harischandra
 
 #include "VisualServo.h"
 
-// State variables
-bool mode = 0; //1 auto 0 manual
-bool userReqStop = 0;
-bool stopCondition = 0;
-bool stopAllOperations = 0;
-bool recording = 0;
-bool trajectoryMode = 0;
-bool p2pMode = 0;
-bool oneCoilMode = 0;
-bool stepMode = 0;
-bool stepX = 1; //step direction: 1 for X, 0 for Y
-bool stepModeStarted = 0;
-bool trajectoryStarted = 0;
-bool p2pStarted = 0;
-bool programmableManipulationStarted = 0;
-bool offTime = 0;
-bool openLoopMode = 0;
-int skipMode = 0;
-bool keyboardInputEnabled = 1;
-bool DisplayVariables = 0;
-int trajectory_id = 0;
-bool firstRun = 0;
-bool startRecording = 0;
-bool stopRecording = 0;
-
-//Other variables
-double stepsize = 6.0;
-int nRepeats = 0;
-double positionErrorTolerance = 3.0;
 const int numberOfCoils = 8;
 const double degToRad = M_PI / 180.0;
 
-double MX = 470;
-double MY = 532;
+thread_local RigSession* currentRig = NULL;
+thread_local LoopClock* loopClock = NULL;
 
-//Set the desired fps here.
-float fps = 10.0;
-float frameLength = 1000 / fps;
-
-//Construct Vision Object
-Vision MyVision = Vision(true, false, fps);
-
-//Construct Controller Object
-Controller MyControl = Controller();
-
-//Log file
-ofstream outfile;
+//Set by Q on the rig with the keyboard, stops every rig of the process
+static std::atomic<bool> stopAllRigs(false);
 
 using namespace std;
 
-void VisionServoing()
+//Constructor
+RigSession::RigSession(const RigConfig& rigConfig) :
+	config(rigConfig),
+	filePrefix(rigConfig.name.empty() ? "" : rigConfig.name + "_"),
+	MyVision(true, false, fps, rigConfig.cameraIndex, filePrefix),
+	MyControl(rigConfig.doChannel),
+	MyScheduler(&MyClock, fps, overrunPolicy)
+{
+}
+
+/**====================================================
+* Function to run the rig on the calling thread until it is stopped
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void RigSession::run()
 {
+	currentRig = this;
+	loopClock = &MyClock;
+	if (config.core >= 0 && !PinThread(config.core))
+		cout << "Could not pin rig " << config.name << " to core " << config.core << endl;
+	if (config.input)
+		ClaimInput();
 
 	vpImagePoint clickedTarget;
 	vpImagePoint cmdPosition;
 	vpImagePoint cog, prevCog;
 
-	std::cout << "Initializing camera" << endl;
-	MyVision.Initialize(1024, 1024);
-	std::cout << "Initialized camera" << endl;
-
 	uInt8 activationCoil;
 
 	//Coil position configuration
 	vpImagePoint coilTip[numberOfCoils];
 
-	coilTip[0].set_u(621);
-	coilTip[0].set_v(355);
-	coilTip[1].set_u(705);
-	coilTip[1].set_v(513);
-	coilTip[2].set_u(625);
-	coilTip[2].set_v(693);
-	coilTip[3].set_u(441);
-	coilTip[3].set_v(763);
-	coilTip[4].set_u(293);
-	coilTip[4].set_v(682);
-	coilTip[5].set_u(222);
-	coilTip[5].set_v(507);
-	coilTip[6].set_u(297);
-	coilTip[6].set_v(360);
-	coilTip[7].set_u(485);
-	coilTip[7].set_v(281);
+	for (int i = 0; i < numberOfCoils; i++)
+	{
+		coilTip[i].set_u(coilTipPixels[i][0]);
+		coilTip[i].set_v(coilTipPixels[i][1]);
+	}
+
+	//Fitted force model, replaces the default gains
+	loadForceModel(config.forceModel);
+	MyEstimator.anchor();
+
+#ifndef usingCamera
+	//Simulated rig: the synthetic camera renders the simulated particle
+	SyntheticSource* syntheticCamera = new SyntheticSource(fps);
+	MySimulator.Initialize(coilTip, vpImagePoint(MY, MX));
+	for (int k = 1; k < simulatedParticles; k++)
+		MySimulator.addParticle(vpImagePoint(MY + 80 * sin(2 * M_PI * k / simulatedParticles), MX + 80 * cos(2 * M_PI * k / simulatedParticles)));
+	syntheticCamera->setMotion(&MySimulator);
+	MyVision.SetFrameSource(syntheticCamera);
+	MyControl.useSimulator(&MySimulator);
+#endif
+
+	std::cout << "Initializing camera" << endl;
+	MyVision.Initialize(1024, 1024, config.name.empty() ? "NegMag" : "NegMag " + config.name);
+	std::cout << "Initialized camera" << endl;
 
 	std::cout << "Initializing DAQ" << endl;
+	if (waveformOutput)
+		MyControl.useWaveform();
 	MyControl.initDAQ();
 	std::cout << "Initialized DAQ" << endl;
 
-	chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
-	chrono::high_resolution_clock::time_point currentTime = chrono::high_resolution_clock::now();
-	MyVision.AcquireImage();
+	if (MyTrajectories.Load())
+		MyTrajectories.Compile(stepsize);
+	MyExperiments.Load();
+
+	long long startTime = loopClock->now();
+	if (!MyVision.AcquireImage())
+	{
+		cout << "No frame from the " << MyVision.source->getName() << " source" << endl;
+		shutdown();
+		return;
+	}
 
 #ifdef BinaryDebugDisplay
 	MyVision.InitializeBinary(128);
 #endif
 
+	if (config.input)
+	{
+#ifdef headless
+		LoadInputScript(inputScriptFile);
+#endif
+		StartInputThread();
+	}
+	if (commandServerEnabled)
+		MyCommandServer.start(config.name.empty() ? commandSocketPath : config.name + ".sock");
+	long long commandTicks = 0; //reception of the oldest command not yet actuated
+	if (telemetryEnabled)
+		MyTelemetry.open(config.name.empty() ? telemetryName : telemetryName "_" + config.name);
+	bool tracked = 0;
+
+	if (traceTimeline)
+		MyTrace.enable();
+	if (perfCountersEnabled)
+		MyPerfCounters.open();
+
+	MyScheduler.start();
+	if (watchdogEnabled)
+		MyWatchdog.start(&MyControl, max(watchdogDeadline, 2.0 * frameLength), config.name);
+	long long prevFrameTime = 0;
+
 	while (true) 
 	{
-		chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
-		auto duration = chrono::duration_cast<chrono::microseconds>(t1 - startTime).count();
+		long long t1 = MyScheduler.beginFrame();
+		MyWatchdog.beat();
+		long long duration = t1 - startTime;
+		long long frameTicks = StageProfiler::now();
+		NextInputFrame();
+		ApplyRemoteCommands(cmdPosition, commandTicks);
 
-		MyVision.AcquireImage();
-		MyVision.ConvertToBinary(128);
+		bool acquired;
+		{
+			PROFILE_STAGE(STAGE_ACQUIRE);
+			acquired = MyVision.AcquireImage();
+		}
+		if (!acquired)
+		{
+			cout << "No frame from the " << MyVision.source->getName() << " source" << endl;
+			shutdown();
+			break;
+		}
+		{
+			PERF_STAGE(STAGE_THRESHOLD);
+			PROFILE_STAGE(STAGE_THRESHOLD);
+			MyVision.ConvertToBinary(128);
+		}
 
-		if (recording)
+		if (recording && !MyScheduler.skipRecording())
+		{
+			PROFILE_STAGE(STAGE_RECORDING);
 			MyVision.AddFrameToVideo(); //Add the frame to video
+		}
 
-		MyVision.DisplayImage();
+		if (!MyScheduler.skipDisplay())
+		{
+			PERF_STAGE(STAGE_DISPLAY);
+			PROFILE_STAGE(STAGE_DISPLAY);
+			MyVision.DisplayImage();
+		}
 
 #ifdef BinaryDebugDisplay
 		MyVision.DisplayBinary();
 #endif
-		if (mode == Automatic)
+		if (mode == Automatic && multiParticleMode)
+		{
+			MyVision.DisplayText("Multi Particle Mode", 15, 40, vpColor::darkRed);
+			{
+				PERF_STAGE(STAGE_TRACKING);
+				PROFILE_STAGE(STAGE_TRACKING);
+				tracked = MyVision.TrackParticles();
+			}
+			if (tracked)
+			{
+				activationCoil = multiParticleControl(cog, cmdPosition);
+			}
+			else
+			{
+				cout << "Could not track all the particles. Switching to manual mode." << endl;
+				activationCoil = 0;
+				stopAllOperations = 1;
+				mode = !Automatic;
+			}
+
+			//Write to log file (first particle)
+			if (recording)
+				outfile << duration << "," << cmdPosition.get_u() << "," << cmdPosition.get_v() << "," << cog.get_u() << "," << cog.get_v() << "," << (int)activationCoil << endl;
+		}
+		else if (mode == Automatic)
 		{
 			MyVision.DisplayText("Automatic Mode", 15, 40, vpColor::darkRed);
 			//Track the blob
-			if (MyVision.TrackBlob())
+			{
+				PERF_STAGE(STAGE_TRACKING);
+				PROFILE_STAGE(STAGE_TRACKING);
+				tracked = MyVision.TrackBlob();
+			}
+			if (!tracked && MyVision.isSensorWindowActive())
+			{
+				//Lost in the sensor window: look again in a full frame (same instant in simulation)
+				TRACE_SCOPE("FullFrameRegrab");
+				followSensorWindow(cog, prevCog, false);
+				if (MyVision.AcquireImage(true))
+				{
+					MyVision.ConvertToBinary(128);
+					tracked = MyVision.TrackBlob();
+				}
+			}
+			if (tracked)
 			{
 				MyVision.GetBlobTrackerCoG(cog);
+				//The mask written in the last frame moved the particle from prevCog to cog
+				if (modelAdaptation)
+					MyEstimator.update(cog.get_u(), cog.get_v(), prevCog.get_u(), prevCog.get_v(), (t1 - prevFrameTime) / 1e6, activationCoil);
 			}
 			else
 			{
@@ -141,10 +230,10 @@ void VisionServoing()
 
 			if (trajectoryMode)
 			{
-				if (trajectory_id == ID_CIRCLE)
-					cmdPosition = circularTrajectory(cog);
-				else if (trajectory_id == ID_SPIRAL)
-					cmdPosition = spiralTrajectory(cog);
+				if (timedTracking)
+					cmdPosition = timedTrajectory(cog);
+				else if (purePursuit)
+					cmdPosition = purePursuitTrajectory(cog);
 				else
 					cmdPosition = trajectory(cog);
 			}
@@ -160,13 +249,21 @@ void VisionServoing()
 			else if (MyVision.getClickedPosition(&clickedTarget) && !trajectoryMode && !p2pMode) //Get clicked position from mouse click
 			{
 				cmdPosition = clickedTarget;
+				remoteWaypoints.clear();
+				remoteWaypointIndex = 0;
+			}
+			else if (!remoteWaypoints.empty() && !trajectoryMode && !p2pMode)
+			{
+				cmdPosition = remoteWaypointTarget(cog);
 			}
 
+#ifndef headless
 			//Display target position
 			std::stringstream ss2;
 			ss2 << "Tx" << cmdPosition.get_u() << " " << "Ty" << cmdPosition.get_v() << endl;
 			MyVision.DisplayText(ss2.str());
 			ss2.str("");
+#endif
 
 			//Draw target
 			MyVision.drawCross(cmdPosition, vpColor::yellow);
@@ -178,12 +275,8 @@ void VisionServoing()
 			}
 			else
 			{
-				//Run experiments
-				openLoopInfinityExp(cog, activationCoil, coilTip, cmdPosition);
-				//openLoopDifferentDistancesExp(cog, activationCoil, coilTip, cmdPosition);
-				//openLoopDifferentVoltageExp(cog, activationCoil, coilTip, cmdPosition);
-				//openLoopDifferentCombinationsExp(cog, activationCoil, coilTip, cmdPosition);
-				//closedLoopPosititioningExp(cog, activationCoil, coilTip, cmdPosition);
+				//Run the selected experiment
+				runExperiment(cog, activationCoil, coilTip, cmdPosition);
 			}
 		}
 		else
@@ -194,13 +287,31 @@ void VisionServoing()
 				activationCoil = 0b10000000;
 		}
 
-		MyControl.writeToDAQ(activationCoil);
+		{
+			PROFILE_STAGE(STAGE_DAQ);
+			MyControl.writeToDAQ(activationCoil);
+		}
+		if (commandTicks)
+		{
+			MyProfiler.record(STAGE_COMMAND, StageProfiler::now() - commandTicks);
+			commandTicks = 0;
+		}
+		publishTelemetry(cog, prevCog, cmdPosition, activationCoil, tracked);
 		//Display coil status
 		displayCoilStatus(activationCoil, coilTip);
 
+		if (sensorWindowMode)
+			followSensorWindow(cog, prevCog, tracked && mode == Automatic && !multiParticleMode);
+
 		prevCog = cog;
+		prevFrameTime = t1;
 
-		MyVision.Flush();
+		if (!MyScheduler.skipDisplay())
+		{
+			PERF_STAGE(STAGE_FLUSH);
+			PROFILE_STAGE(STAGE_FLUSH);
+			MyVision.Flush();
+		}
 
 #ifdef BinaryDebugDisplay
 		MyVision.FlushBinary();
@@ -208,9 +319,9 @@ void VisionServoing()
 
 		//Keyboard inputs
 
-		if ((GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState('K') & 0x8000))
+		if (KeyPressed('K', KEY_CONTROL))
 		{
-			while (GetKeyState('K') & 0x8000);//wait for unpress
+			TRACE_INSTANT("Keyboard input toggle");
 			keyboardInputEnabled = !keyboardInputEnabled;
 			if (keyboardInputEnabled)
 				std::cout << "Keyboard Input Enabled" << endl;
@@ -221,15 +332,20 @@ void VisionServoing()
 		if (keyboardInputEnabled)
 		{
 			//Switch  Mode
-			if ((GetKeyState('M') & 0x8000))
+			if (KeyPressed('M'))
 			{
-				while (GetKeyState('M') & 0x8000); //wait for unpress
+				TRACE_INSTANT("Mode switch");
+				if (multiParticleMode)
+				{
+					MyMultiParticle.stop();
+					multiParticleMode = 0;
+				}
 				mode = !mode;
 				if (mode == Automatic)
 				{
 					std::cout << "Initializing Tracking" << endl;
 					/* Initialize vpDot blob tracker*/
-					if (MyVision.InitializeBlobTracking())
+					if (StartTracking())
 					{
 						std::cout << "Initialized Tracking" << endl;
 						//Set command position to center
@@ -243,16 +359,53 @@ void VisionServoing()
 					}
 				}
 			}
+			//Switch multi particle mode
+			if (KeyPressed('B', KEY_CONTROL))
+			{
+				TRACE_INSTANT("Particle scheduling");
+				MyMultiParticle.mode = (MyMultiParticle.mode == SCHEDULE_JOINT) ? SCHEDULE_TIME_SLICE : SCHEDULE_JOINT;
+				if (MyMultiParticle.mode == SCHEDULE_JOINT)
+					cout << "Joint particle scheduling" << endl;
+				else
+					cout << "Time sliced particle scheduling" << endl;
+			}
+			else if (KeyPressed('B'))
+			{
+				TRACE_INSTANT("Multi particle mode");
+				if (!multiParticleMode)
+				{
+					if (StartParticleTracking())
+					{
+						multiParticleMode = 1;
+						mode = Automatic;
+						cout << "Multi Particle Mode: " << MyMultiParticle.getCount() << " particles, click the targets in turn" << endl;
+					}
+					else
+					{
+						cout << "Could not initialize particle tracking." << endl;
+					}
+				}
+				else
+				{
+					MyMultiParticle.stop();
+					multiParticleMode = 0;
+					stopAllOperations = 1;
+					mode = !Automatic;
+					cout << "Multi Particle Mode Off" << endl;
+				}
+			}
 			// Quit the program
-			if ((GetKeyState('Q') & 0x8000)) // Detect if a key was pressed
+			if (KeyPressed('Q')) // Detect if a key was pressed
 			{
-				while (GetKeyState('Q') & 0x8000);//wait for unpress
+				TRACE_INSTANT("Quit");
 				userReqStop = 1; // Quit the while()
+				if (config.input)
+					stopAllRigs = 1;
 			}
 			//Switch Trajectory Mode
-			if ((GetKeyState('T') & 0x8000)) // Detect if a key was pressed
+			if (KeyPressed('T')) // Detect if a key was pressed
 			{
-				while (GetKeyState('T') & 0x8000);//wait for unpress
+				TRACE_INSTANT("Trajectory mode");
 
 				if (!trajectoryMode)
 				{
@@ -272,31 +425,44 @@ void VisionServoing()
 			}
 
 			//Switch Open Loop mode
-			if ((GetKeyState('Y') & 0x8000)) // Detect if a key was pressed
+			if (KeyPressed('Y')) // Detect if a key was pressed
 			{
-				while (GetKeyState('Y') & 0x8000);//wait for unpress
+				TRACE_INSTANT("Open loop mode");
 
 				if (!openLoopMode)
 				{
-					nRepeats = 0;
-					cout << "Started Open Loop Control" << endl;
-					openLoopMode = 1; //open loop mode
+					if (startExperiment(experiment_id))
+					{
+						nRepeats = 0;
+						cout << "Started Open Loop Control" << endl;
+						openLoopMode = 1; //open loop mode
+					}
 				}
 				else
 				{
-					if (recording)
-					{
-						stopRecording = 1; // check if this causes any issues 11 26 2020
-					}
+					stopExperiment();
 					cout << "Stopped  Open Loop Control" << endl;
 					openLoopMode = 0;
 				}
 			}
 
+			//Change Experiment
+			if (KeyPressed('X')) // Detect if a key was pressed
+			{
+				TRACE_INSTANT("Experiment change");
+				if (!openLoopMode)
+				{
+					experiment_id = experiment_id + 1;
+					if (experiment_id >= MyExperiments.size() + MyScripts.size())
+						experiment_id = 0;
+					PrintExperimentID();
+				}
+			}
+
 			//Increase step size
-			if ((GetKeyState('H') & 0x8000)) // Detect if a key was pressed
+			if (KeyPressed('H')) // Detect if a key was pressed
 			{
-				while (GetKeyState('H') & 0x8000);//wait for unpress
+				TRACE_INSTANT("Step size");
 
 				stepsize = stepsize + 5.5;
 				if (stepsize == 55.0)
@@ -305,13 +471,12 @@ void VisionServoing()
 			}
 
 			//Switch One coil mode
-			if ((GetKeyState('W') & 0x8000)) // Detect if a key was pressed
+			if (KeyPressed('W')) // Detect if a key was pressed
 			{
-				while (GetKeyState('W') & 0x8000);//wait for unpress
+				TRACE_INSTANT("One coil mode");
 
 				if (!oneCoilMode)
 				{
-					Sleep(10); // Wait 10ms
 					startRecording = 1;
 					cout << "Started One coil mode" << endl;
 					oneCoilMode = 1; //trajectory mode
@@ -325,13 +490,12 @@ void VisionServoing()
 			}
 
 			//Switch Stepping Mode
-			if ((GetKeyState('S') & 0x8000)) // Detect if a key was pressed
+			if (KeyPressed('S')) // Detect if a key was pressed
 			{
-				while (GetKeyState('S') & 0x8000);//wait for unpress
+				TRACE_INSTANT("Stepping mode");
 
 				if (!stepMode)
 				{
-					Sleep(10);
 					startRecording = 1;
 					cout << "Started Stepping mode and  Recording" << endl;
 					stepMode = 1;
@@ -345,9 +509,9 @@ void VisionServoing()
 				}
 			}
 			//Switch Recording Mode
-			if ((GetKeyState('R') & 0x8000)) // Detect if a key was pressed
+			if (KeyPressed('R')) // Detect if a key was pressed
 			{
-				while (GetKeyState('R') & 0x8000);//wait for unpress
+				TRACE_INSTANT("Recording toggle");
 				if (!recording)
 				{
 					startRecording = 1;
@@ -357,26 +521,100 @@ void VisionServoing()
 					stopRecording = 1;
 				}
 			}
-			//Skip mode
-			if ((GetKeyState('Z') & 0x8000)) // Detect if a key was pressed
+			//Pure pursuit mode
+			if (KeyPressed('Z')) // Detect if a key was pressed
+			{
+				TRACE_INSTANT("Pure pursuit");
+				purePursuit = !purePursuit;
+				trajectoryStarted = 0;
+				if (purePursuit)
+					cout << "Pure Pursuit On" << endl;
+				else
+					cout << "Pure Pursuit Off" << endl;
+			}
+
+			//Switch iterative learning control
+			if (KeyPressed('N')) // Detect if a key was pressed
+			{
+				TRACE_INSTANT("Learning control");
+				learningControl = !learningControl;
+				MyLearning.reset();
+				if (learningControl)
+					cout << "Iterative Learning Control On" << endl;
+				else
+					cout << "Iterative Learning Control Off" << endl;
+			}
+
+			//Switch online force model estimation
+			if (KeyPressed('A')) // Detect if a key was pressed
 			{
-				while (GetKeyState('Z') & 0x8000);//wait for unpress
-				skipMode++;
-				cout << "Skip Mode On, Skips: " << skipMode << endl;
-				if (skipMode == 3)
+				TRACE_INSTANT("Model adaptation");
+				modelAdaptation = !modelAdaptation;
+				if (modelAdaptation)
+				{
+					MyEstimator.reset();
+					cout << "Force Model Adaptation On" << endl;
+				}
+				else
 				{
-					skipMode = 0;
-					cout << "Skip Mode Off" << endl;
+					MyEstimator.print();
+					cout << "Force Model Adaptation Off" << endl;
 				}
 			}
 
+			//Switch the sensor window, the source is asked again if it refused one
+			if (KeyPressed('F')) // Detect if a key was pressed
+			{
+				TRACE_INSTANT("Sensor window");
+				sensorWindowMode = !sensorWindowMode;
+				followSensorWindow(cog, prevCog, false);
+				MyVision.ResetSensorWindow();
+				cout << (sensorWindowMode ? "Sensor Window Mode On" : "Sensor Window Mode Off") << endl;
+			}
+
+			//Switch time parameterized tracking
+			if (KeyPressed('G')) // Detect if a key was pressed
+			{
+				TRACE_INSTANT("Timed tracking");
+				timedTracking = !timedTracking;
+				trajectoryStarted = 0;
+				if (timedTracking)
+					cout << "Timed tracking at " << trackingSpeed << "mm/s" << endl;
+				else
+					cout << "Point by point tracking" << endl;
+			}
+
+			//Change tracking speed
+			if (KeyPressed('J')) // Detect if a key was pressed
+			{
+				TRACE_INSTANT("Tracking speed");
+				trackingSpeed = trackingSpeed * 2;
+				if (trackingSpeed > 4.0)
+					trackingSpeed = 0.25;
+				cout << "Tracking speed = " << trackingSpeed << "mm/s" << endl;
+			}
+
+			//Print stage latencies
+			if (KeyPressed('L')) // Detect if a key was pressed
+			{
+				TRACE_INSTANT("Latency report");
+				MyProfiler.PrintLatencyReport();
+			}
+
 			//Change Trajectory
-			if ((GetKeyState('V') & 0x8000)) // Detect if a key was pressed
+			if (KeyPressed('V')) // Detect if a key was pressed
 			{
-				while (GetKeyState('V') & 0x8000);//wait for unpress
-				trajectory_id = trajectory_id + 1;
-				if (trajectory_id == nID)
-					trajectory_id = 0;
+				TRACE_INSTANT("Trajectory change");
+				int n;
+				for (int tries = 0; tries < MyTrajectories.size(); tries++) //skip the empty (unused) ids
+				{
+					trajectory_id = trajectory_id + 1;
+					if (trajectory_id >= MyTrajectories.size())
+						trajectory_id = 0;
+					MyTrajectories.getPath(trajectory_id, n);
+					if (n > 0)
+						break;
+				}
 
 				PrintTrajectoryID();
 
@@ -385,8 +623,9 @@ void VisionServoing()
 		}
 		if (startRecording)
 		{
+			TRACE_SCOPE("Start recording");
 			MyVision.StartRecordingVideo();
-			startTime = chrono::high_resolution_clock::now();
+			startTime = loopClock->now();
 			startLogging();
 			recording = 1;
 			cout << "Started Recording" << endl;
@@ -394,6 +633,7 @@ void VisionServoing()
 		}
 		if (stopRecording)
 		{
+			TRACE_SCOPE("Stop recording");
 			MyVision.StopRecordingVideo();
 			stopLogging();
 			recording = 0;
@@ -401,35 +641,16 @@ void VisionServoing()
 			stopRecording = 0;
 		}
 
-		chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
-
-		auto frameDuration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
+		MyProfiler.record(STAGE_FRAME, frameTicks, StageProfiler::now());
 
+		//Wait for the frame deadline (returns immediately on virtual time)
+		MyScheduler.endFrame();
 
-		while (frameDuration < frameLength)
-		{
-			chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
-			frameDuration = chrono::duration_cast<chrono::milliseconds>(t2 - t1).count();
-		}
-
-		if (frameDuration > frameLength)
-		{
-			cout << "Unable to record at " << fps << " FPS" << endl;
-			cout << "FPS: " << 1000.0 / ((float)frameDuration) << endl;
-			cout << "Check USB port version: 3.0 or 2.0? /n Try Grayscale" << endl;
-		}
-
-		stopCondition = userReqStop;
+		stopCondition = userReqStop || stopAllRigs;
 
 		if (stopCondition)
 		{
-			cout << "Exiting the program" << endl;
-			MyControl.writeToDAQ(0b00000000);
-			Sleep(500);
-			cout << "All outputs Low" << endl;
-			MyControl.stopDAQ();
-			cout << "DAQ Shutdown" << endl;
-			Sleep(500);
+			shutdown();
 			break;
 		}
 
@@ -443,6 +664,13 @@ void VisionServoing()
 			trajectoryMode = 0;
 			oneCoilMode = 0;
 			stepMode = 0;
+			MyControl.releaseSchedule(1);
+			actuation.id = -1;
+			if (multiParticleMode && mode != Automatic)
+			{
+				MyMultiParticle.stop();
+				multiParticleMode = 0;
+			}
 			stopAllOperations = 0;
 		}
 
@@ -452,369 +680,441 @@ void VisionServoing()
 
 
 /**====================================================
-* Function to print trajectory id to console.
-* Input: COG of the object
-* Output: Null
+* Function to turn the coils off, stop the DAQ and the loop services and print
+* the reports of the rig
+* Input: NULL
+* Output: NULL
 *======================================================*/
-void PrintTrajectoryID()
+void RigSession::shutdown()
 {
-	if (trajectory_id == ID_V)
-	{
-		cout << "Draw Verticle Lines" << endl;
-	}
-	else if (trajectory_id == ID_VO)
-	{
-		cout << "Draw Opposite Verticle Lines" << endl;
-	}
-	else if (trajectory_id == ID_H)
-	{
-		cout << "Draw Horizontal Lines" << endl;
-	}
-	else if (trajectory_id == ID_HO)
-	{
-		cout << "Draw Opposite Horizontal Lines" << endl;
-	}
-	else if (trajectory_id == ID_A)
-	{
-		cout << "Draw Letter A" << endl;
-	}
-	else if (trajectory_id == ID_U)
-	{
-		cout << "Draw Letter U" << endl;
-	}
-	else if (trajectory_id == ID_S)
-	{
-		cout << "Draw Letter S" << endl;
-	}
-	else if (trajectory_id == ID_e)
-	{
-		cout << "Draw Letter e" << endl;
-	}
-	else if (trajectory_id == ID_d)
-	{
-		cout << "Draw Letter d" << endl;
-	}
-	else if (trajectory_id == ID_O)
-	{
-		cout << "Draw Letter O" << endl;
-	}
-	else if (trajectory_id == ID_I)
-	{
-		cout << "Draw Letter I" << endl;
-	}
-
-	else if (trajectory_id == ID_L)
-	{
-		cout << "Draw Letter L" << endl;
-	}
-	else if (trajectory_id == ID_T)
-	{
-		cout << "Draw Letter T" << endl;
-	}
-	else if (trajectory_id == ID_SQUARE)
-	{
-		cout << "Draw Square" << endl;
-	}
-	else if (trajectory_id == ID_CIRCLE)
-	{
-		cout << "Draw Circle" << endl;
-	}
-	else if (trajectory_id == ID_SPIRAL)
-	{
-		cout << "Draw Spiral" << endl;
-	}
-
+	cout << "Exiting the program" << endl;
+	MyWatchdog.stop();
+	MyControl.writeToDAQ(0b00000000);
+	SleepMs(500);
+	cout << "All outputs Low" << endl;
+	MyControl.stopDAQ();
+	cout << "DAQ Shutdown" << endl;
+	if (!config.name.empty())
+		cout << "Rig " << config.name << ":" << endl;
+	MyScheduler.PrintReport();
+	if (watchdogEnabled)
+		MyWatchdog.PrintReport();
+	MyProfiler.PrintLatencyReport();
+	if (config.name.empty())
+		MyTrace.WriteChromeTrace();
+	else
+		MyTrace.WriteChromeTrace(filePrefix + "trace.json");
+	MyPerfCounters.PrintReport();
+	if (config.input)
+		StopInputThread();
+	MyCommandServer.stop();
+	MyTelemetry.close();
+	SleepMs(500);
 }
 
-
 /**====================================================
-* Function to control trajectory.
-* Input: COG of the object
-* Output: Null
+* Function to initialize the blob tracker. With the camera the particle is
+* clicked, in simulation the tracker starts at the simulated particle.
+* Input: NULL
+* Output: bool (1 if tracking)
 *======================================================*/
-vpImagePoint trajectory(vpImagePoint cog)
+bool RigSession::StartTracking()
 {
-	vpImagePoint positionCommand;
-	static int k;
-	static int j;
-	static std::vector<double> x;
-	static std::vector<double> y;
-
-	std::vector<double> vec_x;
-	std::vector<double> vec_y;
-	int xdiff = 0;
-	int ydiff = 0;
-	int steps;
-	float lineMagnitude = 0.0;
-
-	// 7-segmentish style coordinates
-	double	     MX = 470;
-	double       MY = 532;
-	double	     LX = MX - 60;
-	double       RX = MX + 60;
-
-	double HY = MY - 90;
-	double LY = MY + 90;
-
-
-	// Square coordinates
-	double S_LX = MX - 93;
-	double S_RX = MX + 93;
-	double S_HY = MY - 93;
-	double S_LY = MY + 93;
+#ifdef usingCamera
+	return MyVision.InitializeBlobTracking();
+#else
+	vpImagePoint simulatedParticle = MySimulator.getPosition();
+	return MyVision.InitializeBlobTrackingViaIP(simulatedParticle);
+#endif
+}
 
-	//Reset variables
-	if (!trajectoryStarted)
+/**====================================================
+* Function to initialize the tracking of several particles. With the camera the
+* particles are clicked, in simulation a tracker starts at every simulated
+* particle.
+* Input: NULL
+* Output: bool (1 if tracking)
+*======================================================*/
+bool RigSession::StartParticleTracking()
+{
+#ifdef usingCamera
+	MyVision.InitializeParticleTracking(maxParticles);
+#else
+	MyVision.ClearParticleTrackers();
+	for (int k = 0; k < MySimulator.getParticleCount() && k < maxParticles; k++)
 	{
-		k = 0;
-		j = 0;
-		trajectoryStarted = 1;
+		vpImagePoint simulatedParticle = MySimulator.getPosition(k);
+		MyVision.AddParticleTracker(simulatedParticle);
 	}
+#endif
+	int count = MyVision.getParticleCount();
+	if (count < 1)
+		return false;
 
-	//Initialization
-	if (!firstRun)
+	double u[maxParticles], v[maxParticles];
+	for (int k = 0; k < count; k++)
 	{
-		//By default draw letter A
-		x.assign({ LX,   LX,   RX,   RX,   RX,  LX }); //Ax 
-		y.assign({ LY,   HY,   HY,   LY,   MY,  MY }); //Ay
-
-		firstRun = 1;
+		vpImagePoint particle;
+		MyVision.GetParticleCoG(k, particle);
+		u[k] = particle.get_u();
+		v[k] = particle.get_v();
 	}
+	MyMultiParticle.start(count, u, v);
+	nextParticleTarget = 0;
+	return true;
+}
 
-
-	if (trajectory_id == ID_H)
+/**====================================================
+* Function to select the coil mask for all the tracked particles. Clicked
+* targets go to the particles in turn.
+* Input: COG and target of the first particle (set here)
+* Output: Coil mask
+*======================================================*/
+uInt8 RigSession::multiParticleControl(vpImagePoint& cog, vpImagePoint& cmdPosition)
+{
+	int count = MyMultiParticle.getCount();
+	double u[maxParticles], v[maxParticles];
+	for (int k = 0; k < count; k++)
 	{
-		x.assign({ S_LX,   S_RX });
-		y.assign({ MY,   MY });
+		vpImagePoint particle;
+		MyVision.GetParticleCoG(k, particle);
+		u[k] = particle.get_u();
+		v[k] = particle.get_v();
 	}
 
-	else if (trajectory_id == ID_HO)
-	{
-		x.assign({ S_RX, S_LX });
-		y.assign({ MY,   MY });
-	}
-	else if (trajectory_id == ID_A)
-	{
-		x.assign({ LX,   LX,   RX,   RX,   RX, LX }); //Ax 
-		y.assign({ LY,   HY,   HY,   LY,   MY, MY }); //Ay
-	}
-	else if (trajectory_id == ID_U)
-	{
-		x.assign({ LX,   LX,   RX,   RX });
-		y.assign({ HY,   LY,   LY,   HY });
-	}
-	else if (trajectory_id == ID_S)
-	{
-		x.assign({ RX,   LX,   LX,   RX,   RX, LX }); //Sx 
-		y.assign({ HY,   HY,   MY,   MY,   LY, LY }); //Sy
-	}
-	else if (trajectory_id == ID_O)
-	{
-		x.assign({ LX,   LX,   RX,   RX,   LX });
-		y.assign({ HY,   LY,   LY,   HY,   HY });
-	}
-	else if (trajectory_id == ID_e)
-	{
-		x.assign({ LX, RX, RX, LX, LX, RX });
-		y.assign({ MY, MY, HY, HY, LY, LY });
-	}
-	else if (trajectory_id == ID_d)
-	{
-		x.assign({ RX,   RX,   LX,   LX,   RX });
-		y.assign({ HY,   LY,   LY,   MY,   MY });
-	}
-	else if (trajectory_id == ID_I)
+	vpImagePoint clickedTarget;
+	if (MyVision.getClickedPosition(&clickedTarget))
 	{
-		x.assign({ RX,   RX });
-		y.assign({ HY,   LY });
+		MyMultiParticle.setTarget(nextParticleTarget, clickedTarget.get_u(), clickedTarget.get_v());
+		nextParticleTarget = (nextParticleTarget + 1) % count;
 	}
-	else if (trajectory_id == ID_V)
-	{
-		x.assign({ MX,   MX });
-		y.assign({ LY,   HY });
 
-	}
-	else if (trajectory_id == ID_VO)
+	uInt8 activationCoil;
 	{
-		x.assign({ MX,   MX });
-		y.assign({ HY,   LY });
+		PERF_STAGE(STAGE_SOLVER);
+		PROFILE_STAGE(STAGE_SOLVER);
+		activationCoil = MyMultiParticle.selectMask(u, v, frameLength / 1000.0, coilTipPixels);
 	}
 
-	else if (trajectory_id == ID_L)
-	{
-		x.assign({ LX,   LX,   RX });
-		y.assign({ HY,   LY,   LY });
-	}
-	else if (trajectory_id == ID_T)
-	{
-		x.assign({ LX,   RX,   MX,   MX });
-		y.assign({ HY,   HY,   HY,   LY });
-	}
-	else if (trajectory_id == ID_SQUARE)
+	MyVision.DisplayParticleTrackers();
+	for (int k = 0; k < count; k++)
 	{
-		x.assign({ S_LX,   S_RX,   S_RX,   S_LX, S_LX });
-		y.assign({ S_HY,	S_HY,	S_LY,	S_LY, S_HY });
+		double targetU, targetV;
+		MyMultiParticle.getTarget(k, targetU, targetV);
+		vpImagePoint particle(v[k], u[k]), target(targetV, targetU);
+		MyVision.drawCross(target, MyMultiParticle.isReached(k) ? vpColor::green : vpColor::yellow);
+		MyVision.DisplayArrow(particle, target, vpColor::lightGreen);
 	}
 
+	cog.set_uv(u[0], v[0]);
+	double targetU, targetV;
+	MyMultiParticle.getTarget(0, targetU, targetV);
+	cmdPosition.set_uv(targetU, targetV);
+	return activationCoil;
+}
 
-	//Go to starting point of the trajectory
-	if (k == 0)
+/**====================================================
+* Function to apply the queued command server commands (once per frame)
+* Input: Command position, reception time of the oldest unactuated command
+* Output: NULL
+*======================================================*/
+void RigSession::ApplyRemoteCommands(vpImagePoint& cmdPosition, long long& commandTicks)
+{
+	RemoteCommand command;
+	while (MyCommandServer.poll(command))
 	{
-		positionCommand.set_u(x[k]);
-		//cout << "Xcmd" << x[k] << endl;
-		positionCommand.set_v(y[k]);
-		if ((abs(x[k] - cog.get_u()) < positionErrorTolerance) && ((abs(y[k] - cog.get_v()) < positionErrorTolerance)))
-			k++;
+		if (!commandTicks)
+			commandTicks = command.ticks;
 
-	}
-	//Generate trajectory points and update the position command
-	if (k > 0 && k < x.size())
-	{
-		xdiff = (x[(long long)k - 1] - x[k]);
-		ydiff = (y[(long long)k - 1] - y[k]);
-		lineMagnitude = sqrt(xdiff * xdiff + ydiff * ydiff);
-		steps = int(lineMagnitude / stepsize);
-
-		vec_x = linspace(x[(long long)k - 1], x[k], steps);
-		vec_y = linspace(y[(long long)k - 1], y[k], steps);
-		positionCommand.set_u(vec_x.at(j));
-		positionCommand.set_v(vec_y.at(j));
-		//Increment the trajectory point if the minimum tolerance is met.
-		if ((abs(vec_x.at(j) - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y.at(j) - cog.get_v()) < positionErrorTolerance)))
-			j++;
-		else if (((j + 2) <= steps) && (skipMode == 1 || skipMode == 2))
+		switch (command.type)
 		{
-			if ((abs(vec_x.at((long long)j + 1) - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y.at((long long)j + 1) - cog.get_v()) < positionErrorTolerance)))
+		case CMD_SET_TARGET:
+			remoteWaypoints.clear();
+			remoteWaypointIndex = 0;
+			cmdPosition.set_u(command.points[0]);
+			cmdPosition.set_v(command.points[1]);
+			trajectoryMode = 0;
+			stepMode = 0;
+			p2pMode = 0;
+			break;
+
+		case CMD_WAYPOINTS:
+			if (!command.append)
 			{
-				j = j + 2;
-				cout << "skipped 1" << endl;
+				remoteWaypoints.clear();
+				remoteWaypointIndex = 0;
 			}
-		}
-		else if (((j + 3) <= steps) && skipMode == 2)
-		{
-			if ((abs(vec_x.at((long long)j + 2) - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y.at((long long)j + 2) - cog.get_v()) < positionErrorTolerance)))
+			if (multiParticleMode)
 			{
-				j = j + 3;
-				cout << "skipped 2" << endl;
+				//One target per particle
+				for (int i = 0; i < command.count && i < MyMultiParticle.getCount(); i++)
+					MyMultiParticle.setTarget(i, command.points[2 * i], command.points[2 * i + 1]);
+				break;
 			}
-		}
-		if (j == steps)
-		{
-			j = 0;
-			k++;
-		}
+			for (int i = 0; i < command.count; i++)
+				remoteWaypoints.push_back(vpImagePoint(command.points[2 * i + 1], command.points[2 * i]));
+			trajectoryMode = 0;
+			stepMode = 0;
+			p2pMode = 0;
+			break;
 
-	}
-
-	if (k == x.size())
-	{
-		k = 0;
-
-		nRepeats = nRepeats + 1;
-		cout << "Iteration No: " << nRepeats + 1 << endl;
+		case CMD_SET_MODE:
+			switch (command.id)
+			{
+			case REMOTE_MANUAL:
+				stopAllOperations = 1;
+				mode = !Automatic;
+				break;
+			case REMOTE_AUTOMATIC:
+				if (mode != Automatic)
+				{
+					if (StartTracking())
+						mode = Automatic;
+					else
+						cout << "Could not initialize tracking." << endl;
+				}
+				break;
+			case REMOTE_TRAJECTORY:
+				if (command.argument >= 0 && command.argument < MyTrajectories.size())
+				{
+					trajectory_id = command.argument;
+					PrintTrajectoryID();
+					nRepeats = 0;
+					if (!recording)
+						startRecording = 1;
+					trajectoryMode = 1;
+					trajectoryStarted = 0;
+				}
+				else if (trajectoryMode)
+				{
+					stopRecording = 1;
+					trajectoryMode = 0;
+				}
+				break;
+			case REMOTE_OPEN_LOOP:
+				nRepeats = 0;
+				if (command.argument > 0)
+				{
+					if (startExperiment(command.argument - 1))
+					{
+						experiment_id = command.argument - 1;
+						openLoopMode = 1;
+					}
+				}
+				else
+				{
+					stopExperiment();
+					openLoopMode = 0;
+				}
+				break;
+			case REMOTE_RECORDING:
+				if (command.argument && !recording)
+					startRecording = 1;
+				else if (!command.argument && recording)
+					stopRecording = 1;
+				break;
+			case REMOTE_STOP:
+				remoteWaypoints.clear();
+				remoteWaypointIndex = 0;
+				stopAllOperations = 1;
+				break;
+			case REMOTE_QUIT:
+				userReqStop = 1;
+				break;
+			}
+			break;
 
-		trajectoryStarted = 0;
+		case CMD_SET_PARAM:
+			if (command.id == PARAM_TRACKING_SPEED)
+			{
+				if (command.value > 0)
+					trackingSpeed = command.value;
+			}
+			else
+			{
+				setModelParameter(command.id, command.value);
+			}
+			break;
+		}
+		TRACE_INSTANT("Remote command");
 	}
+}
 
-	return positionCommand;
+/**====================================================
+* Function to follow the command server waypoints. Moves on to the next
+* waypoint once the particle is within the position tolerance, and holds the
+* last one.
+* Input: COG of the object
+* Output: Position command
+*======================================================*/
+vpImagePoint RigSession::remoteWaypointTarget(vpImagePoint cog)
+{
+	if (remoteWaypointIndex >= remoteWaypoints.size())
+		remoteWaypointIndex = remoteWaypoints.size() - 1;
+	if (vpImagePoint::distance(cog, remoteWaypoints[remoteWaypointIndex]) < positionErrorTolerance
+		&& remoteWaypointIndex + 1 < remoteWaypoints.size())
+		remoteWaypointIndex++;
+	return remoteWaypoints[remoteWaypointIndex];
+}
 
+/**====================================================
+* Function to move the sensor window to the predicted particle position (one
+* frame ahead at constant velocity), or to go back to the full frame when the
+* particle is not tracked. The frame rate follows the window.
+* Input: COG, COG of the previous frame, tracking status
+* Output: NULL
+*======================================================*/
+void RigSession::followSensorWindow(vpImagePoint cog, vpImagePoint prevCog, bool tracked)
+{
+	bool wasActive = MyVision.isSensorWindowActive();
+	if (tracked)
+	{
+		double du = cog.get_u() - prevCog.get_u();
+		double dv = cog.get_v() - prevCog.get_v();
+		//A jump (new particle, first frame) is not a velocity
+		if (abs(du) + abs(dv) > sensorWindowSize / 4)
+			du = dv = 0;
+		MyVision.FollowSensorWindow(vpImagePoint(cog.get_v() + dv, cog.get_u() + du), sensorWindowSize, sensorWindowSize / 4);
+		if (MyVision.isSensorWindowActive())
+			MyVision.drawRectangle(MyVision.GetSensorWindow(), vpColor::orange, false);
+	}
+	else
+		MyVision.ClearSensorWindow();
+
+	bool active = MyVision.isSensorWindowActive();
+	if (active == wasActive)
+		return;
+	double rate = active ? sensorWindowFps : fps;
+#ifdef usingCamera
+	//Simulated time follows the synthetic source, only the camera runs faster.
+	//The loop period follows the rate the camera accepted.
+	double applied;
+	{
+		PROFILE_STAGE(STAGE_WINDOW);
+		applied = MyVision.source->setFrameRate(rate);
+	}
+	if (applied > 0)
+		rate = applied;
+	MyScheduler.setPeriod(rate);
+#endif
+	cout << (active ? "Sensor window " : "Full frame") ;
+	if (active)
+		cout << sensorWindowSize << "x" << sensorWindowSize << " at " << rate << " fps";
+	cout << endl;
 }
 
+/**====================================================
+* Function to publish the state of the frame to the telemetry stream
+* Input: COG, COG of the previous frame, target, coil mask, tracking status
+* Output: NULL
+*======================================================*/
+void RigSession::publishTelemetry(vpImagePoint cog, vpImagePoint prevCog, vpImagePoint cmdPosition, uInt8 activationCoil, bool tracked)
+{
+	double& prevTimestamp = prevTelemetryTimestamp;
+
+	if (!MyTelemetry.isOpen())
+		return;
+
+	TelemetryFrame frame;
+	double timestamp = MyVision.GetFrameTimestamp();
+	double dt = (timestamp - prevTimestamp) / 1000.0;
+	prevTimestamp = timestamp;
+
+	frame.timestamp_ms = timestamp;
+	frame.cogU = (float)cog.get_u();
+	frame.cogV = (float)cog.get_v();
+	frame.velocityU = (dt > 0) ? (float)((cog.get_u() - prevCog.get_u()) / dt) : 0.0f;
+	frame.velocityV = (dt > 0) ? (float)((cog.get_v() - prevCog.get_v()) / dt) : 0.0f;
+	frame.targetU = (float)cmdPosition.get_u();
+	frame.targetV = (float)cmdPosition.get_v();
+	frame.coils = activationCoil;
+	frame.automatic = (mode == Automatic);
+	frame.recording = recording;
+	frame.tracked = (mode == Automatic) && tracked;
+	for (int i = 0; i < STAGE_LAST; i++)
+		frame.stageUs[i] = MyProfiler.getLast((Stage)i) / 1000.0f;
+
+	MyTelemetry.publish(frame);
+}
 
 /**====================================================
-* Function to perform circular trajectory.
+* Function to print trajectory id to console.
 * Input: COG of the object
 * Output: Null
 *======================================================*/
-vpImagePoint  circularTrajectory(vpImagePoint cog)
+void RigSession::PrintTrajectoryID()
 {
+	if (trajectory_id < MyTrajectories.size())
+		cout << MyTrajectories.getDescription(trajectory_id) << endl;
+}
 
-	vpImagePoint positionCommand;
-	static int k;
+/**====================================================
+* Function to print the selected experiment
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void RigSession::PrintExperimentID()
+{
+	if (experiment_id < MyExperiments.size())
+		cout << MyExperiments.getDescription(experiment_id) << " (" << MyExperiments.getTrials(experiment_id) << " trials)" << endl;
+	else if (experiment_id < MyExperiments.size() + MyScripts.size())
+		cout << MyScripts.getDescription(experiment_id - MyExperiments.size()) << endl;
+}
 
-	static std::vector<double> circtheta;
 
-	static std::vector<double> vec_x;
-	static std::vector<double> vec_y;
+/**====================================================
+* Function to control trajectory.
+* Input: COG of the object
+* Output: Null
+*======================================================*/
+vpImagePoint RigSession::trajectory(vpImagePoint cog)
+{
+	vpImagePoint positionCommand;
+	int& k = pointIndex;
 
-	//center coordinates
-	double	     MX = 470;
-	double       MY = 532;
+	//Recompile when the step size changed
+	if (MyTrajectories.getStepsize() != stepsize)
+		MyTrajectories.Compile(stepsize);
 
-	// circle spec
-	double startAngle = 0.0;
-	double endAngle = 2 * M_PI;
-	double radius = 93;
-	int steps = 94;
+	int n;
+	const float* path = MyTrajectories.getPath(trajectory_id, n);
+	const float* arc = MyTrajectories.getArcLength(trajectory_id);
+	if (n == 0)
+		return cog;
 
 	//Reset variables
-	if (!trajectoryStarted)
+	if (!trajectoryStarted || k >= n)
 	{
 		k = 0;
-		circtheta = linspace(startAngle, endAngle, steps);
-		vec_x = circtheta;//initialize
-		vec_y = circtheta;//initialize
-		for (int i = 0; i < circtheta.size(); i++)
-		{
-			vec_x.at(i) = MX + radius * sin(circtheta[i]);
-			vec_y.at(i) = MY + radius * cos(circtheta[i]);
-		}
-		cout << "Theta" << circtheta.at(59) << endl;
-
 		trajectoryStarted = 1;
 	}
 
-	//Initialization
-	if (!firstRun)
-	{
-		firstRun = 1;
-	}
-
-
+	if (MyTrajectories.isShown(trajectory_id))
+		for (int i = 0; i < n; i++)
+			MyVision.drawCross(vpImagePoint(path[2 * i + 1], path[2 * i]), vpColor::yellow);
 
-	//Go to starting point of the trajectory
-	if (k == 0)
-	{
-		positionCommand.set_u(vec_x[k]);
-		positionCommand.set_v(vec_y[k]);
-		if ((abs(vec_x[k] - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y[k] - cog.get_v()) < positionErrorTolerance)))
-			k++;
+	positionCommand.set_u(path[2 * k]);
+	positionCommand.set_v(path[2 * k + 1]);
 
-	}
+	//Cross-track error against the segment being followed
+	double s, error;
+	if (k > 0 && MyTrajectories.project(trajectory_id, cog.get_u(), cog.get_v(), arc[k - 1] - stepsize, arc[k] + stepsize, s, error))
+		addCrossTrackError(error);
 
-	//Follow the rest of the tracjectory
-	if (k > 0 && k < vec_x.size())
+	//Increment the trajectory point if the minimum tolerance is met.
+	if ((abs(path[2 * k] - cog.get_u()) < positionErrorTolerance) && (abs(path[2 * k + 1] - cog.get_v()) < positionErrorTolerance))
 	{
-		positionCommand.set_u(vec_x.at(k));
-		positionCommand.set_v(vec_y.at(k));
-		//Increment the trajectory point if the minimum tolerance is met.
-		if ((abs(vec_x.at(k) - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y.at(k) - cog.get_v()) < positionErrorTolerance)))
-			k++;
-
-		else if ((((long long)k + 2) <= vec_x.size()) && (skipMode == 1 || skipMode == 2))
-		{
-			if ((abs(vec_x.at((long long)k + 1) - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y.at((long long)k + 1) - cog.get_v()) < positionErrorTolerance)))
-			{
-				k = k + 2;
-				cout << "skipped 1" << endl;
-			}
-		}
-		else if ((((long long)k + 3) <= vec_x.size()) && skipMode == 2)
-		{
-			if ((abs(vec_x.at((long long)k + 2) - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y.at((long long)k + 2) - cog.get_v()) < positionErrorTolerance)))
-			{
-				k = k + 3;
-				cout << "skipped 2" << endl;
-			}
-		}
-
+		if (k == 0)
+			startTrajectoryCycle();
+		k++;
 	}
 
-	if (k == vec_x.size())
+	if (k == n)
 	{
 		k = 0;
 
 		nRepeats = nRepeats + 1;
+		reportTrajectoryCycle("Point by point");
 		cout << "Iteration No: " << nRepeats + 1 << endl;
 
 		trajectoryStarted = 0;
@@ -825,104 +1125,276 @@ vpImagePoint  circularTrajectory(vpImagePoint cog)
 }
 
 /**====================================================
-* Function to perform spiral trajectory.
+* Function to follow a trajectory with pure pursuit. The CoG is projected on
+* the path (near the previous projection, so crossings do not make it jump)
+* and the target is placed a lookahead distance further along the path. The
+* lookahead grows with the measured particle speed.
 * Input: COG of the object
-* Output: Null
+* Output: Position command
 *======================================================*/
-vpImagePoint  spiralTrajectory(vpImagePoint cog)
+vpImagePoint RigSession::purePursuitTrajectory(vpImagePoint cog)
 {
-	vpImagePoint positionCommand;
-	static int k;
-
-	static std::vector<double> spiraltheta;
+	double& s = pursuit.s;
+	double& speed = pursuit.speed;
+	bool& moving = pursuit.moving;
+	long long& lastTime = pursuit.lastTime;
+	vpImagePoint& lastCog = pursuit.lastCog;
 
-	static std::vector<double> vec_x;
-	static std::vector<double> vec_y;
+	//Recompile when the step size changed
+	if (MyTrajectories.getStepsize() != stepsize)
+		MyTrajectories.Compile(stepsize);
 
-	//center coordinates
-	double	     MX = 470;
-	double       MY = 532;
+	int n;
+	const float* path = MyTrajectories.getPath(trajectory_id, n);
+	const float* arc = MyTrajectories.getArcLength(trajectory_id);
+	if (n == 0)
+		return cog;
 
-	// circle spec
-	double r = 185;// outer radius
-	double a = 5;// inner radius
-	double b = 30;// incerement per rev
-	double n = (r - a) / (b);// number  of revolutions
-	double th = 2 * n * M_PI;// angle
-	int  steps = 200;
-	double startAngle = 0.0;
-	double endAngle = 2 * M_PI;
-	double radius = 90.0; //pixels
+	long long now = loopClock->now();
 
 	//Reset variables
 	if (!trajectoryStarted)
 	{
-		k = 0;
-		spiraltheta = linspace(startAngle, th, steps);
-		vec_x = spiraltheta;//initialize
-		vec_y = spiraltheta;//initialize
-		for (int i = 0; i < spiraltheta.size(); i++)
+		s = 0;
+		speed = 0;
+		moving = 0;
+		trajectoryStarted = 1;
+	}
+
+	if (MyTrajectories.isShown(trajectory_id))
+		for (int i = 0; i < n; i++)
+			MyVision.drawCross(vpImagePoint(path[2 * i + 1], path[2 * i]), vpColor::yellow);
+
+	//Go to starting point of the trajectory
+	if (!moving)
+	{
+		if ((abs(path[0] - cog.get_u()) < positionErrorTolerance) && (abs(path[1] - cog.get_v()) < positionErrorTolerance))
 		{
-			vec_x.at(i) = MX + (a + b * spiraltheta[i] / (2 * M_PI)) * cos(spiraltheta[i]);
-			vec_y.at(i) = MY + (a + b * spiraltheta[i] / (2 * M_PI)) * sin(spiraltheta[i]);
+			moving = 1;
+			lastTime = now;
+			lastCog = cog;
+			startTrajectoryCycle();
+			if (learningControl)
+				MyLearning.prepare(trajectory_id, n);
 		}
+		return vpImagePoint(path[1], path[0]);
+	}
 
-		trajectoryStarted = 1;
+	//Measured speed, low pass filtered
+	double dt = (now - lastTime) / 1e6;
+	if (dt > 0)
+		speed += 0.3 * (vpImagePoint::distance(cog, lastCog) / dt - speed);
+	lastTime = now;
+	lastCog = cog;
+	double lookahead = max(minLookahead, speed * lookaheadTime);
+
+	//Project the CoG, never moving backwards along the path
+	double projected, error;
+	if (MyTrajectories.project(trajectory_id, cog.get_u(), cog.get_v(), s - stepsize, s + 2 * lookahead + stepsize, projected, error))
+	{
+		s = max(s, projected);
+		addCrossTrackError(error);
+		if (learningControl)
+		{
+			double pu, pv;
+			MyTrajectories.pointAt(trajectory_id, projected, pu, pv);
+			MyLearning.record(MyTrajectories.indexAt(trajectory_id, projected), cog.get_u() - pu, cog.get_v() - pv);
+		}
 	}
-	//Initialization
-	if (!firstRun)
+
+	double length = arc[n - 1];
+	double u, v;
+	MyTrajectories.pointAt(trajectory_id, min(length, s + lookahead), u, v);
+
+	//Learned correction of the target sample
+	if (learningControl)
 	{
-		firstRun = 1;
+		double du, dv;
+		MyLearning.correction(MyTrajectories.indexAt(trajectory_id, min(length, s + lookahead)), du, dv);
+		u += du;
+		v += dv;
 	}
-	//Go to starting point of the trajectory
-	if (k == 0)
+
+	if (s >= length - positionErrorTolerance && (abs(path[2 * n - 2] - cog.get_u()) < positionErrorTolerance) && (abs(path[2 * n - 1] - cog.get_v()) < positionErrorTolerance))
 	{
-		positionCommand.set_u(vec_x[k]);
-		positionCommand.set_v(vec_y[k]);
-		if ((abs(vec_x[k] - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y[k] - cog.get_v()) < positionErrorTolerance)))
-			k++;
+		nRepeats = nRepeats + 1;
+		reportTrajectoryCycle("Pure pursuit");
+		if (learningControl)
+			MyLearning.endIteration();
+		cout << "Iteration No: " << nRepeats + 1 << endl;
+
+		trajectoryStarted = 0;
+	}
 
+	vpImagePoint positionCommand;
+	positionCommand.set_u(u);
+	positionCommand.set_v(v);
+	return positionCommand;
+}
+
+void RigSession::startTrajectoryCycle()
+{
+	trajectoryCycle.startTime = loopClock->now();
+	trajectoryCycle.sumSquaredError = 0;
+	trajectoryCycle.maxError = 0;
+	trajectoryCycle.samples = 0;
+}
+
+void RigSession::addCrossTrackError(double error)
+{
+	trajectoryCycle.sumSquaredError += error * error;
+	trajectoryCycle.maxError = max(trajectoryCycle.maxError, error);
+	trajectoryCycle.samples++;
+}
+
+/**====================================================
+* Function to print the cycle time and cross-track error of a completed shape
+* Input: Tracking mode name
+* Output: NULL
+*======================================================*/
+void RigSession::reportTrajectoryCycle(const char* trackingMode)
+{
+	double rms = trajectoryCycle.samples ? sqrt(trajectoryCycle.sumSquaredError / trajectoryCycle.samples) : 0.0;
+	cout << trackingMode << ": " << MyTrajectories.getDescription(trajectory_id) << " in "
+		<< (loopClock->now() - trajectoryCycle.startTime) / 1e6 << "s, cross-track error rms "
+		<< rms / mm2pix << "mm, max " << trajectoryCycle.maxError / mm2pix << "mm" << endl;
+}
 
+/**====================================================
+* Function to follow a trajectory with a reference moving at a set speed.
+* The reference accelerates to trackingSpeed at trackingAcceleration and
+* brakes to stop at the end of the path. It waits while the particle lags more
+* than maxTrackingLag. The solver target leads the reference along the path
+* direction by feedforwardTime.
+* Input: COG of the object
+* Output: Position command
+*======================================================*/
+vpImagePoint RigSession::timedTrajectory(vpImagePoint cog)
+{
+	int& j = timed.j;
+	double& s = timed.s;
+	double& speed = timed.speed;
+	bool& moving = timed.moving;
+	long long& lastTime = timed.lastTime;
+	double& sumLag = timed.sumLag;
+	double& maxLag = timed.maxLag;
+	long& lagSamples = timed.lagSamples;
+
+	//Recompile when the step size changed. The segment index is found again
+	//from the arc length (the number of points changes).
+	if (MyTrajectories.getStepsize() != stepsize)
+	{
+		MyTrajectories.Compile(stepsize);
+		j = 0;
 	}
 
-	for (int i = 0; i < steps; i++)
-		MyVision.drawCross(vpImagePoint(vec_y[i], vec_x[i]), vpColor::yellow);
+	int n;
+	const float* path = MyTrajectories.getPath(trajectory_id, n);
+	const float* arc = MyTrajectories.getArcLength(trajectory_id);
+	if (n == 0)
+		return cog;
+	if (n < 2)
+		return vpImagePoint(path[1], path[0]);
+	if (j > n - 2)
+		j = 0;
+	s = min(s, (double)arc[n - 1]);
+
+	long long now = loopClock->now();
 
-	//Follow the rest of the tracjectory
-	if (k > 0 && k < vec_x.size())
+	//Reset variables
+	if (!trajectoryStarted)
 	{
-		positionCommand.set_u(vec_x.at(k));
-		positionCommand.set_v(vec_y.at(k));
-		//Increment the trajectory point if the minimum tolerance is met.
-		if ((abs(vec_x.at(k) - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y.at(k) - cog.get_v()) < positionErrorTolerance)))
-			k++;
-		else if ((((long long)k + 2) <= vec_x.size()) && (skipMode == 1 || skipMode == 2))
-		{
-			if ((abs(vec_x.at((long long)k + 1) - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y.at((long long)k + 1) - cog.get_v()) < positionErrorTolerance)))
-			{
-				k = k + 2;
-				cout << "Skipped 1" << endl;
-			}
-		}
-		else if ((((long long)k + 3) <= vec_x.size()) && skipMode == 2)
+		j = 0;
+		s = 0;
+		speed = 0;
+		moving = 0;
+		sumLag = 0;
+		maxLag = 0;
+		lagSamples = 0;
+		trajectoryStarted = 1;
+	}
+
+	//Go to starting point of the trajectory
+	if (!moving)
+	{
+		if ((abs(path[0] - cog.get_u()) < positionErrorTolerance) && (abs(path[1] - cog.get_v()) < positionErrorTolerance))
 		{
-			if ((abs(vec_x.at((long long)k + 2) - cog.get_u()) < positionErrorTolerance) && ((abs(vec_y.at((long long)k + 2) - cog.get_v()) < positionErrorTolerance)))
-			{
-				k = k + 3;
-				cout << "Skipped 2" << endl;
-			}
+			moving = 1;
+			lastTime = now;
+			startTrajectoryCycle();
+			if (learningControl)
+				MyLearning.prepare(trajectory_id, n);
 		}
-	}
+		return vpImagePoint(path[1], path[0]);
+	}
+
+	double dt = (now - lastTime) / 1e6;
+	lastTime = now;
+
+	//Velocity profile
+	double length = arc[n - 1];
+	double maxSpeed = trackingSpeed * mm2pix;
+	double acceleration = trackingAcceleration * mm2pix;
+	while (j + 2 < n && arc[j + 1] <= s)
+		j++;
+	double t = (arc[j + 1] > arc[j]) ? (s - arc[j]) / (arc[j + 1] - arc[j]) : 0.0;
+	vpImagePoint reference(path[2 * j + 1] + t * (path[2 * j + 3] - path[2 * j + 1]), path[2 * j] + t * (path[2 * j + 2] - path[2 * j]));
+	double lag = vpImagePoint::distance(cog, reference);
+	if (learningControl)
+		MyLearning.record(MyTrajectories.indexAt(trajectory_id, s), cog.get_u() - reference.get_u(), cog.get_v() - reference.get_v());
+
+	double targetSpeed = (lag > maxTrackingLag) ? 0.0 : min(maxSpeed, sqrt(2 * acceleration * max(0.0, length - s)));
+	if (speed < targetSpeed)
+		speed = min(targetSpeed, speed + acceleration * dt);
+	else
+		speed = max(targetSpeed, speed - acceleration * dt);
+	s = min(length, s + speed * dt);
+
+	//Reference and path direction at the new arc length
+	while (j + 2 < n && arc[j + 1] <= s)
+		j++;
+	double segment = arc[j + 1] - arc[j];
+	t = (segment > 0) ? (s - arc[j]) / segment : 0.0;
+	reference.set_u(path[2 * j] + t * (path[2 * j + 2] - path[2 * j]));
+	reference.set_v(path[2 * j + 1] + t * (path[2 * j + 3] - path[2 * j + 1]));
+	double tangentU = (segment > 0) ? (path[2 * j + 2] - path[2 * j]) / segment : 0.0;
+	double tangentV = (segment > 0) ? (path[2 * j + 3] - path[2 * j + 1]) / segment : 0.0;
+
+	sumLag += lag;
+	maxLag = max(maxLag, lag);
+	lagSamples++;
+	double projected, error;
+	if (MyTrajectories.project(trajectory_id, cog.get_u(), cog.get_v(), s - maxTrackingLag - stepsize, s + stepsize, projected, error))
+		addCrossTrackError(error);
+
+	MyVision.drawCross(reference, vpColor::orange);
+
+	//Feedforward: lead the solver target along the path
+	vpImagePoint positionCommand;
+	positionCommand.set_u(reference.get_u() + tangentU * speed * feedforwardTime);
+	positionCommand.set_v(reference.get_v() + tangentV * speed * feedforwardTime);
 
-	if (k == vec_x.size())
+	//Learned correction of the commanded sample
+	if (learningControl)
 	{
-		k = 0;
+		double du, dv;
+		MyLearning.correction(MyTrajectories.indexAt(trajectory_id, s + speed * feedforwardTime), du, dv);
+		positionCommand.set_u(positionCommand.get_u() + du);
+		positionCommand.set_v(positionCommand.get_v() + dv);
+	}
 
+	if (s >= length && lag < positionErrorTolerance)
+	{
 		nRepeats = nRepeats + 1;
+		reportTrajectoryCycle("Timed");
+		if (learningControl)
+			MyLearning.endIteration();
+		cout << "At " << trackingSpeed << "mm/s, mean lag " << sumLag / lagSamples / mm2pix << "mm, max lag " << maxLag / mm2pix << "mm" << endl;
 		cout << "Iteration No: " << nRepeats + 1 << endl;
 
 		trajectoryStarted = 0;
 	}
+
 	return positionCommand;
 }
 
@@ -931,15 +1403,15 @@ vpImagePoint  spiralTrajectory(vpImagePoint cog)
 * Input: COG of the object
 * Output: Null
 *======================================================*/
-vpImagePoint  p2p(vpImagePoint cog)
+vpImagePoint  RigSession::p2p(vpImagePoint cog)
 {
 
 	vpImagePoint positionCommand;
-	static int k;
-	static int p;
-	static std::vector<double> x;
-	static std::vector<double> y;
-	static bool start_delay_loop = false;
+	int& k = pointToPoint.k;
+	int& p = pointToPoint.p;
+	std::vector<double>& x = pointToPoint.x;
+	std::vector<double>& y = pointToPoint.y;
+	bool& start_delay_loop = pointToPoint.start_delay_loop;
 
 	// 7-segment style coordinates
 	double	     MX = 470;
@@ -971,7 +1443,8 @@ vpImagePoint  p2p(vpImagePoint cog)
 	}
 
 
-	if (trajectory_id == ID_V)
+	const std::string name = (trajectory_id < MyTrajectories.size()) ? MyTrajectories.getName(trajectory_id) : "";
+	if (name == "V")
 	{
 		x.assign({ LX, LX, MX, MX, RX, RX,LX, LX, MX, MX, RX, RX, });
 		y.assign({ HY, LY, HY, LY, HY, LY,LY, HY, LY, HY, LY, HY, });
@@ -979,7 +1452,7 @@ vpImagePoint  p2p(vpImagePoint cog)
 
 
 
-	else if (trajectory_id == ID_H)
+	else if (name == "H")
 	{
 		x.assign({ LX, RX, LX, RX, LX, RX, RX, LX, RX, LX, RX, LX });
 		y.assign({ LY, LY, MY, MY, HY, HY, LY, LY, MY, MY, HY, HY });
@@ -1026,23 +1499,19 @@ vpImagePoint  p2p(vpImagePoint cog)
 * Input: COG of the object
 * Output: Null
 *======================================================*/
-vpImagePoint  stepping(vpImagePoint cog)
+vpImagePoint  RigSession::stepping(vpImagePoint cog)
 {
 	vpImagePoint positionCommand;
-	static double x;
-	static double y;
+	double& x = stepU;
+	double& y = stepV;
 
-	if ((GetKeyState('V') & 0x8000)) // Press V to change variable
+	if (KeyPressed('V')) // Press V to change variable
 	{
-		while (GetKeyState('V') & 0x8000);//wait for unpress
-
 		stepX = !stepX;
 	}
 
-	if ((GetKeyState('E') & 0x8000)) // Press E to give step
+	if (KeyPressed('E')) // Press E to give step
 	{
-		while (GetKeyState('E') & 0x8000);//wait for unpress
-
 		if (stepX)
 			x = x + 50;
 		else
@@ -1068,13 +1537,13 @@ vpImagePoint  stepping(vpImagePoint cog)
 * Input: NULL
 * Output: NULL
 *======================================================*/
-void startLogging()
+void RigSession::startLogging()
 {
 	auto now = std::chrono::system_clock::now();
 	auto in_time_t = std::chrono::system_clock::to_time_t(now);
 	std::stringstream ss;
 	ss << std::put_time(std::localtime(&in_time_t), "%Y_%m_%d_%H_%M_%S");
-	string filename = ss.str() + ".txt";
+	string filename = filePrefix + ss.str() + ".txt";
 
 	outfile.open(filename, ios::out);
 
@@ -1085,7 +1554,7 @@ void startLogging()
 * Input: NULL
 * Output: NULL
 *======================================================*/
-void stopLogging()
+void RigSession::stopLogging()
 {
 	outfile.close();
 }
@@ -1095,8 +1564,9 @@ void stopLogging()
 * Input: NULL
 * Output: NULL
 *======================================================*/
-void displayParticleMotionVector(vpImagePoint realArrowBegin, vpImagePoint realArrowEnd, float scalingFactor)
+void RigSession::displayParticleMotionVector(vpImagePoint realArrowBegin, vpImagePoint realArrowEnd, float scalingFactor)
 {
+#ifndef headless
 	vpImagePoint displayArrowEndCoord;
 	double u;
 	double v;
@@ -1118,6 +1588,7 @@ void displayParticleMotionVector(vpImagePoint realArrowBegin, vpImagePoint realA
 
 	//Display velocity vector
 	MyVision.DisplayArrow(realArrowEnd, displayArrowEndCoord, vpColor::lightBlue);
+#endif
 }
 
 /**====================================================
@@ -1125,8 +1596,9 @@ void displayParticleMotionVector(vpImagePoint realArrowBegin, vpImagePoint realA
 * Input: Coil status, Coil positions
 * Output: NULL
 *======================================================*/
-void displayCoilStatus(uInt8 coilData, vpImagePoint coilPositions[])
+void RigSession::displayCoilStatus(uInt8 coilData, vpImagePoint coilPositions[])
 {
+#ifndef headless
 	for (int i = 0; i < numberOfCoils; i++)
 	{
 		if (coilData & (1 << i))
@@ -1144,547 +1616,173 @@ void displayCoilStatus(uInt8 coilData, vpImagePoint coilPositions[])
 			MyVision.drawCross(coilPositions[i], vpColor::red);
 		}
 	}
+#endif
 
 }
 
-/**=============================================================================
-* Function to perform open loop different distance vs velocity experiments
-* Input: COG of the object, Activation coils, Coil positions, Command Position
-* Output: Null
-*==============================================================================*/
-void openLoopDifferentDistancesExp(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition)
+/**====================================================
+* Function to start an experiment. The ids of the experiment file come first,
+* then the coroutine scripts (ExperimentScript.h).
+* Input: Experiment id
+* Output: bool (1 if started)
+*======================================================*/
+bool RigSession::startExperiment(int id)
 {
-	static int state = 0;
-
-	const uInt8 initialCoilActuation = 0b00001000;
-	static uInt8 coils;
-
-	vpImagePoint positionCommand;
-	static int k;
-
-	static int nIterations = 0;
-	const int maxIterations = 6;
-
-	static std::vector<double> vec_x;
-	static std::vector<double> vec_y;
-
-	//center coordinates
-	double	     MX = 470;
-	double       MY = 532;
-	vpImagePoint center;
-	center.set_u(MX);
-	center.set_v(MY);
-	// circle spec
-	double radius = 120.0;
-	double noEntryRadius = 140.0;
-	double tlr = 20;
-	int steps = 5;//360;
-
-	chrono::high_resolution_clock::time_point currentTime = chrono::high_resolution_clock::now();
-	static chrono::high_resolution_clock::time_point startTime;
-	long long duration = 0;
-
-	MyVision.drawCircleWithRadius(center, (int)radius, vpColor::darkGreen, 0);
-	MyVision.drawCircleWithRadius(center, (int)noEntryRadius, vpColor::darkRed, 0);
-	//Reset variables
-	if (state == 0)
-	{
-		k = 0;//4;
-		vec_x = linspace(coilTip[3].get_u(), MX, steps);
-		vec_y = linspace(MY + radius - tlr, MY - radius + tlr, steps);
-		state = 1;
-		coils = initialCoilActuation; //First coil to activate
-		cout << "Initialized" << endl;
-	}
-
-	if (state == 1)
-	{
-		cmdPosition.set_u(vec_x[k]);
-		cmdPosition.set_v(vec_y[k]);
-		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-
-		for (int i = 0; i < steps; i++)
-			MyVision.drawCross(vpImagePoint(vec_y[i], vec_x[i]), vpColor::yellow);
-	}
-
-	if (state == 1 && ((abs(vec_x[k] - cog.get_u()) < positionErrorTolerance) && (abs(vec_y[k] - cog.get_v()) < positionErrorTolerance)))
-	{
-		cmdPosition.set_u(vec_x[k]);
-		cmdPosition.set_v(vec_y[k]);
-		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-		startTime = chrono::high_resolution_clock::now();
-		state = 2;
-	}
-	if (state == 2)
-	{
-		cmdPosition.set_u(vec_x[k]);
-		cmdPosition.set_v(vec_y[k]);
-		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
-	}
-
-	if (state == 2 && duration > 1000)
-	{
-		coilActivation = 0b00000000;
-		startTime = chrono::high_resolution_clock::now();
-		state = 3;
-	}
-
-	if (state == 3)
-	{
-		coilActivation = 0b00000000;
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
-
-		for (int i = 0; i < steps; i++)
-			MyVision.drawCross(vpImagePoint(vec_y[i], vec_x[i]), vpColor::yellow);
-	}
-
-	if (state == 3 && duration > 1000)
-	{
-
-		startRecording = 1;
-		startTime = chrono::high_resolution_clock::now();
-		state = 4;
-	}
-	if (state == 4)
-	{
-		coilActivation = coils;
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
-
-		for (int i = 0; i < steps; i++)
-			MyVision.drawCross(vpImagePoint(vec_y[i], vec_x[i]), vpColor::yellow);
-	}
-
-	if (state == 4 && ((duration > 10000) || ((abs(MX - cog.get_u()) > noEntryRadius) || (abs(MY - cog.get_v()) > noEntryRadius))))
-	{
-		stopRecording = 1;
-
-		if (nIterations < maxIterations - 1)
-		{
-			nIterations++;
-			state = 1;
-		}
-		else
-		{
-			k++;
-			if (k == steps)
-				k = 0;
-			nIterations = 0;
-			state = 1;
-		}
+	if (id < MyExperiments.size())
+		return MyExperiments.start(id);
+	return MyScripts.start(id - MyExperiments.size());
+}
 
-	}
+void RigSession::stopExperiment()
+{
+	MyExperiments.stop();
+	MyScripts.stop();
+	MyControl.releaseSchedule(1);
+	actuation.id = -1;
 }
 
-/**=============================================================================
-* Function to perform open loop voltage vs velocity experiments
+/**====================================================
+* Function to run the selected experiment for one frame. Closed loop phases
+* set the target and leave the coils to the solver.
 * Input: COG of the object, Activation coils, Coil positions, Command Position
-* Output: Null
-*==============================================================================*/
-void openLoopDifferentVoltageExp(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition)
+* Output: NULL
+*======================================================*/
+void RigSession::runExperiment(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition)
 {
-	static int state = 0;
-
-	const uInt8 initialCoilActuation = 0b00001000;
-	static uInt8 coils;
-
-	vpImagePoint positionCommand;
-	static int k;
-
-	static int nIterations = 0;
-	const int maxIterations = 6;
-	//center coordinates
-	double	     MX = 450;
-	double       MY = 532;
-	vpImagePoint center;
-	center.set_u(MX);
-	center.set_v(MY);
-	// circle spec
-	double radius = 120.0; //pixels
-	double tlr = 40;
-
-	chrono::high_resolution_clock::time_point currentTime = chrono::high_resolution_clock::now();
-	static chrono::high_resolution_clock::time_point startTime;
-	long long duration = 0;
-
-	MyVision.drawCircleWithRadius(center, (int)radius, vpColor::darkRed, 0);
-	//Reset variables
-	if (state == 0)
-	{
-		state = 1;
-		coils = initialCoilActuation; //First coil to activate
-		cout << "Initialized" << endl;
-	}
-
-	if (state == 1)
-	{
-		cmdPosition.set_u(MX);
-		cmdPosition.set_v(MY + radius - tlr);
-		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-	}
+	double targetU = cmdPosition.get_u();
+	double targetV = cmdPosition.get_v();
+	unsigned char coils = 0;
+	bool closedLoop;
+	double regionU, regionV, halfWidth;
+	bool region;
+	CoilSchedule schedule;
+	int actuationId;
+	bool actuating;
 
-	if (state == 1 && ((abs(MX - cog.get_u()) < positionErrorTolerance) && (abs(MY + radius - tlr - cog.get_v()) < positionErrorTolerance)))
+	if (MyScripts.isRunning())
 	{
-		coilActivation = 0b00000000;
-		startTime = chrono::high_resolution_clock::now();
-		state = 2;
+		closedLoop = MyScripts.step(cog.get_u(), cog.get_v(), targetU, targetV, coils);
+		region = MyScripts.getRegion(regionU, regionV, halfWidth);
+		actuating = MyScripts.getActuation(schedule.mask, schedule.duty, schedule.periodMs, schedule.ms, actuationId);
+		MyVision.DisplayText(MyScripts.getStatus(), 15, 60, vpColor::darkRed);
 	}
-	if (state == 2)
+	else
 	{
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
+		closedLoop = MyExperiments.step(cog.get_u(), cog.get_v(), targetU, targetV, coils);
+		region = MyExperiments.getRegion(regionU, regionV, halfWidth);
+		actuating = MyExperiments.getActuation(schedule.mask, schedule.duty, schedule.periodMs, schedule.ms, actuationId);
+		MyVision.DisplayText(MyExperiments.getStatus(), 15, 60, vpColor::darkRed);
 	}
 
-	if (state == 2 && duration > 1000)
+	//Hardware timed output: the whole actuation is played on the sample clock
+	if (MyControl.isWaveform())
 	{
-
-		startRecording = 1;
-
-		startTime = chrono::high_resolution_clock::now();
-		state = 3;
-	}
-	if (state == 3)
-	{
-		coilActivation = coils;
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
-	}
-
-	if (state == 3 && ((duration > 10000) || ((abs(MX - cog.get_u()) > radius) || (abs(MY - cog.get_v()) > radius))))
-	{
-		stopRecording = 1;
-
-		if (nIterations < maxIterations - 1)
+		if (actuating && actuationId != actuation.id)
 		{
-			nIterations++;
-			cout << "nIterations" << nIterations + 1 << endl;
-			state = 1;
+			MyControl.playSchedule(schedule);
+			actuation.id = actuationId;
+			actuation.start = loopClock->nowMs();
+			actuation.ms = schedule.ms;
 		}
-		else
+		else if (!actuating && actuation.id >= 0)
 		{
-			nIterations = 0;
-			state = 1;
+			//Actuations that ended early (abort region) are cut, the others play to the end
+			MyControl.releaseSchedule(loopClock->nowMs() - actuation.start + 1 < actuation.ms);
+			actuation.id = -1;
 		}
 	}
 
-}
-
-/**=============================================================================
-* Function to perform open loop infinity test
-* Input: COG of the object, Activation coils, Coil positions, Command Position
-* Output: Null
-*==============================================================================*/
-void openLoopInfinityExp(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition)
-{
-	static int state = 0;
-
-	const uInt8 initialCoilActuation = 0b00001000;
-	static uInt8 coils;
-
-	vpImagePoint positionCommand;
-	static int k;
-
-	static int nIterations = 0;
-	const int maxIterations = 6;
-
-	//center coordinates
-	double	     MX = 470;
-	double       MY = 532;
-	vpImagePoint center;
-	center.set_u(MX);
-	center.set_v(MY);
-	// circle spec
-	double radius = 120.0; //pixels
-	double tlr = 40;
-	chrono::high_resolution_clock::time_point currentTime = chrono::high_resolution_clock::now();
-	static chrono::high_resolution_clock::time_point startTime;
-
-	long long duration = 0;
-
-	MyVision.drawCircleWithRadius(center, (int)radius, vpColor::darkRed, 0);
-	//Reset variables
-	if (state == 0)
-	{
-		state = 1;
-		coils = initialCoilActuation; //First coil to activate
-		cout << "Initialized" << endl;
-	}
-
-	if (state == 1)
-	{
-		cmdPosition.set_u(MX);
-		cmdPosition.set_v(MY + radius - 40);
+	cmdPosition.set_u(targetU);
+	cmdPosition.set_v(targetV);
+	if (closedLoop)
 		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-	}
-
-	if (state == 1 && ((abs(MX - cog.get_u()) < positionErrorTolerance) && (abs(MY + radius - tlr - cog.get_v()) < positionErrorTolerance)))
-	{
-		startTime = chrono::high_resolution_clock::now();
-		state = 2;
-	}
-	if (state == 2)
-	{
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
-	}
-
-	if (state == 2 && duration > 1000)
-	{
-
-		startRecording = 1;
-		startTime = chrono::high_resolution_clock::now();
-		state = 3;
-	}
-	if (state == 3)
-	{
+	else
 		coilActivation = coils;
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
-	}
+	if (region)
+		MyVision.drawCircleWithRadius(vpImagePoint(regionV, regionU), (int)halfWidth, vpColor::darkRed, 0);
 
-	if (state == 3 && ((duration > 10000)))
+	if (!MyExperiments.isRunning() && !MyScripts.isRunning())
 	{
-		stopRecording = 1;
-
-		if (nIterations < maxIterations - 1)
-		{
-			nIterations++;
-			cout << "nIterations" << nIterations + 1 << endl;
-			state = 1;
-		}
-		else
-		{
-			nIterations = 0;
-			state = 1;
-		}
-
-
+		cout << "Stopped  Open Loop Control" << endl;
+		openLoopMode = 0;
 	}
-
 }
 
-/**=============================================================================
-* Function to perform open loop different combination vs velocity experiments
-* Input: COG of the object, Activation coils, Coil positions, Command Position
-* Output: Null
-*==============================================================================*/
-void openLoopDifferentCombinationsExp(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition)
+/**====================================================
+* Function to run a single rig on the calling thread
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void VisionServoing()
 {
-	static int state = 0; // 0 Initialize, 1 Move to shooting point, 
-
-	const uInt8 initialCoilActuation = 0b00001000;
-	static uInt8 coils;
-
-	vpImagePoint positionCommand;
-	static int k;
-
-	static int nIterations = 0;
-	const int maxIterations = 7;
-
-	//center coordinates
-	double	     MX = 470;
-	double       MY = 532;
-	vpImagePoint center;
-	center.set_u(MX);
-	center.set_v(MY);
-	// circle spec
-	double radius = 120.0; //pixels
-
-	chrono::high_resolution_clock::time_point currentTime = chrono::high_resolution_clock::now();
-	static chrono::high_resolution_clock::time_point startTime;
-	long long duration = 0;
-
-	MyVision.drawCircleWithRadius(center, (int)radius, vpColor::darkRed, 0);
-	//Reset variables
-	if (state == 0)
-	{
-		k = 0;
-		state = 1;
-		coils = initialCoilActuation; //First coil to activate
-		cout << "Initialized" << endl;
-	}
-
-	if (state == 1 || state == 2)
-	{
-		cmdPosition.set_u(MX);
-		cmdPosition.set_v(MY);
-		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-	}
-
-	if (state == 1 && ((abs(cmdPosition.get_u() - cog.get_u()) < positionErrorTolerance) && (abs(cmdPosition.get_v() - cog.get_v()) < positionErrorTolerance)))
-	{
-		startTime = chrono::high_resolution_clock::now();
-		state = 2;
-	}
-	if (state == 2 || state == 3)
-	{
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
-	}
-
-	if (state == 3 && duration > 1000)
-	{
-		startRecording = 1;
-		coilActivation = coils;
-		startTime = chrono::high_resolution_clock::now();
-		state = 4;
-	}
-	if (state == 2 && duration > 1000)
-	{
-		startTime = chrono::high_resolution_clock::now();
-		coilActivation = 0b00000000;
-		state = 3;
-	}
+	RigSession* rig = new RigSession();
+	rig->run();
+	delete rig;
+}
 
-	if (state == 4)
-	{
-		coilActivation = coils;
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
-	}
+/**====================================================
+* Function to load the rigs of the bench
+* Input: File name, rigs (output)
+* Output: bool (1 if at least one rig was read)
+*======================================================*/
+bool LoadRigs(const std::string& fileName, std::vector<RigConfig>& rigs)
+{
+	ifstream file(fileName);
+	if (!file.is_open())
+		return false;
 
-	if (state == 4 && ((duration > 10000) || ((abs(MX - cog.get_u()) > radius) || (abs(MY - cog.get_v()) > radius))))
+	rigs.clear();
+	string line;
+	while (getline(file, line))
 	{
-		stopRecording = 1;
+		if (line.empty() || line[0] == '#')
+			continue;
 
-		if (nIterations < maxIterations - 1)
+		stringstream ss(line);
+		RigConfig rig;
+		if (!(ss >> rig.name >> rig.cameraIndex >> rig.doChannel >> rig.core))
 		{
-			nIterations++;
-			state = 1;
+			cout << "Invalid rig: " << line << endl;
+			continue;
 		}
-		else
-		{
-			k++;
-			if (k > 7)
-			{
-				k = 0;
-				coils = 0b00001000;
-			}
-			if (k == 1)
-				coils = 0b00000100;
-			if (k == 2)
-				coils = 0b00001100;
-			if (k == 3)
-				coils = 0b00011100;
-			if (k == 4)
-				coils = 0b00001110;
-
-			if (k > 4)
-			{
-				k = 0;
-				coils = 0b00001000;
-			}
-
-			nIterations = 0;
-			state = 1;
-		}
-
+		string model;
+		if (ss >> model)
+			rig.forceModel = model;
+		rig.input = rigs.empty();
+		rigs.push_back(rig);
 	}
+	return !rigs.empty();
 }
 
-/**=============================================================================
-* Function to perform closed loop positioning experiment
-* Input: COG of the object, Activation coils, Coil positions, Command Position
-* Output: Null
-*==============================================================================*/
-void closedLoopPosititioningExp(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition)
+/**====================================================
+* Function to run every rig of the bench on its own thread. Without a rig file
+* a single rig runs on the calling thread.
+* Input: Rig file name
+* Output: 0
+*======================================================*/
+int RunRigs(const std::string& fileName)
 {
-	static int state = 0;
-
-	const uInt8 initialCoilActuation = 0b00001000;
-	static uInt8 coils;
-
-	vpImagePoint positionCommand;
-	static int k;
-
-	static int nIterations = 0;
-	const int maxIterations = 1;
-
-	static std::vector<double> vec_x;
-	static std::vector<double> vec_y;
-
-	//center coordinates
-	double	     MX = 470;
-	double       MY = 532;
-	vpImagePoint center;
-	center.set_u(MX);
-	center.set_v(MY);
-	// circle spec
-	double radius = 10.0;
-	double tlr = 9;
-	int steps = 3;
-
-	chrono::high_resolution_clock::time_point currentTime = chrono::high_resolution_clock::now();
-	static chrono::high_resolution_clock::time_point startTime;
-	long long duration = 0;
-
-	MyVision.drawCircleWithRadius(center, (int)radius, vpColor::darkGreen, 0);
-	//Reset variables
-	if (state == 0)
-	{
-		k = 0;
-		vec_x = linspace(MX - tlr, MX + tlr, steps);
-		vec_y = linspace(MY + radius, MY - radius, steps);
-
-		state = 1;
-
-		coils = initialCoilActuation; //First coil to activate
-		cout << "Initialized Closed loop positioning Test" << endl;
-	}
-
-	if (state == 1)
-	{
-		cmdPosition.set_u(vec_x[k]);
-		cmdPosition.set_v(vec_y[k]);
-		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-
-		for (int i = 0; i < steps; i++)
-			MyVision.drawCross(vpImagePoint(vec_y[i], vec_x[i]), vpColor::yellow);
-	}
-
-	if (state == 1 && ((abs(vec_x[k] - cog.get_u()) < positionErrorTolerance) && (abs(vec_y[k] - cog.get_v()) < positionErrorTolerance)))
-	{
-		startTime = chrono::high_resolution_clock::now();
-		state = 2;
-	}
-	if (state == 2)
-	{
-		cmdPosition.set_u(vec_x[k]);
-		cmdPosition.set_v(vec_y[k]);
-		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
-		for (int i = 0; i < steps; i++)
-			MyVision.drawCross(vpImagePoint(vec_y[i], vec_x[i]), vpColor::yellow);
-
-	}
-
-	if (state == 2 && duration > 2000)
+	std::vector<RigConfig> rigs;
+	if (!LoadRigs(fileName, rigs))
 	{
-		startRecording = 1;
-		cmdPosition.set_u(vec_x[k]);
-		cmdPosition.set_v(vec_y[k]);
-		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-		startTime = chrono::high_resolution_clock::now();
-		state = 3;
+		VisionServoing();
+		return 0;
 	}
 
-	if (state == 3)
+	cout << "Running " << rigs.size() << " rigs" << endl;
+	std::vector<RigSession*> sessions;
+	std::vector<std::thread> threads;
+	for (size_t r = 0; r < rigs.size(); r++)
 	{
-		duration = chrono::duration_cast<chrono::milliseconds>(currentTime - startTime).count();
-		cmdPosition.set_u(vec_x[k]);
-		cmdPosition.set_v(vec_y[k]);
-		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-
-		for (int i = 0; i < steps; i++)
-			MyVision.drawCross(vpImagePoint(vec_y[i], vec_x[i]), vpColor::yellow);
+		cout << "Rig " << rigs[r].name << ": camera " << rigs[r].cameraIndex << ", " << rigs[r].doChannel << ", core " << rigs[r].core << endl;
+		sessions.push_back(new RigSession(rigs[r]));
 	}
-
-	if (state == 3 && (duration > 60000))
+	for (size_t r = 0; r < sessions.size(); r++)
+		threads.push_back(std::thread(&RigSession::run, sessions[r]));
+	for (size_t r = 0; r < threads.size(); r++)
 	{
-		stopRecording = 1;
-		k++;
-		if (k >= steps)
-			k = 0;
-
-		cmdPosition.set_u(vec_x[k]);
-		cmdPosition.set_v(vec_y[k]);
-		coilActivation = MyControl.selectCoilsLP(cog, cmdPosition, coilTip);
-		nIterations = 0;
-		state = 1;
+		threads[r].join();
+		delete sessions[r];
 	}
+	return 0;
 }
-
@@ -2,13 +2,34 @@
 #ifndef VISUALSERVO_H
 #define VISUALSERVO_H
 
+#include <atomic>
 #include <chrono>
 #include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
 
 #include "Vision.h"
 
 #include "Controller.h"
 
+#include "Simulator.h"
+#include "LoopClock.h"
+#include "FrameScheduler.h"
+#include "Profiler.h"
+#include "Trace.h"
+#include "PerfCounters.h"
+#include "Input.h"
+#include "CommandServer.h"
+#include "Telemetry.h"
+#include "TrajectoryLibrary.h"
+#include "IterativeLearning.h"
+#include "ExperimentRunner.h"
+#include "ExperimentScript.h"
+#include "ModelEstimator.h"
+#include "MultiParticle.h"
+#include "Watchdog.h"
+
 //#include "FlyCapture2.h"
 #include <thread>
 #include <visp3/core/vpConfig.h>
@@ -20,27 +41,6 @@
 //Defvions
 #define Automatic 1
 
-//Trajectory IDs
-#define ID_V 0 //Verticle Lines
-#define ID_A 1 //letter A
-#define ID_L 2 //letter L
-#define ID_T 3 //letter T
-#define ID_S 4 //letter S
-#define ID_e 5 //letter e
-#define ID_O 6 //letter D or O
-#define ID_I 7 //letter I
-#define ID_L 8 //letter L
-#define ID_U 9 //letter U
-#define ID_d 10 //letter d
-#define ID_H 11 //Horizontal Lines
-#define ID_SQUARE 12// Square
-#define ID_CIRCLE 13//Circle
-#define ID_SPIRAL 14//Spiral
-#define ID_HO 15 //Horizontal Lines Opposite
-#define ID_VO 16 //Verticle Lines Opposite
-
-#define nID 17 //number of IDs
-
 
 
 #define nExp 6
@@ -51,32 +51,219 @@
 #define IT 5
 #define MA2 6
 
+#define rigsFile "rigs.txt"
 
-//Function prototypes
-void displayParticleMotionVector(vpImagePoint realArrowBegin, vpImagePoint realArrowEnd, float scalingFactor);
-void displayCoilStatus(uInt8 activatedCoil, vpImagePoint coilPositions[]);
-void PrintTrajectoryID();
+/*	Note: Rig sessions
+*	Everything one manipulator needs is in a RigSession: the camera (MyVision),
+*	the DAQ (MyControl), the simulator, the clock and the frame scheduler, the
+*	command server and the telemetry, the mode flags and the state the trajectory
+*	functions keep between frames. run() drives the rig on the calling thread.
+*	The module singletons (MyProfiler, MyTrace, MyPerfCounters, MyTrajectories,
+*	MyExperiments, MyScripts, MyLearning, MyEstimator, MyMultiParticle) and the
+*	solver parameters of model.cpp are thread_local, so every rig thread has its
+*	own; currentRig and loopClock point to the session of the thread.
+*	rigs.txt lists the rigs of the bench, one per line:
+*		<name> <camera index> <DO port> <core> [force model file]
+*	e.g. "left 0 Dev1/port0 2 force_model_left.txt". RunRigs starts one thread
+*	per rig, pinned to <core> (-1 leaves it to the OS). The files of a rig are
+*	prefixed with its name (logs, videos, traces, experiment results), it listens
+*	on <name>.sock and publishes to ferro_telemetry_<name>. The keyboard, the
+*	clicks and the input script go to the first rig, the others are driven
+*	through their command servers. Q on the first rig stops all of them.
+*	Without rigs.txt a single rig runs on the main thread with the plain names.
+*/
 
-vpImagePoint  trajectory(vpImagePoint cog);
-vpImagePoint  stepping(vpImagePoint cog);
-vpImagePoint  p2p(vpImagePoint cog);
-vpImagePoint  circularTrajectory(vpImagePoint cog);
-vpImagePoint  spiralTrajectory(vpImagePoint cog);
+struct RigConfig
+{
+	std::string name;		// empty for a single rig
+	int cameraIndex = 0;
+	std::string doChannel = "Dev1/port0";
+	int core = -1;
+	std::string forceModel = forceModelFile;
+	bool input = true;		// keyboard, clicks and input script
+};
 
-void openLoopInfinityExp(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition);
-void openLoopDifferentDistancesExp(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition);
-void openLoopDifferentVoltageExp(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition);
-void openLoopDifferentCombinationsExp(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition);
+//Cycle time and cross-track error of the trajectory being followed
+struct TrajectoryCycle
+{
+	long long startTime;
+	double sumSquaredError;
+	double maxError;
+	long samples;
+};
 
-void closedLoopPosititioningExp(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition);
+class RigSession
+{
+public:
+	//Constructor
+	RigSession(const RigConfig& rigConfig = RigConfig());
 
-void VisionServoing();
+	void run();
+	void shutdown();
+
+	bool StartTracking();
+	bool StartParticleTracking();
+	uInt8 multiParticleControl(vpImagePoint& cog, vpImagePoint& cmdPosition);
+	void ApplyRemoteCommands(vpImagePoint& cmdPosition, long long& commandTicks);
+	vpImagePoint remoteWaypointTarget(vpImagePoint cog);
+	void publishTelemetry(vpImagePoint cog, vpImagePoint prevCog, vpImagePoint cmdPosition, uInt8 activationCoil, bool tracked);
+	void followSensorWindow(vpImagePoint cog, vpImagePoint prevCog, bool tracked);
+	void PrintTrajectoryID();
+	void PrintExperimentID();
+
+	vpImagePoint  trajectory(vpImagePoint cog);
+	vpImagePoint  timedTrajectory(vpImagePoint cog);
+	vpImagePoint  purePursuitTrajectory(vpImagePoint cog);
+	void startTrajectoryCycle();
+	void addCrossTrackError(double error);
+	void reportTrajectoryCycle(const char* trackingMode);
+	vpImagePoint  stepping(vpImagePoint cog);
+	vpImagePoint  p2p(vpImagePoint cog);
+
+	bool startExperiment(int id);
+	void stopExperiment();
+	void runExperiment(vpImagePoint cog, uInt8& coilActivation, vpImagePoint coilTip[], vpImagePoint& cmdPosition);
+
+	void startLogging();
+	void stopLogging();
+	void displayParticleMotionVector(vpImagePoint realArrowBegin, vpImagePoint realArrowEnd, float scalingFactor);
+	void displayCoilStatus(uInt8 activatedCoil, vpImagePoint coilPositions[]);
 
-void startLogging();
-void stopLogging();
+	RigConfig config;
+	std::string filePrefix; //rig name + "_", empty for a single rig
 
+	// State variables
+	bool mode = 0; //1 auto 0 manual
+	bool userReqStop = 0;
+	bool stopCondition = 0;
+	bool stopAllOperations = 0;
+	bool recording = 0;
+	bool trajectoryMode = 0;
+	bool p2pMode = 0;
+	bool oneCoilMode = 0;
+	bool stepMode = 0;
+	bool stepX = 1; //step direction: 1 for X, 0 for Y
+	bool stepModeStarted = 0;
+	bool trajectoryStarted = 0;
+	bool p2pStarted = 0;
+	bool programmableManipulationStarted = 0;
+	bool offTime = 0;
+	bool openLoopMode = 0;
+	bool purePursuit = 0; //Trajectory target a speed dependent distance ahead of the projected CoG
+	bool keyboardInputEnabled = 1;
+	bool DisplayVariables = 0;
+	int trajectory_id = 0;
+	int experiment_id = 0;
+	bool firstRun = 0;
+	bool startRecording = 0;
+	bool stopRecording = 0;
+	bool traceTimeline = 0; //Write a Chrome trace of the loop at exit
+	bool perfCountersEnabled = 0; //Hardware counters per stage (Linux), printed at exit
+	std::string inputScriptFile = "input_script.txt"; //Keys and clicks of a headless run
+	bool commandServerEnabled = 0; //Accept commands on a local socket (CommandServer.h)
+	bool telemetryEnabled = 0; //Publish every frame to shared memory (Telemetry.h)
+	bool waveformOutput = 0; //Sample clocked coil output, actuations timed by the DAQ (CoilWaveform.h)
+	bool watchdogEnabled = 1; //Coils off when no frame starts for watchdogDeadline (Watchdog.h)
+	double watchdogDeadline = watchdogDeadlineMs; //ms, at least two frame periods
+	bool sensorWindowMode = 0; //Camera reads a window around the particle (Format7 ROI), full frame when lost, F switches
+	int sensorWindowSize = 128; //pixels
+	double sensorWindowFps = 400.0; //Frame rate while the window is read
 
+	//Other variables
+	double stepsize = 6.0;
+	bool timedTracking = 0; //Trajectories follow a moving reference instead of waiting at every point
+	double trackingSpeed = 1.0; //mm/s
+	double trackingAcceleration = 2.0; //mm/s^2
+	double feedforwardTime = 0.5; //s, lead of the solver target along the path
+	double maxTrackingLag = 30.0; //pixels, the reference waits while the particle is further behind
+	double lookaheadTime = 1.0; //s, pure pursuit lookahead distance per measured particle speed
+	double minLookahead = 12.0; //pixels
+	bool learningControl = 0; //Iterative learning control of timed tracking and pure pursuit
+	bool modelAdaptation = 0; //Online estimation of the coil force model (ModelEstimator.h)
+	bool multiParticleMode = 0; //Several particles steered with one mask per frame (MultiParticle.h)
+	int simulatedParticles = 1; //Particles of the simulated rig, placed around the center
+	int nextParticleTarget = 0; //Particle of the next clicked target
+	int nRepeats = 0;
+	double positionErrorTolerance = 3.0;
 
+	double MX = 470;
+	double MY = 532;
 
+	//Set the desired fps here.
+	float fps = 10.0;
+	float frameLength = 1000 / fps;
+	//What to give up on the frame after an overrun
+	OverrunPolicy overrunPolicy = OVERRUN_REPORT;
+
+	Vision MyVision;
+	Controller MyControl;
+#ifndef usingCamera
+	//Simulator (replaces the camera and the DAQ)
+	ParticleSimulator MySimulator;
+#endif
+	//Loop clock: real time with the camera, virtual time in simulation
+#ifdef usingCamera
+	WallClock MyClock;
+#else
+	VirtualClock MyClock;
+#endif
+	FrameScheduler MyScheduler;
+	LoopWatchdog MyWatchdog;
+	CommandServer MyCommandServer;
+	TelemetryPublisher MyTelemetry;
+
+	//Log file
+	std::ofstream outfile;
+
+	//Waypoints received from the command server
+	std::vector<vpImagePoint> remoteWaypoints;
+	size_t remoteWaypointIndex = 0;
+
+	// State kept between frames by the trajectory functions
+	TrajectoryCycle trajectoryCycle = {};
+	int pointIndex = 0;					// trajectory()
+	struct
+	{
+		double s = 0;					// arc length of the projected CoG (pixels)
+		double speed = 0;				// measured particle speed (pixels/s)
+		bool moving = 0;
+		long long lastTime = 0;
+		vpImagePoint lastCog;
+	} pursuit;							// purePursuitTrajectory()
+	struct
+	{
+		int j = 0;
+		double s = 0;					// arc length of the reference (pixels)
+		double speed = 0;				// pixels/s
+		bool moving = 0;
+		long long lastTime = 0;
+		double sumLag = 0, maxLag = 0;
+		long lagSamples = 0;
+	} timed;							// timedTrajectory()
+	struct
+	{
+		int k = 0;
+		int p = 0;
+		std::vector<double> x;
+		std::vector<double> y;
+		bool start_delay_loop = false;
+	} pointToPoint;						// p2p()
+	struct
+	{
+		int id = -1;					// actuation played on the sample clock
+		long long start = 0;			// ms
+		double ms = 0;
+	} actuation;						// runExperiment()
+	double stepU = 0, stepV = 0;		// stepping()
+	double prevTelemetryTimestamp = 0;	// publishTelemetry()
+};
+
+// Session of the rig running on this thread
+extern thread_local RigSession* currentRig;
+
+//Function prototypes
+void VisionServoing();
+bool LoadRigs(const std::string& fileName, std::vector<RigConfig>& rigs);
+int RunRigs(const std::string& fileName = rigsFile);
 
-#endif
\ No newline at end of file
+#endif
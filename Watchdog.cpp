@@ -0,0 +1,125 @@
+/*
+Watchdog.cpp - Coils off when the control loop misses its deadline
+Date: 2026-10-18
+Author: agent
+*/
+
+#include "Vision.h"
+#include "Controller.h"
+#include "Watchdog.h"
+#include "Profiler.h"
+#include "Input.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+//Constructor
+LoopWatchdog::LoopWatchdog() : running(false), heartbeat(0)
+{
+	control = NULL;
+	scope = NULL;
+	deadline = 0;
+	trips = 0;
+	longestStall = 0;
+	lastScope = NULL;
+}
+
+LoopWatchdog::~LoopWatchdog()
+{
+	stop();
+}
+
+long long LoopWatchdog::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**====================================================
+* Function to start watching the loop of the calling thread
+* Input: Controller of the coils, deadline (ms), rig name (for the messages)
+* Output: bool (1 if started)
+*======================================================*/
+bool LoopWatchdog::start(Controller* controller, double deadlineMs, const std::string& rigName)
+{
+	if (running)
+		return true;
+	control = controller;
+	scope = &loopScope;
+	name = rigName.empty() ? "Watchdog" : "Watchdog " + rigName;
+	deadline = (long long)(deadlineMs * 1e6);
+	trips = 0;
+	longestStall = 0;
+	lastScope = NULL;
+
+	beat();
+	running = true;
+	watchThread = std::thread(&LoopWatchdog::watch, this);
+	cout << name << ": coils off after " << deadlineMs << " ms without a frame" << endl;
+	return true;
+}
+
+void LoopWatchdog::stop()
+{
+	if (!running)
+		return;
+	running = false;
+	if (watchThread.joinable())
+		watchThread.join();
+}
+
+/**====================================================
+* Function run by the watchdog thread
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void LoopWatchdog::watch()
+{
+	bool tripped = false;
+	long long trippedBeat = 0;
+
+	while (running.load(std::memory_order_relaxed))
+	{
+		SleepMs(watchdogPollMs);
+		long long last = heartbeat.load(std::memory_order_acquire);
+		long long stall = now() - last;
+
+		if (!tripped && stall > deadline)
+		{
+			const char* stuck = scope->load(std::memory_order_relaxed);
+			bool off = control->forceOff();
+			tripped = true;
+			trippedBeat = last;
+			trips++;
+			lastScope = stuck;
+			cout << name << ": no frame for " << stall / 1000000 << " ms, loop in " << (stuck ? stuck : "no profiled stage")
+				<< (control->isSimulated() ? ", coils simulated" : off ? ", coils off" : ", could not turn the coils off") << endl;
+		}
+		else if (tripped && last != trippedBeat)
+		{
+			long long stalled = last - trippedBeat;
+			if (stalled > longestStall)
+				longestStall = stalled;
+			control->releaseForceOff();
+			tripped = false;
+			cout << name << ": loop resumed after " << stalled / 1000000 << " ms" << endl;
+		}
+	}
+
+	if (tripped)
+		control->releaseForceOff();
+}
+
+/**====================================================
+* Function to print the missed deadlines (after stop)
+* Input: NULL
+* Output: NULL
+*======================================================*/
+void LoopWatchdog::PrintReport()
+{
+	cout << name << ": " << trips << " missed deadlines";
+	if (trips)
+		cout << ", longest stall " << longestStall / 1000000 << " ms, last in " << (lastScope ? lastScope : "no profiled stage");
+	cout << endl;
+}
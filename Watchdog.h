@@ -0,0 +1,63 @@
+#pragma once
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+/*	Note: Loop watchdog
+*	The loop calls beat() at the start of every frame. A separate thread checks
+*	the heartbeat every watchdogPollMs on the steady clock and, when no frame has
+*	started for the deadline, turns the coils off (Controller::forceOff): it
+*	writes 0 to the on demand task of the loop from its own thread (DAQmx calls
+*	are thread safe, the started task reserves the lines for itself), or with the
+*	hardware timed output the streaming thread zeroes the stream, which keeps
+*	running while the loop is blocked. A failed write is printed with its DAQmx
+*	error. It logs the stage or traced scope the loop is stuck in (loopScope,
+*	Profiler.h), e.g. getClick or StartRecordingVideo. The loop gets the coils back
+*	at its next frame. The deadline is at least two frame periods, so the wait for
+*	the frame deadline never trips it.
+*/
+
+#define watchdogDeadlineMs 250.0
+#define watchdogPollMs 1
+
+class Controller;
+
+class LoopWatchdog
+{
+public:
+	//Constructor
+	LoopWatchdog();
+	~LoopWatchdog();
+
+	bool start(Controller* controller, double deadlineMs = watchdogDeadlineMs, const std::string& rigName = "");
+	void stop();
+	bool isRunning() { return running; }
+
+	// Called by the loop at the start of every frame
+	void beat() { heartbeat.store(now(), std::memory_order_release); }
+
+	void PrintReport();
+
+private:
+	void watch();
+	static long long now();	// steady clock (ns)
+
+	Controller* control;
+	const std::atomic<const char*>* scope;	// loopScope of the loop thread
+	std::string name;
+	long long deadline;						// ns
+
+	std::thread watchThread;
+	std::atomic<bool> running;
+	std::atomic<long long> heartbeat;
+
+	// Report
+	long trips;
+	long long longestStall;					// ns
+	const char* lastScope;
+};
+
+#endif //WATCHDOG_H
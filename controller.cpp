@@ -7,6 +7,10 @@ Author: P. A. Diluka Harischandra
 #include "Vision.h"
 
 #include "Controller.h"
+#include "Simulator.h"
+#include "Profiler.h"
+#include "PerfCounters.h"
+#include "Input.h"
 #include <stdio.h>
 #include <iostream>
 #include <vector>
@@ -22,9 +26,9 @@ Author: P. A. Diluka Harischandra
 using namespace std;
 
 //Constructor
-Controller::Controller()
+Controller::Controller(const std::string& channel)
 {
-	taskHandle = 0;
+	doChannel = channel;
 }
 
 /**====================================================
@@ -34,6 +38,8 @@ Controller::Controller()
 *======================================================*/
 uInt8 Controller::selectCoilsLP(vpImagePoint particlePos, vpImagePoint target, vpImagePoint coilTip[])
 {
+	PERF_STAGE(STAGE_SOLVER);
+	PROFILE_STAGE(STAGE_SOLVER);
 	uInt8 activationCoils = 0b00000000;
 	activationCoils = lpModel(particlePos, target, coilTip);
 	return activationCoils;
@@ -46,10 +52,37 @@ uInt8 Controller::selectCoilsLP(vpImagePoint particlePos, vpImagePoint target, v
 *======================================================*/
 void Controller::initDAQ()
 {
-		DAQmxErrChk(DAQmxCreateTask("", &taskHandle));
-		DAQmxErrChk(DAQmxCreateDOChan(taskHandle, "Dev1/port0", "", DAQmx_Val_ChanForAllLines));
+		if (simulator != NULL)
+		{
+#ifdef mockDAQ
+			//The mock records the coil output of the simulated rig, the simulator gets the frame masks
+			if (waveformMode && waveform.start(doChannel, waveformSampleRate))
+			{
+				cout << "Using simulated DAQ, hardware timed coil output to the mock at " << waveformSampleRate << " samples/s" << endl;
+				return;
+			}
+#endif
+			waveformMode = 0;
+			cout << "Using simulated DAQ" << endl;
+			return;
+		}
+		if (waveformMode)
+		{
+			if (waveform.start(doChannel, waveformSampleRate))
+			{
+				cout << "Hardware timed coil output at " << waveformSampleRate << " samples/s" << endl;
+				return;
+			}
+			cout << "Could not start the hardware timed coil output, using on demand writes" << endl;
+			waveformMode = 0;
+		}
+		TaskHandle task = 0;
+		DAQmxErrChk(DAQmxCreateTask("", &task));
+		DAQmxErrChk(DAQmxCreateDOChan(task, doChannel.c_str(), "", DAQmx_Val_ChanForAllLines));
 		// DAQmx Start Code
-		DAQmxErrChk(DAQmxStartTask(taskHandle));
+		DAQmxErrChk(DAQmxStartTask(task));
+		// The started task holds the lines, so the watchdog thread writes through it too
+		taskHandle.store(task, std::memory_order_release);
 }
 
 /**====================================================
@@ -59,7 +92,30 @@ void Controller::initDAQ()
 *======================================================*/
 void Controller::writeToDAQ(uInt8 data)
 {
-	DAQmxErrChk(DAQmxWriteDigitalU8(taskHandle, 1, 1, 10.0, DAQmx_Val_GroupByChannel, &data, NULL, NULL));
+	if (simulator != NULL)
+	{
+		simulator->setCoils(data);
+		if (!waveformMode)
+			return;
+	}
+	if (waveformMode)
+	{
+		if (!waveform.hasFailed())
+		{
+			if (!scheduleOwned)
+				waveform.setFrameMask(data);
+			return;
+		}
+		//Underflow or device error: the lines hold the last sample
+		cout << "Hardware timed coil output stopped, switching to on demand writes" << endl;
+		waveform.stop();
+		waveformMode = 0;
+		scheduleOwned = 0;
+		initDAQ();
+		if (simulator != NULL)
+			return;
+	}
+	DAQmxErrChk(DAQmxWriteDigitalU8(taskHandle.load(std::memory_order_relaxed), 1, 1, 10.0, DAQmx_Val_GroupByChannel, &data, NULL, NULL));
 }
 
 /**====================================================
@@ -69,13 +125,114 @@ void Controller::writeToDAQ(uInt8 data)
 *======================================================*/
 void Controller::stopDAQ()
 {
-	if (taskHandle != 0) {
+	if (waveformMode)
+	{
+		waveform.stop();
+		waveform.PrintReport();
+		waveformMode = 0;
+		scheduleOwned = 0;
+	}
+	TaskHandle task = taskHandle.exchange(NULL);
+	if (task != 0) {
+
+		DAQmxStopTask(task);
+		DAQmxClearTask(task);
+	}
+}
+
+
+/**====================================================
+* Function to route the coil outputs to the particle simulator
+* instead of the DAQ (call before initDAQ)
+* Input: Simulator, NULL to use the DAQ
+* Output: NULL
+*======================================================*/
+void Controller::useSimulator(ParticleSimulator *particleSimulator)
+{
+	simulator = particleSimulator;
+}
+
+/**====================================================
+* Function to drive the coils with the sample clocked output (call before
+* initDAQ). The frame masks and the patterns are then streamed by
+* CoilWaveform; with the simulator only when built with mockDAQ, to the mock.
+* Input: Sample rate (samples/s)
+* Output: NULL
+*======================================================*/
+void Controller::useWaveform(double sampleRate)
+{
+	waveformMode = 1;
+	waveformSampleRate = sampleRate;
+}
+
+/**====================================================
+* Function to play an open loop actuation on the sample clock. The frame
+* masks are ignored until the schedule is released.
+* Input: Schedule
+* Output: bool (1 if queued)
+*======================================================*/
+bool Controller::playSchedule(const CoilSchedule& schedule)
+{
+	if (!isWaveform() || waveform.hasFailed())
+		return false;
+	CoilPattern* pattern = new CoilPattern();
+	MakeCoilPattern(schedule, waveform.getRate(), *pattern);
+	waveform.cancel();
+	waveform.setFrameMask(0);
+	scheduleOwned = waveform.play(pattern);
+	return scheduleOwned;
+}
+
+/**====================================================
+* Function to give the coils back to the frame masks
+* Input: 1 to cut the pattern short, 0 to let it finish
+* Output: NULL
+*======================================================*/
+void Controller::releaseSchedule(bool cancel)
+{
+	if (!scheduleOwned)
+		return;
+	if (cancel)
+		waveform.cancel();
+	scheduleOwned = 0;
+}
 
-		DAQmxStopTask(taskHandle);
-		DAQmxClearTask(taskHandle);
+/**====================================================
+* Function to turn the coils off from the watchdog thread, while the loop may
+* be blocked anywhere. The hardware timed output is zeroed by its streaming
+* thread, the on demand output by a write to the task of the loop (DAQmx
+* calls are thread safe, and a second task could not start on the reserved
+* lines). The simulated coils need nothing, the simulated time stops with the
+* loop.
+* Input: NULL
+* Output: bool (1 if the coils were turned off)
+*======================================================*/
+bool Controller::forceOff()
+{
+	waveform.setForcedOff(true);
+	bool off = waveform.isStreaming();
+	TaskHandle task = taskHandle.load(std::memory_order_acquire);
+	if (task != NULL)
+	{
+		uInt8 allOff = 0;
+		int32 status = DAQmxWriteDigitalU8(task, 1, 1, 1.0, DAQmx_Val_GroupByChannel, &allOff, NULL, NULL);
+		if (!DAQmxFailed(status))
+			off = true;
+		else
+		{
+			//Not errBuff: the loop thread may be using it
+			char info[2048] = { '\0' };
+			DAQmxGetExtendedErrorInfo(info, 2048);
+			printf("DAQmx Error (watchdog): %s\n", info);
+		}
 	}
+	return off;
 }
 
+void Controller::releaseForceOff()
+{
+	waveform.setForcedOff(false);
+}
 
 /**====================================================
 * Function to handle DAQ Errors
@@ -103,7 +260,7 @@ uInt8 Controller::ManualCoilControl()
 	uInt8 manualCoilAct = 0b00000000;
 	//numpad buttons to the coils map
 	for (int i = 0; i < 9; i++)
-		num[i] = (bool)(GetKeyState(i + 97) & 0x8000);
+		num[i] = KeyDown(KEY_NUMPAD1 + i);
 
 	if (num[coil1_key])	manualCoilAct |= (1 << 0);
 	if (num[coil2_key]) manualCoilAct |= (1 << 1);
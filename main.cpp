@@ -2,7 +2,7 @@
 
 int main(int argc, char* argv[])
 {
-	VisionServoing();
+	RunRigs();
 			
 	return 0;
 }
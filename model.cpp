@@ -9,26 +9,102 @@ Author: P. A. Diluka Harischandra
 #include <stdio.h>
 #include <iostream>
 #include "Vision.h"
-#include <NIDAQmx.h>
 
 #include "Controller.h"
+#include "Input.h"
+#include "CommandServer.h"
+#include "ForceModel.h"
 using namespace std;
 
 
-bool incrementVal = 0;
-bool decrementVal = 0;
-int editingVariable = 0;
+//Solver state of the rig running on this thread (VisualServo.h)
+thread_local bool incrementVal = 0;
+thread_local bool decrementVal = 0;
+thread_local int editingVariable = 0;
 
 //initialize objective function weights
-double alpha = 0.4145;
-double beta = 0.2685;
-double gamma = 0.0001;
-double delta = 0.5;
-double changingValue = 0.005;
-double scalingFactorPower = 0;
-double mm2pix = 46.5;
+thread_local double alpha = 0.4145;
+thread_local double beta = 0.2685;
+thread_local double gamma = 0.0001;
+thread_local double delta = 0.5;
+thread_local double changingValue = 0.005;
+thread_local double scalingFactorPower = 0;
+thread_local double mm2pix = 46.5;
+//Force model per coil, v = gain * d ^ exponent (ForceModel.h)
+thread_local double coilGain[nModelCoils] = { 2.4675, 2.4675, 2.4675, 2.4675, 2.4675, 2.4675, 2.4675, 2.4675 };
+thread_local double coilExponent[nModelCoils] = { -0.8652, -0.8652, -0.8652, -0.8652, -0.8652, -0.8652, -0.8652, -0.8652 };
+
+thread_local bool PrintToConsole = 0; 
 
-bool PrintToConsole = 0; 
+/***********************************************************
+	Particle velocity (mm/s) produced by one coil at a
+	distance (mm) from its tip. Shared with the simulator.
+***********************************************************/
+double coilVelocityModel(int coil, double distance_mm)
+{
+	return pow(10.0, scalingFactorPower) * coilGain[coil] * pow(distance_mm, coilExponent[coil]);
+}
+
+/***********************************************************
+	Copy of the current force model
+***********************************************************/
+void getForceModel(ForceModel& model)
+{
+	model.mm2pix = mm2pix;
+	for (int i = 0; i < nModelCoils; i++)
+	{
+		model.gain[i] = coilGain[i];
+		model.exponent[i] = coilExponent[i];
+	}
+}
+
+/***********************************************************
+	Load the fitted force model (ForceModelFit) if there is one
+***********************************************************/
+bool loadForceModel(const std::string& fileName)
+{
+	ForceModel model;
+	getForceModel(model);
+	if (!ReadForceModel(fileName, model))
+	{
+		cout << "No force model file " << fileName << ", using the default model" << endl;
+		return false;
+	}
+
+	mm2pix = model.mm2pix;
+	for (int i = 0; i < nModelCoils; i++)
+	{
+		coilGain[i] = model.gain[i];
+		coilExponent[i] = model.exponent[i];
+		cout << "Coil " << i + 1 << ": v = " << coilGain[i] << " * d^" << coilExponent[i] << endl;
+	}
+	cout << "Loaded force model " << fileName << ", mm2pix " << mm2pix << endl;
+	return true;
+}
+
+/***********************************************************
+	Set a model weight from the command server (RemoteParam)
+***********************************************************/
+void setModelParameter(int parameter, double value)
+{
+	switch (parameter)
+	{
+	case PARAM_ALPHA: alpha = value; break;
+	case PARAM_BETA: beta = value; break;
+	case PARAM_GAMMA: gamma = value; break;
+	case PARAM_DELTA: delta = value; break;
+	case PARAM_MM2PIX:
+		if (value > 0)
+			mm2pix = value;
+		break;
+	case PARAM_SCALING_POWER: scalingFactorPower = value; break;
+	default:
+		cout << "Unknown model parameter " << parameter << endl;
+		return;
+	}
+	if (PrintToConsole)
+		cout << "Alpha " << alpha << " Beta " << beta << " Gamma " << gamma << " Delta " << delta << " Scaling Factor Power " << scalingFactorPower << " mm2pix " << mm2pix << endl;
+}
 
 /***********************************************************
 	Linear Programming model
@@ -37,7 +113,6 @@ uInt8 lpModel(vpImagePoint particlePos, vpImagePoint target, vpImagePoint coilTi
 {
 	uInt8 activationCoils = 0b00000000;
 	const int numberOfCoils = 8;
-	double scalingFactor;
 	double MPx = 0.0;
 	double MPy = 0.0;
 	double MP_norm = 0.0;
@@ -46,8 +121,6 @@ uInt8 lpModel(vpImagePoint particlePos, vpImagePoint target, vpImagePoint coilTi
 	double PTO_norm = 0.0;
 	double indicatorCoeficient = 20.0;
 
-	scalingFactor = pow(10.0, scalingFactorPower);
-
 	double Vx[numberOfCoils] = {};
 	double Vy[numberOfCoils] = {};
 
@@ -79,7 +152,7 @@ uInt8 lpModel(vpImagePoint particlePos, vpImagePoint target, vpImagePoint coilTi
 		MP[1] = particlePos.get_v() - coilTip[i].get_v();
 		MP_norm = MP.euclideanNorm();
 		
-		MF = scalingFactor * (2.4675 * pow(MP_norm / mm2pix, -0.8652)) * (MP / (MP_norm));
+		MF = coilVelocityModel(i, MP_norm / mm2pix) * (MP / (MP_norm));
 		
 		Vx[i] = vpColVector::dotProd(MF, PT_unitVec);
 		Vy[i] = vpColVector::dotProd(MF, PTO_unitVec);
@@ -169,13 +242,12 @@ uInt8 lpModel(vpImagePoint particlePos, vpImagePoint target, vpImagePoint coilTi
 void lpkeyboardInput()
 {
 
-if ((GetKeyState('P') & 0x8000)) // Detect if a key was pressed
+if (KeyPressed('P')) // Detect if a key was pressed
 {
-	while (GetKeyState('P') & 0x8000);//wait for unpress
 	cout << "Alpha " << alpha << "Beta " << beta << "Gamma " << gamma << "Delta " << delta << "Scaling Factor Power" << scalingFactorPower << "mm2pix " << mm2pix << "Changing Value " << changingValue << endl;
 }
 
-if ((GetKeyState('I') & 0x8000)) // Detect if a key was pressed
+if (KeyDown('I')) // Detect if a key was pressed
 {
 	if (editingVariable == 0)
 	{
@@ -208,7 +280,7 @@ if ((GetKeyState('I') & 0x8000)) // Detect if a key was pressed
 
 
 }
-if ((GetKeyState('D') & 0x8000)) // Detect if a key was pressed
+if (KeyDown('D')) // Detect if a key was pressed
 {
 	if (editingVariable == 0)
 	{
@@ -241,9 +313,8 @@ if ((GetKeyState('D') & 0x8000)) // Detect if a key was pressed
 }
 
 //Change variable
-if ((GetKeyState('C') & 0x8000))
+if (KeyPressed('C'))
 {
-	while (GetKeyState('C') & 0x8000);
 	editingVariable++;
 	if (editingVariable == 5)
 		editingVariable = 0;